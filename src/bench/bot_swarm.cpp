@@ -0,0 +1,317 @@
+// Load generator for a running server, without any window.
+// Spawns simulated players that connect with the SYN/SYNACK handshake, send their inputs every tick,
+// fire at a scripted rate and disconnect cleanly at the end, each one a Client without network thread.
+// Reports what the server tells about itself (time per tick, packets and bytes per second) and how long
+// a shot takes to come back from the server as a bullet, the delivery latency of an event.
+//
+// Usage: asteroids_bot_swarm [--address A] [--port N] [--bots N] [--threads N] [--duration S]
+//                            [--fire-interval MS] [--connect-interval MS]
+// The server only sends its stats when started with --server-stats, every second.
+// The ids of the players are a byte, so a server takes up to 255 of them.
+
+#include "networking/client.hpp"
+#include "networking/networking.hpp"
+#include "networking/tick_scheduler.hpp"
+#include "networking/utils.hpp"
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// A shot that did not come back as a bullet for this long is not waited for anymore, the ship may be out of lives
+	const unsigned FIRE_TIMEOUT = 1000;
+	// Longest a bot waits for the server to acknowledge its disconnection
+	const unsigned DISCONNECT_TIMEOUT = 1000;
+
+	struct Options
+	{
+		std::string mAddress = "127.0.0.1";
+		uint16_t mPort = 5999;
+		unsigned mBots = 200;
+		unsigned mThreads = 4;
+		unsigned mDuration = 30;
+		unsigned mFireInterval = 250;
+		unsigned mConnectInterval = 20;
+	};
+
+	struct Bot
+	{
+		std::unique_ptr<CS260::Client> mClient;
+		unsigned mIndex = 0;
+		unsigned mFireTimer = 0;
+		// When each shot still waiting for its bullet was sent, oldest first
+		std::deque<CS260::clock_t::time_point> mPendingFires;
+		bool mTimedOut = false;
+	};
+
+	// What the bots of every thread saw, merged at the end
+	struct Report
+	{
+		unsigned mConnected = 0;
+		unsigned mFailed = 0;
+		unsigned mTimedOut = 0;
+		unsigned mCleanDisconnections = 0;
+		unsigned long long mFires = 0;
+		unsigned long long mBullets = 0;
+		unsigned long long mUnanswered = 0;
+		std::vector<float> mLatencies;
+		std::vector<CS260::ServerStatsPacket> mServerStats;
+	};
+
+	std::mutex sReportMutex;
+	Report sReport;
+
+	// Thrusts most of the time and turns one way or the other, each bot with its own phase so they spread out
+	uint8_t ScriptedInput(const Bot& bot, unsigned tick)
+	{
+		unsigned phase = (tick + bot.mIndex * 37) % 240;
+		uint8_t input = phase < 180 ? CS260::InputThrust : 0;
+		if (phase % 60 < 15)
+			input |= (bot.mIndex + tick / 240) % 2 ? CS260::InputLeft : CS260::InputRight;
+		return input;
+	}
+
+	void HandleBullets(Bot& bot, Report& report)
+	{
+		auto current = CS260::now();
+		for (auto& bullet : bot.mClient->GetBulletsToCreate())
+		{
+			// Every shot of a ship becomes a bullet in order, so ours answer our oldest shots
+			if (bullet.mOwnerID != bot.mClient->GetPlayerID() || bot.mPendingFires.empty())
+				continue;
+			report.mLatencies.push_back(std::chrono::duration<float, std::milli>(current - bot.mPendingFires.front()).count());
+			report.mBullets++;
+			bot.mPendingFires.pop_front();
+		}
+
+		while (!bot.mPendingFires.empty() && current - bot.mPendingFires.front() > std::chrono::milliseconds(FIRE_TIMEOUT))
+		{
+			report.mUnanswered++;
+			bot.mPendingFires.pop_front();
+		}
+	}
+
+	void PrintServerStats(const CS260::ServerStatsPacket& stats, float seconds)
+	{
+		printf("%6.1fs players=%-4u ticks=%-3u tick avg=%7.3f ms max=%7.3f ms  out=%7u pkt/s %9u B/s  in=%7u pkt/s %9u B/s\n",
+			seconds, stats.mPlayers, stats.mTicks, stats.mTickTimeAverage / 1000.0f, stats.mTickTimeMax / 1000.0f,
+			stats.mPacketsSent, stats.mBytesSent, stats.mPacketsReceived, stats.mBytesReceived);
+	}
+
+	void Run(const Options& options, unsigned first, unsigned last, bool reportsStats, CS260::clock_t::time_point start)
+	{
+		Report report;
+
+		std::vector<Bot> bots;
+		unsigned next = first;
+		unsigned connectTimer = options.mConnectInterval;
+
+		CS260::TickScheduler ticks(CS260::tickRate);
+		unsigned tick = 0;
+		while (CS260::ms_since(start) < options.mDuration * 1000)
+		{
+			unsigned elapsed = ticks.ConsumeTicks();
+			if (elapsed == 0)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(ticks.GetMsUntilNextTick()));
+				continue;
+			}
+			tick += elapsed;
+
+			// The handshake blocks until the server answers it, so the bots join a few per tick while the others keep playing
+			connectTimer += CS260::tickRate * elapsed;
+			while (next < last && connectTimer >= options.mConnectInterval)
+			{
+				connectTimer -= options.mConnectInterval;
+				try
+				{
+					Bot bot;
+					bot.mClient = std::make_unique<CS260::Client>(options.mAddress, options.mPort, false, false);
+					bot.mIndex = next;
+					bot.mFireTimer = next * 13 % std::max(options.mFireInterval, 1u);
+					bots.push_back(std::move(bot));
+					report.mConnected++;
+				}
+				catch (const std::exception&)
+				{
+					report.mFailed++;
+				}
+				next++;
+			}
+
+			for (auto& bot : bots)
+			{
+				if (bot.mTimedOut)
+					continue;
+
+				bot.mClient->Tick(elapsed);
+				if (bot.mClient->ShouldClose())
+				{
+					bot.mTimedOut = true;
+					report.mTimedOut++;
+					continue;
+				}
+
+				HandleBullets(bot, report);
+
+				CS260::ServerStatsPacket stats;
+				if (reportsStats && &bot == &bots.front() && bot.mClient->GetServerStats(&stats))
+				{
+					PrintServerStats(stats, CS260::ms_since(start) / 1000.0f);
+					report.mServerStats.push_back(stats);
+				}
+
+				uint8_t input = ScriptedInput(bot, tick);
+				bot.mFireTimer += CS260::tickRate * elapsed;
+				if (options.mFireInterval > 0 && bot.mFireTimer >= options.mFireInterval)
+				{
+					bot.mFireTimer %= options.mFireInterval;
+					input |= CS260::InputFire;
+					bot.mPendingFires.push_back(CS260::now());
+					report.mFires++;
+				}
+
+				bot.mClient->QueueInput(input, CS260::tickRate * elapsed * 0.001f);
+				bot.mClient->Flush();
+			}
+		}
+
+		// Leave the way a player closing the game does, and wait for the server to acknowledge it
+		for (auto& bot : bots)
+		{
+			if (!bot.mTimedOut)
+				bot.mClient->NotifyDisconnection();
+		}
+		auto disconnectStart = CS260::now();
+		while (CS260::ms_since(disconnectStart) < DISCONNECT_TIMEOUT)
+		{
+			bool waiting = false;
+			for (auto& bot : bots)
+			{
+				if (bot.mTimedOut || bot.mClient->Disconnected())
+					continue;
+				bot.mClient->Tick();
+				bot.mClient->Flush();
+				waiting = waiting || !bot.mClient->Disconnected();
+			}
+			if (!waiting)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(CS260::tickRate));
+		}
+		for (auto& bot : bots)
+		{
+			if (!bot.mTimedOut && bot.mClient->Disconnected())
+				report.mCleanDisconnections++;
+		}
+
+		std::lock_guard<std::mutex> lock(sReportMutex);
+		sReport.mConnected += report.mConnected;
+		sReport.mFailed += report.mFailed;
+		sReport.mTimedOut += report.mTimedOut;
+		sReport.mCleanDisconnections += report.mCleanDisconnections;
+		sReport.mFires += report.mFires;
+		sReport.mBullets += report.mBullets;
+		sReport.mUnanswered += report.mUnanswered;
+		sReport.mLatencies.insert(sReport.mLatencies.end(), report.mLatencies.begin(), report.mLatencies.end());
+		sReport.mServerStats.insert(sReport.mServerStats.end(), report.mServerStats.begin(), report.mServerStats.end());
+	}
+
+	float Percentile(const std::vector<float>& sorted, unsigned percent)
+	{
+		if (sorted.empty())
+			return 0.0f;
+		return sorted[std::min<size_t>(sorted.size() - 1, sorted.size() * percent / 100)];
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc - 1; i++)
+	{
+		if (strcmp("--address", argv[i]) == 0)
+			options.mAddress = argv[i + 1];
+		if (strcmp("--port", argv[i]) == 0)
+			options.mPort = static_cast<uint16_t>(atoi(argv[i + 1]));
+		if (strcmp("--bots", argv[i]) == 0)
+			options.mBots = atoi(argv[i + 1]);
+		if (strcmp("--threads", argv[i]) == 0)
+			options.mThreads = std::max(atoi(argv[i + 1]), 1);
+		if (strcmp("--duration", argv[i]) == 0)
+			options.mDuration = atoi(argv[i + 1]);
+		if (strcmp("--fire-interval", argv[i]) == 0)
+			options.mFireInterval = atoi(argv[i + 1]);
+		if (strcmp("--connect-interval", argv[i]) == 0)
+			options.mConnectInterval = atoi(argv[i + 1]);
+	}
+
+#ifdef __linux__
+	// One socket per bot
+	rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+#endif
+
+	CS260::NetworkCreate();
+
+	printf("bots=%u threads=%u duration=%us fire-interval=%ums server=%s:%u\n", options.mBots, options.mThreads, options.mDuration,
+		options.mFireInterval, options.mAddress.c_str(), options.mPort);
+
+	// Each thread connects and drives its share of the bots, the first one prints the stats of the server
+	auto start = CS260::now();
+	std::vector<std::thread> threads;
+	unsigned threadCount = std::min(options.mThreads, std::max(options.mBots, 1u));
+	for (unsigned t = 0; t < threadCount; t++)
+		threads.emplace_back(Run, std::cref(options), options.mBots * t / threadCount, options.mBots * (t + 1) / threadCount, t == 0, start);
+	for (auto& thread : threads)
+		thread.join();
+
+	Report& report = sReport;
+	std::sort(report.mLatencies.begin(), report.mLatencies.end());
+
+	// The first stats are from before every bot connected
+	CS260::ServerStatsPacket worst{};
+	unsigned long long packetsSent = 0, packetsReceived = 0, bytesSent = 0, bytesReceived = 0, tickTime = 0;
+	unsigned samples = 0;
+	for (auto& stats : report.mServerStats)
+	{
+		if (stats.mPlayers < report.mConnected - report.mTimedOut)
+			continue;
+		worst.mTickTimeAverage = std::max(worst.mTickTimeAverage, stats.mTickTimeAverage);
+		worst.mTickTimeMax = std::max(worst.mTickTimeMax, stats.mTickTimeMax);
+		tickTime += stats.mTickTimeAverage;
+		packetsSent += stats.mPacketsSent;
+		packetsReceived += stats.mPacketsReceived;
+		bytesSent += stats.mBytesSent;
+		bytesReceived += stats.mBytesReceived;
+		samples++;
+	}
+
+	printf("\nconnected=%u failed=%u timed-out=%u clean-disconnections=%u\n", report.mConnected, report.mFailed, report.mTimedOut, report.mCleanDisconnections);
+	if (samples > 0)
+	{
+		printf("server with every bot (%u s): tick avg=%.3f ms worst avg=%.3f ms worst max=%.3f ms\n", samples, tickTime / 1000.0 / samples,
+			worst.mTickTimeAverage / 1000.0, worst.mTickTimeMax / 1000.0);
+		printf("  out=%llu pkt/s %llu B/s  in=%llu pkt/s %llu B/s\n", packetsSent / samples, bytesSent / samples, packetsReceived / samples, bytesReceived / samples);
+	}
+	else
+		printf("server with every bot: no stats received, was it started with --server-stats?\n");
+	printf("shots=%llu bullets=%llu unanswered=%llu latency p50=%.1f ms p99=%.1f ms max=%.1f ms\n", report.mFires, report.mBullets, report.mUnanswered,
+		Percentile(report.mLatencies, 50), Percentile(report.mLatencies, 99), report.mLatencies.empty() ? 0.0f : report.mLatencies.back());
+
+	CS260::NetworkDestroy();
+	return 0;
+}
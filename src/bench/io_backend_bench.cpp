@@ -0,0 +1,211 @@
+// Loopback benchmark of the socket backends of the server.
+// Every simulated client sends its ship each tick, and the server drains them
+// and answers with a few asteroid updates broadcast to everyone, like a real tick.
+// Only the server side (receive + tick + flush) is timed.
+//
+// Usage: asteroids_io_bench [--clients N] [--ticks N] [--updates N] [--io poll|batched|uring]
+// Without --io, every backend available is measured.
+
+#include "networking/protocol.hpp"
+#include "networking/networking.hpp"
+#include "networking/utils.hpp"
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+	struct Options
+	{
+		unsigned mClients = 1024;
+		unsigned mTicks = 300;
+		unsigned mUpdates = 8;
+		CS260::IoBackendType mBackend = CS260::IoBackendType::Default;
+	};
+
+	struct Result
+	{
+		double mAverageMs = 0.0;
+		double mP99Ms = 0.0;
+		unsigned long long mReceived = 0;
+		unsigned long long mDelivered = 0;
+		//the requested backend may not be available
+		CS260::IoBackendType mUsed = CS260::IoBackendType::Default;
+	};
+
+	const char* BackendName(CS260::IoBackendType type)
+	{
+		switch (type)
+		{
+		case CS260::IoBackendType::Poll:
+			return "poll";
+		case CS260::IoBackendType::Batched:
+			return "batched";
+		case CS260::IoBackendType::Uring:
+			return "uring";
+		default:
+			return "default";
+		}
+	}
+
+	SOCKET CreateSocket()
+	{
+		SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		CS260::SetSocketBlocking(s, false);
+
+		// Room for a whole tick of datagrams, so the kernel does not drop them
+		int bufferSize = 8 * 1024 * 1024;
+		setsockopt(s, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+		setsockopt(s, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+		return s;
+	}
+
+	Result Run(const Options& options, CS260::IoBackendType type)
+	{
+		Result result;
+
+		// Server bound to an ephemeral loopback port
+		sockaddr_in serverAddress{};
+		serverAddress.sin_family = AF_INET;
+		serverAddress.sin_addr = CS260::ToIpv4("127.0.0.1");
+		serverAddress.sin_port = 0;
+
+		SOCKET serverSocket = CreateSocket();
+		bind(serverSocket, reinterpret_cast<sockaddr*>(&serverAddress), sizeof(serverAddress));
+		socklen_t addressSize = sizeof(serverAddress);
+		getsockname(serverSocket, reinterpret_cast<sockaddr*>(&serverAddress), &addressSize);
+
+		CS260::Protocol server;
+		server.SetSocket(serverSocket, type);
+		result.mUsed = server.GetIoBackendType();
+
+		// Clients always use the portable backend, they are not what we measure
+		std::vector<SOCKET> clientSockets;
+		std::vector<std::unique_ptr<CS260::Protocol>> clients;
+		for (unsigned i = 0; i < options.mClients; i++)
+		{
+			SOCKET s = CreateSocket();
+			connect(s, reinterpret_cast<sockaddr*>(&serverAddress), sizeof(serverAddress));
+			clientSockets.push_back(s);
+			clients.push_back(std::make_unique<CS260::Protocol>());
+			clients.back()->SetSocket(s, CS260::IoBackendType::Poll);
+		}
+
+		std::vector<sockaddr> endpoints;
+		std::unordered_set<uint64_t> known;
+		std::vector<double> tickTimes;
+
+		CS260::ProtocolPacket packet;
+		unsigned size = 0;
+		CS260::Packet_Types packetType;
+		sockaddr sender;
+
+		for (unsigned tick = 0; tick < options.mTicks; tick++)
+		{
+			// Every client sends its ship
+			for (auto& client : clients)
+			{
+				CS260::ShipUpdatePacket ship{};
+				client->SendPacket(CS260::Packet_Types::ShipPacket, &ship);
+				client->Flush();
+			}
+
+			auto start = CS260::now();
+
+			while (server.ReceivePacket(&packet, &size, &packetType, &sender))
+			{
+				if (packetType == CS260::Packet_Types::VoidPacket)
+					continue;
+				result.mReceived++;
+				if (known.insert(CS260::EndpointKey(&sender)).second)
+					endpoints.push_back(sender);
+			}
+
+			for (unsigned i = 0; i < options.mUpdates; i++)
+			{
+				CS260::AsteroidUpdatePacket update{};
+				update.mID = static_cast<unsigned short>(i);
+				server.Broadcast(CS260::Packet_Types::AsteroidUpdate, &update, endpoints);
+			}
+			server.Tick();
+			server.Flush();
+
+			tickTimes.push_back(std::chrono::duration<double, std::milli>(CS260::now() - start).count());
+
+			// Clients drain what the server sent
+			for (auto& client : clients)
+			{
+				while (client->ReceivePacket(&packet, &size, &packetType))
+				{
+					if (packetType != CS260::Packet_Types::VoidPacket)
+						result.mDelivered++;
+				}
+			}
+		}
+
+		std::sort(tickTimes.begin(), tickTimes.end());
+		for (double time : tickTimes)
+			result.mAverageMs += time;
+		result.mAverageMs /= tickTimes.size();
+		result.mP99Ms = tickTimes[std::min<size_t>(tickTimes.size() - 1, tickTimes.size() * 99 / 100)];
+
+		clients.clear();
+		for (SOCKET s : clientSockets)
+			closesocket(s);
+		closesocket(serverSocket);
+
+		return result;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc - 1; i++)
+	{
+		if (strcmp("--clients", argv[i]) == 0)
+			options.mClients = atoi(argv[i + 1]);
+		if (strcmp("--ticks", argv[i]) == 0)
+			options.mTicks = atoi(argv[i + 1]);
+		if (strcmp("--updates", argv[i]) == 0)
+			options.mUpdates = atoi(argv[i + 1]);
+		if (strcmp("--io", argv[i]) == 0)
+			options.mBackend = CS260::IoBackend::FromString(argv[i + 1]);
+	}
+
+#ifdef __linux__
+	// One socket per simulated client
+	rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+#endif
+
+	CS260::NetworkCreate();
+
+	std::vector<CS260::IoBackendType> backends;
+	if (options.mBackend != CS260::IoBackendType::Default)
+		backends.push_back(options.mBackend);
+	else
+		backends = { CS260::IoBackendType::Poll, CS260::IoBackendType::Batched, CS260::IoBackendType::Uring };
+
+	printf("clients=%u ticks=%u updates=%u\n", options.mClients, options.mTicks, options.mUpdates);
+	printf("%-8s %-8s %12s %12s %14s %14s\n", "backend", "used", "avg ms/tick", "p99 ms/tick", "received", "delivered");
+	for (CS260::IoBackendType type : backends)
+	{
+		Result result = Run(options, type);
+		printf("%-8s %-8s %12.3f %12.3f %14llu %14llu\n", BackendName(type), BackendName(result.mUsed), result.mAverageMs, result.mP99Ms, result.mReceived, result.mDelivered);
+	}
+
+	CS260::NetworkDestroy();
+	return 0;
+}
@@ -0,0 +1,471 @@
+// Microbenchmarks of the networking library, written as JSON so they can be compared across changes.
+// Every benchmark reports the nanoseconds and heap allocations per operation:
+//   protocol/get_type_size        Protocol::GetTypeSize over every packet type
+//   protocol/round_trip/...       SendPacket + Flush on one protocol and ReceivePacket on the other over loopback,
+//                                 with a reply carrying the acknowledgements back. An operation is a message delivered
+//   retransmit_window/ack/N       Acknowledging the oldest of N messages waiting for it and sending a new one
+//   connection/record_received/.. Duplicate detection of the received sequence numbers
+//   server/receive_inputs/N       Server::Tick handling the input commands of N players, per input handled
+//
+// Usage: asteroids_networking_bench [--filter TEXT] [--min-time MS] [--port N] [--output FILE]
+
+#include "networking/connection.hpp"
+#include "networking/protocol.hpp"
+#include "networking/retransmit_window.hpp"
+#include "networking/server.hpp"
+#include "networking/networking.hpp"
+#include "networking/utils.hpp"
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	std::atomic<unsigned long long> sAllocations{ 0 };
+}
+
+// Every allocation of the process goes through here to be counted
+void* operator new(std::size_t size)
+{
+	sAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* memory = std::malloc(size > 0 ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+namespace
+{
+	struct Options
+	{
+		std::string mFilter;
+		unsigned mMinTime = 200;
+		uint16_t mPort = 6300;
+		std::string mOutput;
+	};
+
+	struct Result
+	{
+		std::string mName;
+		unsigned long long mOperations = 0;
+		double mNsPerOp = 0.0;
+		double mAllocationsPerOp = 0.0;
+	};
+
+	// What a benchmark measures, the setup it does between operations can be left out with Pause and Resume
+	class State
+	{
+	public:
+		explicit State(unsigned long long iterations) :
+			mIterations(iterations),
+			mOperations(iterations),
+			mElapsed(0),
+			mAllocations(0),
+			mRunning(false)
+		{
+		}
+
+		unsigned long long GetIterations() const { return mIterations; }
+
+		// When an iteration is not a single operation
+		void SetOperations(unsigned long long operations) { mOperations = operations; }
+		unsigned long long GetOperations() const { return mOperations; }
+
+		void Resume()
+		{
+			mRunning = true;
+			mAllocationsStart = sAllocations.load(std::memory_order_relaxed);
+			mStart = CS260::now();
+		}
+
+		void Pause()
+		{
+			mElapsed += CS260::now() - mStart;
+			mAllocations += sAllocations.load(std::memory_order_relaxed) - mAllocationsStart;
+			mRunning = false;
+		}
+
+		double GetElapsedNs() const { return std::chrono::duration<double, std::nano>(mElapsed).count(); }
+		unsigned long long GetAllocations() const { return mAllocations; }
+		bool IsRunning() const { return mRunning; }
+
+	private:
+		unsigned long long mIterations;
+		unsigned long long mOperations;
+		CS260::clock_t::duration mElapsed;
+		CS260::clock_t::time_point mStart;
+		unsigned long long mAllocations;
+		unsigned long long mAllocationsStart;
+		bool mRunning;
+	};
+
+	std::vector<Result> sResults;
+
+	// Runs the benchmark with more iterations until it lasts the minimum time. The ones that wait between
+	// operations stop growing at ten times that of wall time
+	template <typename Fn>
+	void Measure(const Options& options, const std::string& name, Fn&& fn)
+	{
+		if (!options.mFilter.empty() && name.find(options.mFilter) == std::string::npos)
+			return;
+
+		unsigned long long iterations = 1;
+		while (true)
+		{
+			State state(iterations);
+			auto wallStart = CS260::now();
+			state.Resume();
+			fn(state);
+			if (state.IsRunning())
+				state.Pause();
+
+			double elapsedMs = state.GetElapsedNs() / 1e6;
+			double wallMs = std::chrono::duration<double, std::milli>(CS260::now() - wallStart).count();
+			double maxWallMs = options.mMinTime * 10.0;
+			if (elapsedMs >= options.mMinTime || wallMs >= maxWallMs || iterations >= (1ull << 32))
+			{
+				Result result;
+				result.mName = name;
+				result.mOperations = state.GetOperations();
+				result.mNsPerOp = state.GetOperations() > 0 ? state.GetElapsedNs() / state.GetOperations() : 0.0;
+				result.mAllocationsPerOp = state.GetOperations() > 0 ? static_cast<double>(state.GetAllocations()) / state.GetOperations() : 0.0;
+				sResults.push_back(result);
+				fprintf(stderr, "%-44s %12.1f ns/op %8.2f allocs/op\n", name.c_str(), result.mNsPerOp, result.mAllocationsPerOp);
+				return;
+			}
+
+			// Aim a bit past the minimum time, without growing more than tenfold at once
+			double scale = elapsedMs > 0.0 ? options.mMinTime * 1.2 / elapsedMs : 10.0;
+			if (wallMs > 0.0)
+				scale = std::min(scale, maxWallMs * 1.2 / wallMs);
+			iterations = static_cast<unsigned long long>(iterations * std::min(std::max(scale, 1.5), 10.0));
+		}
+	}
+
+	SOCKET CreateSocket(sockaddr_in* address)
+	{
+		SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		CS260::SetSocketBlocking(s, false);
+
+		address->sin_family = AF_INET;
+		address->sin_addr = CS260::ToIpv4("127.0.0.1");
+		address->sin_port = 0;
+		bind(s, reinterpret_cast<sockaddr*>(address), sizeof(*address));
+		socklen_t addressSize = sizeof(*address);
+		getsockname(s, reinterpret_cast<sockaddr*>(address), &addressSize);
+		return s;
+	}
+
+	// First packet type that needs an acknowledgement or that does not
+	CS260::Packet_Types FindType(bool reliable)
+	{
+		for (int type = CS260::Packet_Types::VoidPacket + 1; type <= CS260::Packet_Types::ServerStats; type++)
+		{
+			bool needsAck = false;
+			if (CS260::Protocol::GetTypeSize(static_cast<CS260::Packet_Types>(type), &needsAck) > 0 && needsAck == reliable
+				&& !CS260::Protocol::HasVariableSize(static_cast<CS260::Packet_Types>(type)))
+				return static_cast<CS260::Packet_Types>(type);
+		}
+		return CS260::Packet_Types::VoidPacket;
+	}
+
+	void GetTypeSize(State& state)
+	{
+		unsigned total = 0;
+		for (unsigned long long i = 0; i < state.GetIterations(); i++)
+		{
+			for (int type = CS260::Packet_Types::VoidPacket; type <= CS260::Packet_Types::ServerStats; type++)
+				total += CS260::Protocol::GetTypeSize(static_cast<CS260::Packet_Types>(type));
+		}
+		state.SetOperations(state.GetIterations() * (CS260::Packet_Types::ServerStats + 1));
+
+		// So the calls are not optimized away
+		if (total == 0)
+			fprintf(stderr, "every type is empty\n");
+	}
+
+	void RoundTrip(State& state, bool reliable, unsigned messagesPerFlush)
+	{
+		state.Pause();
+
+		sockaddr_in senderAddress, receiverAddress;
+		SOCKET receiverSocket = CreateSocket(&receiverAddress);
+		SOCKET senderSocket = CreateSocket(&senderAddress);
+		connect(senderSocket, reinterpret_cast<sockaddr*>(&receiverAddress), sizeof(receiverAddress));
+
+		{
+			CS260::Protocol sender, receiver;
+			sender.SetSocket(senderSocket);
+			receiver.SetSocket(receiverSocket);
+
+			CS260::Packet_Types type = FindType(reliable);
+			CS260::Packet_Types replyType = FindType(false);
+			CS260::ProtocolPacket message{}, reply{}, received;
+			unsigned size;
+			CS260::Packet_Types receivedType;
+			sockaddr from;
+
+			unsigned long long delivered = 0;
+			state.Resume();
+			for (unsigned long long i = 0; i < state.GetIterations(); i++)
+			{
+				for (unsigned m = 0; m < messagesPerFlush; m++)
+					sender.SendPacket(type, &message);
+				sender.Flush();
+
+				// Loopback delivers right away, but do not spin forever if the kernel dropped something
+				unsigned got = 0;
+				auto start = CS260::now();
+				while (got < messagesPerFlush && CS260::ms_since(start) < 100)
+				{
+					while (receiver.ReceivePacket(&received, &size, &receivedType, &from))
+						got += receivedType == type;
+				}
+				delivered += got;
+
+				// The reply carries the acknowledgements back
+				receiver.SendPacket(replyType, &reply, &from);
+				receiver.Flush();
+				start = CS260::now();
+				bool replied = false;
+				while (!replied && CS260::ms_since(start) < 100)
+				{
+					while (sender.ReceivePacket(&received, &size, &receivedType))
+						replied = replied || receivedType == replyType;
+				}
+			}
+			state.Pause();
+			state.SetOperations(delivered);
+		}
+
+		closesocket(senderSocket);
+		closesocket(receiverSocket);
+	}
+
+	void AckWindow(State& state, unsigned pending)
+	{
+		state.Pause();
+		auto window = std::make_unique<CS260::RetransmitWindow>();
+		char datagram[64] = {};
+		auto deadline = CS260::now() + std::chrono::seconds(60);
+
+		unsigned next = 0;
+		for (; next < pending; next++)
+			window->Insert(next, datagram, sizeof(datagram), nullptr, deadline);
+
+		state.Resume();
+		for (unsigned long long i = 0; i < state.GetIterations(); i++, next++)
+		{
+			window->Acknowledge(next - pending);
+			window->Insert(next, datagram, sizeof(datagram), nullptr, deadline);
+		}
+	}
+
+	void RecordReceived(State& state, unsigned reorderDistance, bool duplicates)
+	{
+		state.Pause();
+		CS260::Connection connection(nullptr);
+		uint16_t seq = 0;
+		unsigned duplicatesFound = 0;
+
+		state.Resume();
+		for (unsigned long long i = 0; i < state.GetIterations(); i++)
+		{
+			// Sequences arrive a few places away from their order, or twice
+			uint16_t received = seq;
+			if (reorderDistance > 0)
+				received = static_cast<uint16_t>(seq + (i % 2 ? reorderDistance : 0u) - (i % 2 ? 0u : reorderDistance));
+			duplicatesFound += connection.RecordReceived(received);
+			if (duplicates)
+				duplicatesFound += connection.RecordReceived(received);
+			seq++;
+		}
+		state.SetOperations(state.GetIterations() * (duplicates ? 2 : 1));
+
+		if (duplicatesFound == 0 && duplicates)
+			fprintf(stderr, "no duplicate was detected\n");
+	}
+
+	void ServerReceiveInputs(State& state, const Options& options, unsigned players)
+	{
+		state.Pause();
+
+		CS260::Server::SetShardCount(1);
+		CS260::Server server(false, "127.0.0.1", options.mPort);
+
+		sockaddr_in serverAddress{};
+		serverAddress.sin_family = AF_INET;
+		serverAddress.sin_addr = CS260::ToIpv4("127.0.0.1");
+		serverAddress.sin_port = htons(options.mPort);
+
+		std::vector<SOCKET> sockets;
+		std::vector<std::unique_ptr<CS260::Protocol>> clients;
+		for (unsigned i = 0; i < players; i++)
+		{
+			sockaddr_in address;
+			sockets.push_back(CreateSocket(&address));
+			connect(sockets.back(), reinterpret_cast<sockaddr*>(&serverAddress), sizeof(serverAddress));
+			clients.push_back(std::make_unique<CS260::Protocol>());
+			clients.back()->SetSocket(sockets.back(), CS260::IoBackendType::Poll);
+		}
+
+		CS260::ProtocolPacket received;
+		unsigned size;
+		CS260::Packet_Types type;
+
+		// Everyone joins with the handshake at once, the server times out the players that are quiet for too long
+		std::vector<bool> joined(players, false);
+		CS260::SYNPacket syn;
+		for (auto& client : clients)
+		{
+			client->SendPacket(CS260::Packet_Types::SYN, &syn);
+			client->Flush();
+		}
+		auto start = CS260::now();
+		while (server.PlayerCount() < static_cast<int>(players) && CS260::ms_since(start) < 5000)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			server.Tick();
+			server.Flush();
+			for (unsigned i = 0; i < players; i++)
+			{
+				while (clients[i]->ReceivePacket(&received, &size, &type))
+				{
+					if (type == CS260::Packet_Types::SYNACK && !joined[i])
+					{
+						clients[i]->SendPacket(CS260::Packet_Types::SYNACK, received.mBuffer.data());
+						joined[i] = true;
+					}
+				}
+				clients[i]->Flush();
+			}
+		}
+
+		// One input command from every player per round, only the tick of the server handling them is measured
+		unsigned long long handled = 0;
+		unsigned short sequence = 1;
+		for (unsigned long long i = 0; i < state.GetIterations(); i++, sequence++)
+		{
+			CS260::InputCommandsPacket inputs;
+			inputs.mCount = 1;
+			inputs.mCommands[0] = { sequence, CS260::InputThrust, 16 };
+			for (auto& client : clients)
+			{
+				while (client->ReceivePacket(&received, &size, &type))
+					;
+				client->SendPacket(CS260::Packet_Types::InputCommands, &inputs, inputs.GetSize());
+				client->Flush();
+			}
+
+			// Time for the network thread of the server to receive them
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+			state.Resume();
+			server.Tick();
+			state.Pause();
+			handled += server.GetPlayerInputs().size();
+			server.Flush();
+		}
+		state.SetOperations(handled);
+
+		if (server.PlayerCount() != static_cast<int>(players))
+			fprintf(stderr, "server/receive_inputs/%u: only %d players are connected\n", players, server.PlayerCount());
+
+		clients.clear();
+		for (SOCKET s : sockets)
+			closesocket(s);
+	}
+
+	void WriteJson(FILE* file)
+	{
+		fprintf(file, "{\n  \"benchmarks\": [\n");
+		for (size_t i = 0; i < sResults.size(); i++)
+		{
+			const Result& result = sResults[i];
+			fprintf(file, "    { \"name\": \"%s\", \"operations\": %llu, \"ns_per_op\": %.3f, \"allocs_per_op\": %.4f }%s\n", result.mName.c_str(),
+				result.mOperations, result.mNsPerOp, result.mAllocationsPerOp, i + 1 < sResults.size() ? "," : "");
+		}
+		fprintf(file, "  ]\n}\n");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc - 1; i++)
+	{
+		if (strcmp("--filter", argv[i]) == 0)
+			options.mFilter = argv[i + 1];
+		if (strcmp("--min-time", argv[i]) == 0)
+			options.mMinTime = atoi(argv[i + 1]);
+		if (strcmp("--port", argv[i]) == 0)
+			options.mPort = static_cast<uint16_t>(atoi(argv[i + 1]));
+		if (strcmp("--output", argv[i]) == 0)
+			options.mOutput = argv[i + 1];
+	}
+
+#ifdef __linux__
+	// One socket per simulated player
+	rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+#endif
+
+	CS260::NetworkCreate();
+
+	Measure(options, "protocol/get_type_size", GetTypeSize);
+
+	for (bool reliable : { false, true })
+	{
+		for (unsigned messages : { 1u, 32u })
+		{
+			std::string name = std::string("protocol/round_trip/") + (reliable ? "reliable/" : "unreliable/") + std::to_string(messages);
+			Measure(options, name, [&](State& state) { RoundTrip(state, reliable, messages); });
+		}
+	}
+
+	for (unsigned pending : { 1u, 16u, 64u, CS260::RETRANSMIT_WINDOW_SIZE - 1 })
+		Measure(options, "retransmit_window/ack/" + std::to_string(pending), [&](State& state) { AckWindow(state, pending); });
+
+	Measure(options, "connection/record_received/in_order", [](State& state) { RecordReceived(state, 0, false); });
+	Measure(options, "connection/record_received/reordered", [](State& state) { RecordReceived(state, 16, false); });
+	Measure(options, "connection/record_received/duplicated", [](State& state) { RecordReceived(state, 0, true); });
+
+	for (unsigned players : { 1u, 16u, 64u, 200u })
+		Measure(options, "server/receive_inputs/" + std::to_string(players), [&](State& state) { ServerReceiveInputs(state, options, players); });
+
+	if (options.mOutput.empty())
+		WriteJson(stdout);
+	else if (FILE* file = fopen(options.mOutput.c_str(), "w"))
+	{
+		WriteJson(file);
+		fclose(file);
+	}
+	else
+		fprintf(stderr, "could not write %s\n", options.mOutput.c_str());
+
+	CS260::NetworkDestroy();
+	return 0;
+}
@@ -1,11 +1,16 @@
 #include "game.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#ifdef ASTEROIDS_HEADLESS
+#include <thread>
+#else
 #include "engine/opengl.hpp"
 #include "engine/window.hpp"
 #include "engine/shader.hpp"
 #include "engine/font.hpp"
+#endif
 
 // State ingame
 void GameStatePlayLoad(void);
@@ -24,7 +29,8 @@ void GameStatePlayFreeSolo(void);
 void GameStatePlayUnloadSolo(void);
 
 namespace {
-
+    // Frame time simulated at most in a frame, past it the simulation slows down instead of falling further behind
+    const float maxFrameTime = 0.25f;
 }
 
 /**
@@ -33,15 +39,21 @@ namespace {
  */
 void game::create(bool is_server, const std::string& address, uint16_t port, bool verbose, bool is_solo)
 {
+#ifdef ASTEROIDS_HEADLESS
+    // Nothing is drawn, there is no window nor assets
+    m_window         = nullptr;
+    m_default_shader = nullptr;
+    m_default_font   = nullptr;
+#else
     // Window
     m_window = new engine::window();
     if (!is_server) {
 
-        m_window->create(1270, 780, "Asteroids Client");
+        m_window->create(window_width, window_height, "Asteroids Client");
     }
     else {
 
-        m_window->create(1270, 780, "Asteroids Server");
+        m_window->create(window_width, window_height, "Asteroids Server");
 
     }
 
@@ -50,6 +62,7 @@ void game::create(bool is_server, const std::string& address, uint16_t port, boo
 
     m_default_font = new engine::font();
     m_default_font->create("resources/monospaced_24.fnt");
+#endif
 
     // General
     m_start_time_point = clock::now();
@@ -63,30 +76,75 @@ void game::create(bool is_server, const std::string& address, uint16_t port, boo
  * @brief 
  * 
  */
+#ifdef ASTEROIDS_HEADLESS
 bool game::update()
 {
-    // dt
+    // Without a window to pace the frames, wait for the next step unless it is too far behind to catch up
+    auto step = std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(m_dt));
+    m_frame_time_point += step;
+    auto now = clock::now();
+    if (now - m_frame_time_point > std::chrono::duration<float>(maxFrameTime))
+        m_frame_time_point = now;
+    std::this_thread::sleep_until(m_frame_time_point);
+
+    // States, without rendering
+    m_game_time = m_game_time + m_dt;
+    m_state_update();
+
+    return should_continue;
+}
+#else
+bool game::update()
+{
+    // Frame time, the simulation catches up with it in fixed steps
     auto now           = clock::now();
     auto diff          = now - m_frame_time_point;
     m_frame_time_point = now;
-    m_dt               = std::chrono::duration_cast<std::chrono::milliseconds>(diff).count() * 0.001f;
-    m_game_time        = m_game_time + m_dt;
+    m_accumulator      = std::min(m_accumulator + std::chrono::duration<float>(diff).count(), maxFrameTime);
 
     // Window update
     should_continue = m_window->update();
 
+    // Keep the presses until a step sees them
     m_key_states_prev = m_key_states;
     for (int i = 0; i < GLFW_KEY_LAST; ++i) {
         m_key_states[i] = glfwGetKey(m_window->handle(), i);
+        if (m_key_states[i] >= 1 && m_key_states_prev[i] == 0)
+            m_key_triggered[i] = true;
     }
 
-    // States
-    m_state_update();
+    // States, rendering blends the last two steps
+    while (m_accumulator >= m_dt) {
+        m_game_time   = m_game_time + m_dt;
+        m_accumulator = m_accumulator - m_dt;
+        m_state_update();
+        m_key_triggered.clear();
+    }
+    m_alpha = m_accumulator / m_dt;
     m_state_render();
 
     m_window->swap_buffers();
     return should_continue;
 }
+#endif
+
+/**
+ * @brief 
+ * Steps per second the simulation runs at, whatever the frame rate
+ */
+void game::set_tick_rate(unsigned steps_per_second)
+{
+    m_dt = 1.0f / static_cast<float>(std::max(steps_per_second, 1u));
+}
+
+/**
+ * @brief 
+ * Whether the network stats are drawn over the game, F3 toggles them
+ */
+void game::set_network_overlay(bool shown)
+{
+    m_network_overlay = shown;
+}
 
 /**
  * @brief 
@@ -97,6 +155,16 @@ void game::set_state_ingame(bool is_server, const std::string& address, uint16_t
     if (m_state_free) m_state_free();
     if (m_state_unload) m_state_unload();
 
+#ifdef ASTEROIDS_HEADLESS
+    // Only the networked game runs headless, and nothing renders it
+    (void)is_solo;
+    m_state_load = &GameStatePlayLoad;
+    m_state_init = &GameStatePlayInit;
+    m_state_update = &GameStatePlayUpdate;
+    m_state_render = nullptr;
+    m_state_free = &GameStatePlayFree;
+    m_state_unload = &GameStatePlayUnload;
+#else
     if (!is_solo)
     {
         m_state_load = &GameStatePlayLoad;
@@ -115,6 +183,7 @@ void game::set_state_ingame(bool is_server, const std::string& address, uint16_t
         m_state_free = &GameStatePlayFreeSolo;
         m_state_unload = &GameStatePlayUnloadSolo;		
     }
+#endif
 
     m_state_load();
     m_state_init(is_server, address, port, verbose);
@@ -122,10 +191,12 @@ void game::set_state_ingame(bool is_server, const std::string& address, uint16_t
 
 void game::destroy()
 {
+#ifndef ASTEROIDS_HEADLESS
     delete m_default_shader;
     m_default_shader = nullptr;
     delete m_default_font;
     m_default_font = nullptr;
     delete m_window;
     m_window = nullptr;
+#endif
 }
\ No newline at end of file
@@ -14,7 +14,9 @@ class game
     // Time control
     using clock = std::chrono::high_resolution_clock;
     float             m_game_time{};
-    float             m_dt{};
+    float             m_dt{1.0f / 60.0f}; // fixed step the simulation advances by
+    float             m_accumulator{};    // frame time not simulated yet
+    float             m_alpha{};          // where rendering is between the last two steps, from 0 to 1
     clock::time_point m_start_time_point;
     clock::time_point m_frame_time_point;
 
@@ -36,9 +38,17 @@ class game
     // Input
     std::unordered_map<int, int> m_key_states;
     std::unordered_map<int, int> m_key_states_prev;
+    std::unordered_map<int, bool> m_key_triggered; // pressed since the last step, frames can go by without one
+
+    // Debug
+    bool m_network_overlay{}; // the ingame state draws the network stats
 
   public:
 
+    // Size of the window, and of the play field of a headless server
+    static constexpr int window_width  = 1270;
+    static constexpr int window_height = 780;
+
 	// This is made public to make our lifes easier closing the application from networking
     bool should_continue = true;
 	
@@ -53,15 +63,19 @@ class game
     void destroy();
 
     void set_state_ingame(bool is_server, const std::string& address, uint16_t port, bool verbose, bool is_solo);
+    void set_tick_rate(unsigned steps_per_second);
+    void set_network_overlay(bool shown);
 
     float                      game_time() const { return m_game_time; }
     float                      dt() const { return m_dt; }
+    float                      render_alpha() const { return m_alpha; }
     decltype(m_window)         window() const { return m_window; }
     decltype(m_default_shader) shader_default() const { return m_default_shader; }
     decltype(m_default_font)   font_default() const { return m_default_font; }
+    bool                       network_overlay() const { return m_network_overlay; }
 
     bool input_key_pressed(int key) { return m_key_states[key] >= 1; }
-    bool input_key_triggered(int key) { return m_key_states[key] >= 1 && m_key_states_prev[key] == 0; }
+    bool input_key_triggered(int key) { return m_key_triggered[key]; }
 
   private:
     game()                = default;
@@ -3,16 +3,19 @@
 #include <cstdio>            // sprintf
 #include <iostream>          // cout
 #include "engine/math.hpp"   // math
+#ifndef ASTEROIDS_HEADLESS
 #include "engine/mesh.hpp"   // mesh
 #include "engine/opengl.hpp" // opengl, glfw
 #include "engine/shader.hpp" // shader
 #include "engine/window.hpp" // window
 #include "engine/font.hpp"   // font
+#endif
 #include "game/game.hpp"     // game features
 #include "networking/utils.hpp" // networking utils
 #include "networking/client.hpp" // networking utils
 #include "networking/server.hpp" // networking utils
 #include "networking/protocol.hpp" // networking utils
+#include "networking/tick_scheduler.hpp" // networking utils
 
 // ---------------------------------------------------------------------------
 // Defines
@@ -32,6 +35,15 @@
 #define AST_LIFE_MAX 10       // the life of the biggest asteroid (smaller one is scaled accordingly)
 #define AST_VEL_DAMP 1E-8f    // dampening to use if the asteroid velocity is above the maximum
 #define AST_TO_SHIP_ACC 0.01f // how much acceleration to apply to steer the asteroid toward the ship
+#define AST_CORRECTION_DAMP 1E-6f // how fast a correction from the server is blended into the drawn asteroid
+
+#define RENDER_SNAP_DISTANCE 200.0f // objects moving more than this in a step were teleported or wrapped, they are not blended
+
+#define NET_STATS_INTERVAL 0.25f // seconds between the samples of the network stats overlay
+#define NET_STATS_HISTORY 120    // samples shown by the bandwidth graph of the overlay
+#define NET_STATS_FONT_SIZE 16   // size of the text of the overlay
+#define NET_STATS_LINE 18        // pixels between the lines of the overlay
+#define NET_GRAPH_HEIGHT 60.0f   // pixels of the bandwidth graph at its highest sample
 
 #define SHIP_INITIAL_NUM 3          // initial number of ship
 #define SHIP_SPECIAL_NUM 20         //
@@ -43,6 +55,7 @@
 #define SHIP_ROT_SPEED (1.0f * PI)  // ship rotation speed (degree/second)
 
 #define BULLET_SPEED 1000.0f // bullet speed (m/s)
+#define BULLET_COOLDOWN 0.1f // seconds between two bullets of a ship, the server ignores faster fire
 #define BULLET_SIZE 10.0f
 
 #define BOMB_COST 0        // cost to fire a bomb
@@ -96,6 +109,13 @@ enum
 // ---------------------------------------------------------------------------
 // Struct/Class definitions
 
+#ifdef ASTEROIDS_HEADLESS
+// nothing is drawn, the objects have no mesh
+namespace engine {
+    class mesh;
+}
+#endif
+
 struct GameObj
 {
     uint32_t      type;  // object type
@@ -112,7 +132,10 @@ struct GameObjInst
     float    scale;     //
     vec2     posCurr;   // object current position
     vec2     velCurr;   // object current velocity
+    vec2     posCorrection; // offset still to blend into the drawn position, after a correction from the server
+    vec2     posPrev;   // object position at the start of the step, rendering blends from it
     float    dirCurr;   // object current direction
+    float    dirPrev;   // object direction at the start of the step
     mat4     transform; // object drawing matrix
     void*    pUserData; // pointer to custom data specific for each object type
     unsigned id;   
@@ -146,10 +169,16 @@ struct RemoteShipInfo
     uint32_t mScore;
     unsigned short mShipsLeft = SHIP_INITIAL_NUM;
     bool mDead = false;
+    float mRotSpeed = 0.0f;
+    unsigned short mLastInput = 0; // last input command applied to the ship
+    float mFireCooldown = 0.0f;    // simulated seconds until the ship can fire again
 };
 
 static std::vector<RemoteShipInfo> mRemoteShips;
 
+// states of the ships sent by the server every tick, kept to reuse its memory
+static std::vector<CS260::PlayerInfo> sShipStates;
+
 // keep track when the last asteroid was created
 static float sAstCreationTime;
 
@@ -180,12 +209,32 @@ static int gAEWinMaxY = 480;
 
 
 // Networking handles
-static auto networkClock = CS260::now();
+static CS260::TickScheduler sNetworkTicks(CS260::tickRate);
 
 static bool is_server = false;
 static CS260::Server* server = nullptr;
 static CS260::Client* client = nullptr;
 
+#ifndef ASTEROIDS_HEADLESS
+// Rates of the network stats overlay, over the interval between two samples
+struct NetStatsRates
+{
+    float bytesSent;       // per second
+    float bytesReceived;   // per second
+    float packetsSent;     // per second
+    float packetsReceived; // per second
+    float loss;            // fraction of the datagrams of the peers that did not arrive
+};
+
+static CS260::ConnectionStats sNetStats;                       // counters at the last sample
+static float                  sNetStatsTime;                   // game time of the last sample, 0 if there is none
+static NetStatsRates          sNetRates;                       // rates of the last sample
+static NetStatsRates          sNetHistory[NET_STATS_HISTORY];  // rates of the last samples, for the graph
+static unsigned               sNetHistoryNext;
+static unsigned               sNetHistoryCount;
+static engine::mesh*          spNetGraphBar;                   // unit square the graph is drawn with
+#endif
+
 // ---------------------------------------------------------------------------
 
 // function to 'load' object data
@@ -206,8 +255,19 @@ static void resolveCollision(GameObjInst* pSrc, GameObjInst* pDst, vec2* pNrm);
 // function to create the particles
 static void sparkCreate(uint32_t type, vec2* pPos, uint32_t count, float angleMin, float angleMax, float srcSize = 0.0f, float velScale = 1.0f, vec2* pVelInit = 0);
 
+#ifndef ASTEROIDS_HEADLESS
 // function for the missile to find a new target
 static GameObjInst* missileAcquireTarget(GameObjInst* pMissile);
+#endif
+
+// function to move a ship with the input of a player, the same on the server and the predicting client
+static void shipSimulate(GameObjInst* pShip, float* pRotSpeed, uint8_t input, float dt);
+
+#ifndef ASTEROIDS_HEADLESS
+// functions to take a sample of the network stats and to draw them over the game
+static void netStatsSample();
+static void netStatsDraw(mat4 const& vp, int h);
+#endif
 
 // ---------------------------------------------------------------------------
 
@@ -226,6 +286,13 @@ void GameStatePlayLoad(void)
     // load/create the mesh data
     loadGameObjList();
 
+#ifndef ASTEROIDS_HEADLESS
+    spNetGraphBar = new engine::mesh();
+    spNetGraphBar->add_triangle(engine::gfx_triangle(0.0f, 0.0f, 0xFFFFFFFF, 0.0f, 0.0f, 1.0f, 0.0f, 0xFFFFFFFF, 0.0f, 0.0f, 1.0f, 1.0f, 0xFFFFFFFF, 0.0f, 0.0f));
+    spNetGraphBar->add_triangle(engine::gfx_triangle(0.0f, 0.0f, 0xFFFFFFFF, 0.0f, 0.0f, 1.0f, 1.0f, 0xFFFFFFFF, 0.0f, 0.0f, 0.0f, 1.0f, 0xFFFFFFFF, 0.0f, 0.0f));
+    spNetGraphBar->create();
+#endif
+
     // initialize the initial number of asteroid
     sAstCtr = 0;
 }
@@ -244,6 +311,11 @@ void GameStatePlayInit(bool serverIs, const std::string& address, uint16_t port,
     sAstCtr = 0;
     sAstNum = AST_NUM_MIN;
 
+    // the snapshots dead reckon the asteroids the way they move in here, every peer wraps them at the play field of the starting window
+    CS260::SetAsteroidMotion({AST_TO_SHIP_ACC, AST_VEL_MAX * 2.0f, AST_VEL_DAMP,
+        {-game::window_width / 2 - AST_SIZE_MAX, -game::window_height / 2 - AST_SIZE_MAX},
+        {game::window_width / 2 + AST_SIZE_MAX, game::window_height / 2 + AST_SIZE_MAX}});
+
 	// If we are a client, create the ship
     if (!serverIs)
     {
@@ -271,6 +343,23 @@ void GameStatePlayInit(bool serverIs, const std::string& address, uint16_t port,
     sGameStateChangeCtr = 2.0f;
     is_server = serverIs;
 
+    // the network ticks count from now
+    sNetworkTicks.Reset();
+
+#ifndef ASTEROIDS_HEADLESS
+    // the network stats start over with the connection
+    sNetStatsTime    = 0.0f;
+    sNetHistoryCount = 0;
+#endif
+
+#ifdef ASTEROIDS_HEADLESS
+    // there is no window to take the play field from, use the one the server window would have
+    gAEWinMinX = -game::window_width / 2;
+    gAEWinMaxX = game::window_width / 2;
+    gAEWinMinY = -game::window_height / 2;
+    gAEWinMaxY = game::window_height / 2;
+#endif
+
 }
 
 // ---------------------------------------------------------------------------
@@ -281,6 +370,31 @@ void GameStatePlayUpdate(void)
     // update the input
     // =================
     float const dt = game::instance().dt();
+
+    // =========================================
+    // keep where the objects start the step from
+    // =========================================
+
+    for (uint32_t i = 0; i < GAME_OBJ_INST_NUM_MAX; i++) {
+        GameObjInst* pInst = sGameObjInstList + i;
+        pInst->posPrev = pInst->posCurr;
+        pInst->dirPrev = pInst->dirCurr;
+    }
+
+#ifndef ASTEROIDS_HEADLESS
+    // =========================================
+    // show or hide the network stats, they start over when shown again
+    // =========================================
+
+    if (game::instance().input_key_triggered(GLFW_KEY_F3)) {
+        game::instance().set_network_overlay(!game::instance().network_overlay());
+        sNetStatsTime    = 0.0f;
+        sNetHistoryCount = 0;
+    }
+    if (game::instance().network_overlay())
+        netStatsSample();
+#endif
+
     if (spShip == 0) {
         sGameStateChangeCtr -= dt;
 
@@ -289,83 +403,23 @@ void GameStatePlayUpdate(void)
             // TODO: Change to RESULT GAME STATE
         }
     } else {
+        uint8_t input = 0;
+
         // Update the ship only if we have lives to spend
         if (sShipCtr > 0 && !won)
         {
-            if (game::instance().input_key_pressed(GLFW_KEY_UP)) {
-#if 0
-                vec2 acc, u, dir;
-
-                // calculate the current direction vector
-                AEVector2Set(&dir, glm::cos(spShip->dirCurr), glm::sin(spShip->dirCurr));
-
-                // calculate the dampening vector
-                AEVec2Scale(&u, &spShip->velCurr, -AEVec2Length(&spShip->velCurr) * 0.01f);//pow(SHIP_DAMP_FORWARD, dt));
-
-                // calculate the acceleration vector and add the dampening vector to it
-                //AEVec2Scale	(&acc, &dir, 0.5f * SHIP_ACCEL_FORWARD * dt * dt);
-                AEVec2Scale(&acc, &dir, SHIP_ACCEL_FORWARD);
-                AEVec2Add(&acc, &acc, &u);
-
-                // add the velocity to the position
-                //AEVec2Scale	(&u,               &spShip->velCurr, dt);
-                //AEVec2Add	(&spShip->posCurr, &spShip->posCurr, &u);
-                // add the acceleration to the position
-                AEVec2Scale(&u, &acc, 0.5f * dt * dt);
-                AEVec2Add(&spShip->posCurr, &spShip->posCurr, &u);
-
-                // add the acceleration to the velocity
-                AEVec2Scale(&u, &acc, dt);
-                AEVec2Add(&spShip->velCurr, &acc, &spShip->velCurr);
-
-                AEVec2Scale(&u, &dir, -spShip->scale);
-                AEVec2Add(&u, &u, &spShip->posCurr);
-
-                sparkCreate(PTCL_EXHAUST, &u, 2, spShip->dirCurr + 0.8f * PI, spShip->dirCurr + 1.2f * PI);
-#else
-                vec2 pos, dir;
-                dir = { glm::cos(spShip->dirCurr), glm::sin(spShip->dirCurr) };
-                pos = dir;
-                dir = dir * (SHIP_ACCEL_FORWARD * dt);
-                spShip->velCurr = spShip->velCurr + dir;
-                spShip->velCurr = spShip->velCurr * glm::pow(SHIP_DAMP_FORWARD, dt);
-
-                pos = pos * -spShip->scale;
-                pos = pos + spShip->posCurr;
-
-                sparkCreate(PTCL_EXHAUST, &pos, 2, spShip->dirCurr + 0.8f * PI, spShip->dirCurr + 1.2f * PI);
+#ifndef ASTEROIDS_HEADLESS
+            if (game::instance().input_key_pressed(GLFW_KEY_UP))
+                input |= CS260::InputThrust;
+            if (game::instance().input_key_pressed(GLFW_KEY_DOWN))
+                input |= CS260::InputReverse;
+            if (game::instance().input_key_pressed(GLFW_KEY_LEFT))
+                input |= CS260::InputLeft;
+            else if (game::instance().input_key_pressed(GLFW_KEY_RIGHT))
+                input |= CS260::InputRight;
+            if (game::instance().input_key_triggered(GLFW_KEY_SPACE))
+                input |= CS260::InputFire;
 #endif
-            }
-            if (game::instance().input_key_pressed(GLFW_KEY_DOWN)) {
-                vec2 dir;
-
-                dir = { glm::cos(spShip->dirCurr), glm::sin(spShip->dirCurr) };
-                dir = dir * SHIP_ACCEL_BACKWARD * dt;
-                spShip->velCurr = spShip->velCurr + dir;
-                spShip->velCurr = spShip->velCurr * glm::pow(SHIP_DAMP_BACKWARD, dt);
-            }
-            if (game::instance().input_key_pressed(GLFW_KEY_LEFT)) {
-                sShipRotSpeed += (SHIP_ROT_SPEED - sShipRotSpeed) * 0.1f;
-                spShip->dirCurr += sShipRotSpeed * dt;
-                spShip->dirCurr = wrap(spShip->dirCurr, -PI, PI);
-            }
-            else if (game::instance().input_key_pressed(GLFW_KEY_RIGHT)) {
-                sShipRotSpeed += (SHIP_ROT_SPEED - sShipRotSpeed) * 0.1f;
-                spShip->dirCurr -= sShipRotSpeed * dt;
-                spShip->dirCurr = wrap(spShip->dirCurr, -PI, PI);
-            }
-            else {
-                sShipRotSpeed = 0.0f;
-            }
-            if (game::instance().input_key_triggered(GLFW_KEY_SPACE)) {
-                vec2 vel;
-
-                vel = { glm::cos(spShip->dirCurr), glm::sin(spShip->dirCurr) };
-                vel = vel * BULLET_SPEED;
-
-                if (!is_server)
-                    client->RequestBullet(client->GetPlayerID(), vel, spShip->posCurr, spShip->dirCurr);
-            }
 
             for (auto& ship : mRemoteShips)
             {
@@ -375,6 +429,18 @@ void GameStatePlayUpdate(void)
                     won = false;
             }
         }
+
+        // The server moves the ship with the same input, predict it until it sends the state of the ship back
+        CS260::InputCommand command = client->QueueInput(input, dt);
+        shipSimulate(spShip, &sShipRotSpeed, command.mInput, command.mDuration * 0.001f);
+
+        if (command.mInput & CS260::InputThrust) {
+            vec2 pos = { glm::cos(spShip->dirCurr), glm::sin(spShip->dirCurr) };
+            pos = pos * -spShip->scale;
+            pos = pos + spShip->posCurr;
+
+            sparkCreate(PTCL_EXHAUST, &pos, 2, spShip->dirCurr + 0.8f * PI, spShip->dirCurr + 1.2f * PI);
+        }
     }
 
     // ==================================
@@ -404,22 +470,43 @@ void GameStatePlayUpdate(void)
         if ((pInst->flag & FLAG_ACTIVE) == 0)
             continue;
 
+        // skip the ships, they are moved by their inputs or, the ones of other players in the clients, interpolated
+        if (pInst->pObject->type == TYPE_SHIP)
+            continue;
+
         // update the position
         pInst->posCurr += pInst->velCurr * dt;
     }
 
+    // Show the ships of the other players a bit in the past, between the states the server sent around that time
+    if (!is_server)
+    {
+        for (auto& ship : mRemoteShips)
+        {
+            CS260::PlayerInfo state;
+            if (!ship.mShipInstance || !client->GetInterpolatedPlayer(ship.mPlayerID, &state))
+                continue;
+
+            ship.mShipInstance->posCurr = state.pos;
+            ship.mShipInstance->dirCurr = state.rot;
+            ship.mShipInstance->velCurr = state.vel;
+            ship.mShipInstance->inputPressed = state.inputPressed;
+
+            if (ship.mShipInstance->inputPressed)
+            {
+                vec2 pos = { glm::cos(ship.mShipInstance->dirCurr), glm::sin(ship.mShipInstance->dirCurr) };
+                pos = pos * -ship.mShipInstance->scale;
+                pos = pos + ship.mShipInstance->posCurr;
+
+                sparkCreate(PTCL_EXHAUST, &pos, 2, ship.mShipInstance->dirCurr + 0.8f * PI, ship.mShipInstance->dirCurr + 1.2f * PI);
+            }
+        }
+    }
+
     // ===============
     // update objects
     // ===============
 
-    // Update the ship position manually only if we are a client
-    if (spShip)
-    {
-        // warp the ship from one end of the screen to the other
-        spShip->posCurr.x = wrap(spShip->posCurr.x, gAEWinMinX - SHIP_SIZE, gAEWinMaxX + SHIP_SIZE);
-        spShip->posCurr.y = wrap(spShip->posCurr.y, gAEWinMinY - SHIP_SIZE, gAEWinMaxY + SHIP_SIZE);
-    }
-
     // Add all the existing ships to this vector to do some math with asteroids
     std::vector<GameObjInst*> currentShips;
     if (spShip)
@@ -446,6 +533,9 @@ void GameStatePlayUpdate(void)
             // warp the asteroid from one end of the screen to the other
             pInst->posCurr.x = wrap(pInst->posCurr.x, gAEWinMinX - AST_SIZE_MAX, gAEWinMaxX + AST_SIZE_MAX);
             pInst->posCurr.y = wrap(pInst->posCurr.y, gAEWinMinY - AST_SIZE_MAX, gAEWinMaxY + AST_SIZE_MAX);
+
+            // blend the last correction from the server
+            pInst->posCorrection = pInst->posCorrection * glm::pow(AST_CORRECTION_DAMP, dt);
                         
             // If there are ships curently on screen
             if (currentShips.size() > 0)
@@ -715,35 +805,19 @@ void GameStatePlayUpdate(void)
         }
     }
 #endif
-    // =====================================
-    // calculate the matrix for all objects
-    // =====================================
-
-    for (uint32_t i = 0; i < GAME_OBJ_INST_NUM_MAX; i++) {
-        GameObjInst* pInst = sGameObjInstList + i;
-        glm::mat3    m;
-
-        // skip non-active object
-        if ((pInst->flag & FLAG_ACTIVE) == 0)
-            continue;
-
-        auto t           = glm::translate(vec3(pInst->posCurr.x, pInst->posCurr.y, 0));
-        auto r           = glm::rotate(pInst->dirCurr, vec3(0, 0, 1));
-        auto s           = glm::scale(vec3(pInst->scale, pInst->scale, 1));
-        pInst->transform = t * r * s;
-    }
 
 
     // ====================
     // Networking
     // ====================
-    // Update the network 60 times/seconds
-    if (CS260::ms_since(networkClock) > CS260::tickRate)
+    // Update the network 60 times/seconds, on the ticks that came since the last step
+    unsigned networkTicks = sNetworkTicks.ConsumeTicks();
+    if (networkTicks > 0)
     {
         // Server ticks
         if (is_server)
         {
-            server->Tick();
+            server->Tick(networkTicks);
 
             // First of all check if we need to disconnect any player
             for (auto& playerID : server->GetDisconnectedPlayersIDs())
@@ -785,23 +859,56 @@ void GameStatePlayUpdate(void)
                 {
                     //if it is that players ship
                     if (ship.mPlayerID == player.mPlayerInfo.mID )
-                    {
                         ship.mDead = player.mDead;
-                        if (!ship.mDead)
-                        {
-                            ship.mShipInstance->posCurr = player.mPlayerInfo.pos;
-                            ship.mShipInstance->dirCurr = player.mPlayerInfo.rot;
-                            ship.mShipInstance->velCurr = player.mPlayerInfo.vel;
-                            ship.mShipInstance->inputPressed = player.mPlayerInfo.inputPressed;
-                        }
-                    }
-                    else 
-                    { // not that player ship
-                        server->SendPlayerInfo(player.mEndpoint, { ship.mPlayerID, ship.mShipInstance->posCurr, ship.mShipInstance->dirCurr, ship.mShipInstance->velCurr, ship.mShipInstance->inputPressed });
+                }
+            }
+
+            // Move the ships with the inputs of their players, in the order they were pressed
+            for (auto& playerInput : server->GetPlayerInputs())
+            {
+                for (auto& ship : mRemoteShips)
+                {
+                    if (ship.mPlayerID != playerInput.mPlayerID)
+                        continue;
+
+                    // Without lives left the ship only drifts
+                    uint8_t input = ship.mShipsLeft > 0 ? playerInput.mCommand.mInput : 0;
+                    float duration = playerInput.mCommand.mDuration * 0.001f;
+                    shipSimulate(ship.mShipInstance, &ship.mRotSpeed, input, duration);
+                    ship.mShipInstance->inputPressed = (input & CS260::InputThrust) != 0;
+                    ship.mLastInput = playerInput.mCommand.mSequence;
+
+                    // The durations of the commands are bounded by the server clock, so is the fire rate
+                    ship.mFireCooldown = std::max(ship.mFireCooldown - duration, 0.0f);
+                    if ((input & CS260::InputFire) && ship.mFireCooldown <= 0.0f)
+                    {
+                        ship.mFireCooldown = BULLET_COOLDOWN;
+
+                        vec2 pos = ship.mShipInstance->posCurr;
+                        vec2 vel = { glm::cos(ship.mShipInstance->dirCurr), glm::sin(ship.mShipInstance->dirCurr) };
+                        vel = vel * BULLET_SPEED;
+                        GameObjInst* inst = gameObjInstCreate(TYPE_BULLET, BULLET_SIZE, &pos, &vel, ship.mShipInstance->dirCurr, true, sLastGeneratedID);
+
+                        inst->mOwnerID = ship.mPlayerID; //set the bullet owner
+
+                        CS260::BulletCreationPacket sendPCK;
+                        sendPCK.mDir = ship.mShipInstance->dirCurr;
+                        sendPCK.mObjectID = sLastGeneratedID++;
+                        sendPCK.mOwnerID = ship.mPlayerID;
+                        sendPCK.mPos = pos;
+                        sendPCK.mVel = vel;
+
+                        server->SendBulletToAllClients(sendPCK);
                     }
                 }
             }
 
+            // Send the state of every ship to the players at once, with the last input of each one it includes
+            sShipStates.clear();
+            for (auto& ship : mRemoteShips)
+                sShipStates.push_back({ ship.mPlayerID, ship.mShipInstance->posCurr, ship.mShipInstance->dirCurr, ship.mShipInstance->velCurr, ship.mRotSpeed, ship.mShipInstance->inputPressed, ship.mLastInput });
+            server->SendShipStates(sShipStates);
+
             // Update the asteroids information
             for (auto& obj : sGameObjInstList)
             {
@@ -816,24 +923,8 @@ void GameStatePlayUpdate(void)
 
             server->SendAsteroidsUpdate();
 
-            for (auto& obj : server->GetBulletsToCreate()) 
-            {
-                glm::vec2 pos = obj.mPos;
-                glm::vec2 vel = obj.mVel;
-                GameObjInst* inst = gameObjInstCreate(TYPE_BULLET, BULLET_SIZE, &pos, &vel, obj.mDir, true, sLastGeneratedID);
-
-                inst->mOwnerID = obj.mOwnerID; //set the bullet owner
-
-                CS260::BulletCreationPacket sendPCK;
-                sendPCK.mDir = obj.mDir;
-                sendPCK.mObjectID = sLastGeneratedID++;
-                sendPCK.mOwnerID = obj.mOwnerID;
-                sendPCK.mPos = obj.mPos;
-                sendPCK.mVel = obj.mVel;
-
-                server->SendBulletToAllClients(sendPCK);
-            }
-
+            // Everything queued for the clients during this tick goes out packed together
+            server->Flush();
         }		
         // Client ticks
         else
@@ -841,7 +932,7 @@ void GameStatePlayUpdate(void)
             if (spShip)
                 spShip->modColor = client->GetColor();
 
-            client->Tick();
+            client->Tick(networkTicks);
 
 
             // First of all check if we need to disconnect any player
@@ -888,34 +979,6 @@ void GameStatePlayUpdate(void)
                 }
             }
 
-            // Update the current players
-            for (auto& playerInfo : client->GetPlayersInfo())
-            {
-                for (auto& ship : mRemoteShips)
-                {
-                    if (ship.mPlayerID == playerInfo.mID && ship.mShipInstance)
-                    {
-                        ship.mShipInstance->posCurr = playerInfo.pos;
-                        ship.mShipInstance->dirCurr = playerInfo.rot;
-                        ship.mShipInstance->velCurr = playerInfo.vel;
-                        ship.mShipInstance->inputPressed = playerInfo.inputPressed;
-
-                        if (ship.mShipInstance->inputPressed)
-                        {
-                            vec2 pos, dir;
-                            dir = { glm::cos(ship.mShipInstance->dirCurr), glm::sin(ship.mShipInstance->dirCurr) };
-                            pos = dir;
-                            dir = dir * (SHIP_ACCEL_FORWARD * dt);
-
-                            pos = pos * -ship.mShipInstance->scale;
-                            pos = pos + ship.mShipInstance->posCurr;
-
-                            sparkCreate(PTCL_EXHAUST, &pos, 2, ship.mShipInstance->dirCurr + 0.8f * PI, ship.mShipInstance->dirCurr + 1.2f * PI);
-                        }
-                    }
-                }
-            }
-
             // Create asteroids
             for (auto& asteroid : client->GetCreatedAsteroids())
             {
@@ -929,6 +992,14 @@ void GameStatePlayUpdate(void)
                 {
                     if (obj.id == asteroid.mID && obj.pObject && obj.pObject->type == TYPE_ASTEROID)
                     {
+                        // keep drawing it where it was and blend the difference away, unless it is too far off
+                        obj.posCorrection += obj.posCurr - asteroid.mPosition;
+                        obj.posPrev += asteroid.mPosition - obj.posCurr;
+                        if (glm::length(obj.posCorrection) > AST_SIZE_MAX) {
+                            obj.posCorrection = {0.0f, 0.0f};
+                            obj.posPrev = asteroid.mPosition;
+                        }
+
                         obj.posCurr = asteroid.mPosition;
                         obj.velCurr = asteroid.mVelocity;
                     }
@@ -1000,6 +1071,18 @@ void GameStatePlayUpdate(void)
                 }
             }
 
+            // Start again from the state of our ship the server sent, replaying the inputs it did not apply yet
+            CS260::PlayerInfo shipState;
+            if (spShip && client->GetShipState(&shipState))
+            {
+                spShip->posCurr = shipState.pos;
+                spShip->velCurr = shipState.vel;
+                spShip->dirCurr = shipState.rot;
+                sShipRotSpeed = shipState.rotSpeed;
+                for (auto& command : client->GetPendingInputs())
+                    shipSimulate(spShip, &sShipRotSpeed, command.mInput, command.mDuration * 0.001f);
+            }
+
             // Bullet creation
             for (auto& obj : client->GetBulletsToCreate()) {
 
@@ -1025,10 +1108,6 @@ void GameStatePlayUpdate(void)
                 }
             }
 
-            //if (client->Connected() && spShip)
-            if (client->Connected())// && sShipCtr > 0)
-                client->SendPlayerInfo(spShip->posCurr, spShip->velCurr, spShip->dirCurr, game::instance().input_key_pressed(GLFW_KEY_UP));
-
 			// Handle window about to clsoe
             if (!game::instance().should_continue)
             {
@@ -1039,12 +1118,16 @@ void GameStatePlayUpdate(void)
             {
                 game::instance().should_continue = false;
             }
+
+            // Everything queued for the server during this tick goes out packed together
+            client->Flush();
         }		
     }
 }
 
 // ---------------------------------------------------------------------------
 
+#ifndef ASTEROIDS_HEADLESS
 void GameStatePlayDraw(void)
 {
     auto window = game::instance().window();
@@ -1059,6 +1142,34 @@ void GameStatePlayDraw(void)
     glClear(GL_COLOR_BUFFER_BIT);
     glDisable(GL_CULL_FACE);
 
+    // =====================================
+    // calculate the matrix for all objects
+    // =====================================
+
+    // the frame is this far between the last two steps
+    float alpha = game::instance().render_alpha();
+
+    for (uint32_t i = 0; i < GAME_OBJ_INST_NUM_MAX; i++) {
+        GameObjInst* pInst = sGameObjInstList + i;
+
+        // skip non-active object
+        if ((pInst->flag & FLAG_ACTIVE) == 0)
+            continue;
+
+        vec2  pos = pInst->posCurr;
+        float dir = pInst->dirCurr;
+        if (glm::distance2(pInst->posPrev, pInst->posCurr) < RENDER_SNAP_DISTANCE * RENDER_SNAP_DISTANCE) {
+            pos = pInst->posPrev + (pInst->posCurr - pInst->posPrev) * alpha;
+            dir = pInst->dirPrev + wrap(pInst->dirCurr - pInst->dirPrev, -PI, PI) * alpha;
+        }
+        pos = pos + pInst->posCorrection;
+
+        auto t           = glm::translate(vec3(pos.x, pos.y, 0));
+        auto r           = glm::rotate(dir, vec3(0, 0, 1));
+        auto s           = glm::scale(vec3(pInst->scale, pInst->scale, 1));
+        pInst->transform = t * r * s;
+    }
+
     char strBuffer[1024];
     mat4 tmp, tmpScale = glm::scale(glm::vec3{10, 10, 1});
     vec4 col;
@@ -1164,7 +1275,12 @@ void GameStatePlayDraw(void)
     // display the game over message
     if (sShipCtr < 0)
         game::instance().font_default()->render("       GAME OVER       ", 280, 260, 24, vp);
+
+    // the network stats go over everything else
+    if (game::instance().network_overlay())
+        netStatsDraw(vp, h);
 }
+#endif
 
 // ---------------------------------------------------------------------------
 
@@ -1182,16 +1298,28 @@ void GameStatePlayFree(void)
 
 void GameStatePlayUnload(void)
 {
+#ifndef ASTEROIDS_HEADLESS
     // free all mesh
     for (uint32_t i = 0; i < sGameObjNum; i++) {
         delete sGameObjList[i].pMesh;
         sGameObjList[i].pMesh = nullptr;
     }
+    delete spNetGraphBar;
+    spNetGraphBar = nullptr;
+#endif
 }
 
 // ---------------------------------------------------------------------------
 // Static function implementations
 
+#ifdef ASTEROIDS_HEADLESS
+static void loadGameObjList()
+{
+    // nothing is drawn, the objects only need their type
+    for (uint32_t type = 0; type < TYPE_NUM; type++)
+        sGameObjList[sGameObjNum++].type = type;
+}
+#else
 static void loadGameObjList()
 {
     GameObj* pObj;
@@ -1311,6 +1439,7 @@ static void loadGameObjList()
         }
     }
 }
+#endif
 
 // ---------------------------------------------------------------------------
 
@@ -1333,7 +1462,10 @@ GameObjInst* gameObjInstCreate(uint32_t type, float scale, vec2* pPos, vec2* pVe
             pInst->scale     = scale;
             pInst->posCurr   = pPos ? *pPos : zero;
             pInst->velCurr   = pVel ? *pVel : zero;
+            pInst->posCorrection = zero;
+            pInst->posPrev   = pInst->posCurr;
             pInst->dirCurr   = dir;
+            pInst->dirPrev   = dir;
             pInst->pUserData = 0;
             pInst->modColor = {1.0f,1.0f,1.0f,1.0f};
             pInst->id = id;
@@ -1372,7 +1504,10 @@ GameObjInst* gameObjInstCreate(uint32_t type, float scale, vec2* pPos, vec2* pVe
             pDst->scale     = scale;
             pDst->posCurr   = pPos ? *pPos : zero;
             pDst->velCurr   = pVel ? *pVel : zero;
+            pDst->posCorrection = zero;
+            pDst->posPrev   = pDst->posCurr;
             pDst->dirCurr   = dir;
+            pDst->dirPrev   = dir;
             pDst->pUserData = 0;
 
             // keep track the number of asteroid
@@ -1645,6 +1780,12 @@ void resolveCollision(GameObjInst* pSrc, GameObjInst* pDst, vec2* pNrm)
 
 // ---------------------------------------------------------------------------
 
+#ifdef ASTEROIDS_HEADLESS
+void sparkCreate(uint32_t, vec2*, uint32_t, float, float, float, float, vec2*)
+{
+    // particles are only for show, nobody sees them
+}
+#else
 void sparkCreate(uint32_t type, vec2* pPos, uint32_t count, float angleMin, float angleMax, float srcSize, float velScale, vec2* pVelInit)
 {
     float velRange, velMin, scaleRange, scaleMin;
@@ -1723,9 +1864,11 @@ void sparkCreate(uint32_t type, vec2* pPos, uint32_t count, float angleMin, floa
         }
     }
 }
+#endif
 
 // ---------------------------------------------------------------------------
 
+#ifndef ASTEROIDS_HEADLESS
 GameObjInst* missileAcquireTarget(GameObjInst* pMissile)
 {
     vec2         dir, u;
@@ -1760,5 +1903,141 @@ GameObjInst* missileAcquireTarget(GameObjInst* pMissile)
 
     return pTarget;
 }
+#endif
+
+// ---------------------------------------------------------------------------
+
+void shipSimulate(GameObjInst* pShip, float* pRotSpeed, uint8_t input, float dt)
+{
+    vec2 dir = { glm::cos(pShip->dirCurr), glm::sin(pShip->dirCurr) };
+
+    if (input & CS260::InputThrust) {
+        pShip->velCurr = pShip->velCurr + dir * (SHIP_ACCEL_FORWARD * dt);
+        pShip->velCurr = pShip->velCurr * glm::pow(SHIP_DAMP_FORWARD, dt);
+    }
+    if (input & CS260::InputReverse) {
+        pShip->velCurr = pShip->velCurr + dir * (SHIP_ACCEL_BACKWARD * dt);
+        pShip->velCurr = pShip->velCurr * glm::pow(SHIP_DAMP_BACKWARD, dt);
+    }
+    if (input & CS260::InputLeft) {
+        *pRotSpeed += (SHIP_ROT_SPEED - *pRotSpeed) * 0.1f;
+        pShip->dirCurr += *pRotSpeed * dt;
+        pShip->dirCurr = wrap(pShip->dirCurr, -PI, PI);
+    }
+    else if (input & CS260::InputRight) {
+        *pRotSpeed += (SHIP_ROT_SPEED - *pRotSpeed) * 0.1f;
+        pShip->dirCurr -= *pRotSpeed * dt;
+        pShip->dirCurr = wrap(pShip->dirCurr, -PI, PI);
+    }
+    else {
+        *pRotSpeed = 0.0f;
+    }
+
+    // update the position
+    pShip->posCurr += pShip->velCurr * dt;
+
+    // warp the ship from one end of the screen to the other
+    pShip->posCurr.x = wrap(pShip->posCurr.x, gAEWinMinX - SHIP_SIZE, gAEWinMaxX + SHIP_SIZE);
+    pShip->posCurr.y = wrap(pShip->posCurr.y, gAEWinMinY - SHIP_SIZE, gAEWinMaxY + SHIP_SIZE);
+}
 
 // ---------------------------------------------------------------------------
+
+#ifndef ASTEROIDS_HEADLESS
+static void netStatsSample()
+{
+    float time = game::instance().game_time();
+    if (sNetStatsTime > 0.0f && time - sNetStatsTime < NET_STATS_INTERVAL)
+        return;
+
+    CS260::ConnectionStats stats = is_server ? server->GetNetworkStats() : client->GetNetworkStats();
+
+    // the first sample is only where the rates count from
+    if (sNetStatsTime > 0.0f) {
+        float elapsed = time - sNetStatsTime;
+
+        // datagrams counted as lost come back down when they arrive late
+        float received = static_cast<float>(stats.mSequencedReceived - sNetStats.mSequencedReceived);
+        float lost     = static_cast<float>(static_cast<long long>(stats.mPacketsLost) - static_cast<long long>(sNetStats.mPacketsLost));
+
+        sNetRates.bytesSent       = (stats.mBytesSent - sNetStats.mBytesSent) / elapsed;
+        sNetRates.bytesReceived   = (stats.mBytesReceived - sNetStats.mBytesReceived) / elapsed;
+        sNetRates.packetsSent     = (stats.mPacketsSent - sNetStats.mPacketsSent) / elapsed;
+        sNetRates.packetsReceived = (stats.mPacketsReceived - sNetStats.mPacketsReceived) / elapsed;
+        sNetRates.loss            = lost > 0.0f ? lost / (received + lost) : 0.0f;
+
+        sNetHistory[sNetHistoryNext] = sNetRates;
+        sNetHistoryNext              = (sNetHistoryNext + 1) % NET_STATS_HISTORY;
+        sNetHistoryCount             = std::min(sNetHistoryCount + 1, static_cast<unsigned>(NET_STATS_HISTORY));
+    }
+
+    sNetStats     = stats;
+    sNetStatsTime = time;
+}
+
+// ---------------------------------------------------------------------------
+
+static void netStatsDraw(mat4 const& vp, int h)
+{
+    char         strBuffer[256];
+    engine::font* font  = game::instance().font_default();
+    vec4 const   color = {0.6f, 1.0f, 0.6f, 1.0f};
+    int          y     = h - 90;
+
+    // ==========================
+    // counters, under the scores
+    // ==========================
+
+    sprintf(strBuffer, "rtt %.1f ms  loss %.1f%%  unacked %u  connections %u", sNetStats.mRtt, sNetRates.loss * 100.0f, sNetStats.mUnacknowledged, sNetStats.mConnections);
+    font->render(strBuffer, 10, y, NET_STATS_FONT_SIZE, vp, color);
+    y -= NET_STATS_LINE;
+
+    sprintf(strBuffer, "out %.1f kB/s %.0f pkt/s  in %.1f kB/s %.0f pkt/s", sNetRates.bytesSent / 1000.0f, sNetRates.packetsSent, sNetRates.bytesReceived / 1000.0f, sNetRates.packetsReceived);
+    font->render(strBuffer, 10, y, NET_STATS_FONT_SIZE, vp, color);
+    y -= NET_STATS_LINE;
+
+    sprintf(strBuffer, "resent %llu  duplicates %llu  lost %llu  failed %llu  deferred %llu  dropped %llu", sNetStats.mResends, sNetStats.mDuplicates, sNetStats.mPacketsLost, sNetStats.mDeliveryFailures, sNetStats.mDeferredMessages, sNetStats.mDroppedMessages);
+    font->render(strBuffer, 10, y, NET_STATS_FONT_SIZE, vp, color);
+    y -= NET_STATS_LINE;
+
+    // the messages of each type that went through so far, as many as fit above the graph
+    for (unsigned type = 0; type < CS260::STATS_MESSAGE_TYPES && y > NET_GRAPH_HEIGHT + 2 * NET_STATS_LINE + 10; type++) {
+        CS260::MessageStats const& messages = sNetStats.mMessages[type];
+        if (messages.mSent == 0 && messages.mReceived == 0)
+            continue;
+
+        sprintf(strBuffer, "%-25s out %8llu %9.1f kB  in %8llu %9.1f kB", CS260::Protocol::GetTypeName(static_cast<CS260::Packet_Types>(type)),
+                messages.mSent, messages.mBytesSent / 1000.0f, messages.mReceived, messages.mBytesReceived / 1000.0f);
+        font->render(strBuffer, 10, y, NET_STATS_FONT_SIZE, vp, color);
+        y -= NET_STATS_LINE;
+    }
+
+    // ==========================================================
+    // bandwidth graph, a column per sample with out and in bars
+    // ==========================================================
+
+    auto drawBar = [&vp](float x, float y, float width, float height, vec4 const& barColor) {
+        game::instance().shader_default()->use();
+        game::instance().shader_default()->set_uniform(0, vp * glm::translate(vec3(x, y, 0)) * glm::scale(vec3(width, height, 1)));
+        game::instance().shader_default()->set_uniform(1, barColor);
+        spNetGraphBar->draw();
+    };
+
+    // the highest sample fills the graph, at least 1 kB/s
+    float highest = 1000.0f;
+    for (unsigned i = 0; i < sNetHistoryCount; i++)
+        highest = std::max(highest, std::max(sNetHistory[i].bytesSent, sNetHistory[i].bytesReceived));
+
+    vec4 const outColor = {0.6f, 1.0f, 0.6f, 1.0f};
+    vec4 const inColor  = {0.4f, 0.6f, 1.0f, 1.0f};
+    drawBar(10.0f, 10.0f, NET_STATS_HISTORY * 2.0f, NET_GRAPH_HEIGHT, {0.2f, 0.2f, 0.2f, 1.0f});
+    for (unsigned i = 0; i < sNetHistoryCount; i++) {
+        NetStatsRates const& sample = sNetHistory[(sNetHistoryNext + NET_STATS_HISTORY - sNetHistoryCount + i) % NET_STATS_HISTORY];
+        drawBar(10.0f + i * 2.0f, 10.0f, 1.0f, NET_GRAPH_HEIGHT * sample.bytesSent / highest, outColor);
+        drawBar(11.0f + i * 2.0f, 10.0f, 1.0f, NET_GRAPH_HEIGHT * sample.bytesReceived / highest, inColor);
+    }
+
+    sprintf(strBuffer, "out/in up to %.1f kB/s", highest / 1000.0f);
+    font->render(strBuffer, 10, static_cast<int>(NET_GRAPH_HEIGHT) + 10 + NET_STATS_LINE, NET_STATS_FONT_SIZE, vp, color);
+}
+#endif
@@ -1,14 +1,31 @@
+#ifdef ASTEROIDS_HEADLESS
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#else
 #include "engine/window.hpp"
 #include "engine/opengl.hpp"
+#endif
 #include "game/game.hpp"
 
 #include "networking/server.hpp"
 #include "networking/client.hpp"
 #include "networking/networking.hpp"
 #include "networking/utils.hpp"
+#include "networking/simulated_io_backend.hpp"
 
+#ifdef ASTEROIDS_HEADLESS
+namespace {
+	// Set by SIGINT and SIGTERM, a headless server has no window to close
+	volatile std::sig_atomic_t sStopRequested = 0;
 
-void Parse(int argc, char** argv, bool* is_client, bool* is_server, std::string* address, uint16_t* port, bool* verbose, bool* is_solo) {
+	void RequestStop(int) {
+		sStopRequested = 1;
+	}
+}
+#endif
+
+void Parse(int argc, char** argv, bool* is_client, bool* is_server, std::string* address, uint16_t* port, bool* verbose, bool* is_solo, CS260::IoBackendType* io, unsigned* shards, glm::vec2* viewExtents, unsigned* budget, unsigned* shipInterval, unsigned* interpolationDelay, unsigned* tickRate, CS260::NetworkConditions* conditions, bool* netStats, bool* serverStats) {
 
 	for (int i = 0; i < argc; i++) {// for each argument we find, parse it
 
@@ -36,6 +53,71 @@ void Parse(int argc, char** argv, bool* is_client, bool* is_server, std::string*
 			*is_solo = true;
 		}
 
+		if (strcmp("--io", argv[i]) == 0) {
+			*io = CS260::IoBackend::FromString(argv[i + 1]);
+		}
+
+		if (strcmp("--shards", argv[i]) == 0) {
+			*shards = atoi(argv[i + 1]);
+		}
+
+		if (strcmp("--view-extents", argv[i]) == 0) {
+			viewExtents->x = static_cast<float>(atof(argv[i + 1]));
+			viewExtents->y = static_cast<float>(atof(argv[i + 2]));
+		}
+
+		if (strcmp("--budget", argv[i]) == 0) {
+			*budget = atoi(argv[i + 1]);
+		}
+
+		if (strcmp("--ship-interval", argv[i]) == 0) {
+			*shipInterval = atoi(argv[i + 1]);
+		}
+
+		if (strcmp("--interp-delay", argv[i]) == 0) {
+			*interpolationDelay = atoi(argv[i + 1]);
+		}
+
+		if (strcmp("--tick-rate", argv[i]) == 0) {
+			*tickRate = atoi(argv[i + 1]);
+		}
+
+		if (strcmp("--sim-latency", argv[i]) == 0) {
+			conditions->mLatency = static_cast<float>(atof(argv[i + 1]));
+		}
+
+		if (strcmp("--sim-jitter", argv[i]) == 0) {
+			conditions->mJitter = static_cast<float>(atof(argv[i + 1]));
+		}
+
+		if (strcmp("--sim-loss", argv[i]) == 0) {
+			conditions->mLoss = static_cast<float>(atof(argv[i + 1]));
+		}
+
+		if (strcmp("--sim-duplicate", argv[i]) == 0) {
+			conditions->mDuplication = static_cast<float>(atof(argv[i + 1]));
+		}
+
+		if (strcmp("--sim-reorder", argv[i]) == 0) {
+			conditions->mReordering = static_cast<float>(atof(argv[i + 1]));
+		}
+
+		if (strcmp("--sim-bandwidth", argv[i]) == 0) {
+			conditions->mBandwidth = atoi(argv[i + 1]);
+		}
+
+		if (strcmp("--sim-seed", argv[i]) == 0) {
+			conditions->mSeed = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+		}
+
+		if (strcmp("--net-stats", argv[i]) == 0) {
+			*netStats = true;
+		}
+
+		if (strcmp("--server-stats", argv[i]) == 0) {
+			*serverStats = true;
+		}
+
 	}
 
 }
@@ -48,8 +130,56 @@ int main(int argc, char** argv)
 	uint16_t port = 0;
 
 	bool verbose = false;
+	CS260::IoBackendType io = CS260::IoBackendType::Default;
+	unsigned shards = 1;
+	glm::vec2 viewExtents = { 0, 0 };
+	unsigned budget = 0;
+	unsigned shipInterval = 50;
+	unsigned interpolationDelay = 100;
+	unsigned tickRate = 60;
+	CS260::NetworkConditions conditions;
+	bool netStats = false;
+	bool serverStats = false;
+
+	Parse(argc, argv, &is_client, &is_server, &address, &port, &verbose, &is_solo, &io, &shards, &viewExtents, &budget, &shipInterval, &interpolationDelay, &tickRate, &conditions, &netStats, &serverStats);
+
+#ifdef ASTEROIDS_HEADLESS
+	// The dedicated server build can only be a server
+	is_server = true;
+	is_solo = false;
+
+	std::signal(SIGINT, RequestStop);
+	std::signal(SIGTERM, RequestStop);
+#endif
+
+	// Socket backend used by the server and the client (poll, batched or uring)
+	CS260::IoBackend::SetPreferred(io);
+
+	// Latency, jitter, loss, duplication, reordering and bandwidth applied to each datagram this process sends and receives,
+	// to try the game on a bad connection locally. Both directions are affected, so half the round trip goes in the latency
+	CS260::IoBackend::SetNetworkConditions(conditions);
+
+	// Sockets, each with its own network thread, the server receives its clients with
+	CS260::Server::SetShardCount(shards);
+
+	// Half the size of the view around the ship of each client, only what is in or near it is replicated to the client
+	CS260::Server::SetViewExtents(viewExtents);
+
+	// Bytes sent to each client per tick, so a burst of messages is spread over the next ticks instead of being lost
+	CS260::Server::SetClientByteBudget(budget);
+
+	// Milliseconds between the states of the ships, the clients show the other ships that far in the past to move them between the states
+	CS260::Server::SetShipStatesInterval(shipInterval);
+	CS260::Client::SetInterpolationDelay(interpolationDelay);
+
+	// Time per tick, packets and bytes of the server sent to its clients every second, for the bot swarm to report
+	CS260::Server::SetStatsInterval(serverStats ? 1000 : 0);
+
+	// Simulation steps per second, the frames render between the last two
+	game::instance().set_tick_rate(tickRate);
 
-	Parse(argc, argv, &is_client, &is_server, &address, &port, &verbose, &is_solo);
+	// Counters, round trip time, loss and bandwidth of the connections drawn over the game, F3 shows and hides them
+	game::instance().set_network_overlay(netStats);
 
 	game::instance().create(is_server, address, port, verbose, is_solo);
 
@@ -57,6 +187,9 @@ int main(int argc, char** argv)
 	do
 	{
 		exit = !game::instance().update();
+#ifdef ASTEROIDS_HEADLESS
+		exit = exit || sStopRequested;
+#endif
 	} while (!exit);
 	
     game::instance().destroy();
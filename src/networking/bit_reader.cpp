@@ -0,0 +1,75 @@
+#include "bit_reader.hpp"
+
+#include "quantization.hpp"
+
+namespace CS260
+{
+	BitReader::BitReader(const char* buffer, unsigned size) :
+		mBuffer(buffer),
+		mSizeBits(size * 8),
+		mBitPosition(0),
+		mOverflowed(false)
+	{
+	}
+
+	uint32_t BitReader::ReadBits(unsigned bits)
+	{
+		if (mOverflowed || bits > GetBitsLeft()) {
+			mOverflowed = true;
+			return 0;
+		}
+
+		uint32_t value = 0;
+		while (bits > 0) {
+			unsigned byte = mBitPosition / 8;
+			unsigned used = mBitPosition % 8;
+			unsigned chunk = std::min(bits, 8 - used);
+
+			uint32_t chunkValue = (static_cast<uint8_t>(mBuffer[byte]) >> (8 - used - chunk)) & ((1u << chunk) - 1);
+			//shift in two steps, a single shift by 32 is undefined
+			value = ((value << (chunk - 1)) << 1) | chunkValue;
+
+			bits -= chunk;
+			mBitPosition += chunk;
+		}
+		return value;
+	}
+
+	bool BitReader::ReadBool()
+	{
+		return ReadBits(1) != 0;
+	}
+
+	int32_t BitReader::ReadInt(int32_t min, int32_t max)
+	{
+		uint32_t range = static_cast<uint32_t>(static_cast<int64_t>(max) - min);
+		int64_t value = static_cast<int64_t>(ReadBits(BitsRequired(range))) + min;
+		//a corrupted value can be past max if the range is not a power of two
+		return static_cast<int32_t>(std::min<int64_t>(value, max));
+	}
+
+	float BitReader::ReadFloat(float min, float max, float resolution)
+	{
+		return DequantizeFloat(ReadBits(BitsRequired(QuantizedMax(min, max, resolution))), min, max, resolution);
+	}
+
+	float BitReader::ReadAngle(unsigned bits)
+	{
+		return DequantizeAngle(ReadBits(bits), bits);
+	}
+
+	unsigned BitReader::GetBytesRead() const
+	{
+		return (mBitPosition + 7) / 8;
+	}
+
+	unsigned BitReader::GetBitsLeft() const
+	{
+		return mSizeBits - mBitPosition;
+	}
+
+	bool BitReader::HasOverflowed() const
+	{
+		return mOverflowed;
+	}
+}
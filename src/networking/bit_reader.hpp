@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+
+namespace CS260 {
+
+	// Reads back the values packed by a BitWriter, in the same order and with the same ranges.
+	// Reading past the end of the buffer returns zeros and marks the reader as overflowed
+	class BitReader {
+
+	public:
+		/**
+		* @brief
+		*  Constructs a reader from the start of the given buffer
+		*/
+		BitReader(const char* buffer, unsigned size);
+
+		/**
+		* @brief
+		* Reads a value of the given amount of bits, up to 32
+		*/
+		uint32_t ReadBits(unsigned bits);
+
+		/**
+		* @brief
+		* Reads a single bit
+		*/
+		bool ReadBool();
+
+		/**
+		* @brief
+		* Reads an integer written by BitWriter::WriteInt with the same range
+		*/
+		int32_t ReadInt(int32_t min, int32_t max);
+
+		/**
+		* @brief
+		* Reads a float written by BitWriter::WriteFloat with the same range and resolution
+		*/
+		float ReadFloat(float min, float max, float resolution);
+
+		/**
+		* @brief
+		* Reads an angle written by BitWriter::WriteAngle with the same bits, in [-PI, PI)
+		*/
+		float ReadAngle(unsigned bits);
+
+		/**
+		* @brief
+		* Bytes touched by what was read so far, the last one may be partially read
+		*/
+		unsigned GetBytesRead() const;
+
+		/**
+		* @brief
+		* Bits that can still be read
+		*/
+		unsigned GetBitsLeft() const;
+
+		/**
+		* @brief
+		* Whether something was read past the end of the buffer
+		*/
+		bool HasOverflowed() const;
+
+	private:
+		const char* mBuffer;
+		unsigned mSizeBits;
+		unsigned mBitPosition;
+		bool mOverflowed;
+	};
+}
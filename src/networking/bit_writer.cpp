@@ -0,0 +1,81 @@
+#include "bit_writer.hpp"
+
+#include "quantization.hpp"
+
+namespace CS260
+{
+	BitWriter::BitWriter(char* buffer, unsigned capacity) :
+		mBuffer(buffer),
+		mCapacityBits(capacity * 8),
+		mBitPosition(0),
+		mOverflowed(false)
+	{
+	}
+
+	void BitWriter::WriteBits(uint32_t value, unsigned bits)
+	{
+		if (mOverflowed || bits > GetBitsLeft()) {
+			mOverflowed = true;
+			return;
+		}
+
+		//fill the current byte and then whole bytes, a chunk at a time
+		while (bits > 0) {
+			unsigned byte = mBitPosition / 8;
+			unsigned used = mBitPosition % 8;
+			unsigned chunk = std::min(bits, 8 - used);
+
+			//the buffer is not cleared beforehand
+			if (used == 0)
+				mBuffer[byte] = 0;
+
+			uint32_t chunkValue = (value >> (bits - chunk)) & ((1u << chunk) - 1);
+			mBuffer[byte] = static_cast<char>(static_cast<uint8_t>(mBuffer[byte]) | (chunkValue << (8 - used - chunk)));
+
+			bits -= chunk;
+			mBitPosition += chunk;
+		}
+	}
+
+	void BitWriter::WriteBool(bool value)
+	{
+		WriteBits(value ? 1 : 0, 1);
+	}
+
+	void BitWriter::WriteInt(int32_t value, int32_t min, int32_t max)
+	{
+		int32_t clamped = std::clamp(value, min, max);
+		uint32_t range = static_cast<uint32_t>(static_cast<int64_t>(max) - min);
+		WriteBits(static_cast<uint32_t>(static_cast<int64_t>(clamped) - min), BitsRequired(range));
+	}
+
+	void BitWriter::WriteFloat(float value, float min, float max, float resolution)
+	{
+		WriteBits(QuantizeFloat(value, min, max, resolution), BitsRequired(QuantizedMax(min, max, resolution)));
+	}
+
+	void BitWriter::WriteAngle(float radians, unsigned bits)
+	{
+		WriteBits(QuantizeAngle(radians, bits), bits);
+	}
+
+	unsigned BitWriter::GetBitsWritten() const
+	{
+		return mBitPosition;
+	}
+
+	unsigned BitWriter::GetBytesWritten() const
+	{
+		return (mBitPosition + 7) / 8;
+	}
+
+	unsigned BitWriter::GetBitsLeft() const
+	{
+		return mCapacityBits - mBitPosition;
+	}
+
+	bool BitWriter::HasOverflowed() const
+	{
+		return mOverflowed;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+namespace CS260 {
+
+	// Packs values into a buffer using only the bits each one needs, most significant bit first.
+	// Writing past the end of the buffer does nothing but mark the writer as overflowed
+	class BitWriter {
+
+	public:
+		/**
+		* @brief
+		*  Constructs a writer filling the given buffer from its start
+		*/
+		BitWriter(char* buffer, unsigned capacity);
+
+		/**
+		* @brief
+		* Writes the lowest bits of a value
+		* @param bits : amount of bits to write, up to 32
+		*/
+		void WriteBits(uint32_t value, unsigned bits);
+
+		/**
+		* @brief
+		* Writes a single bit
+		*/
+		void WriteBool(bool value);
+
+		/**
+		* @brief
+		* Writes an integer clamped to [min, max] with the bits that range needs
+		*/
+		void WriteInt(int32_t value, int32_t min, int32_t max);
+
+		/**
+		* @brief
+		* Writes a float clamped to [min, max) as the closest step of the given resolution
+		*/
+		void WriteFloat(float value, float min, float max, float resolution);
+
+		/**
+		* @brief
+		* Writes an angle in radians as one of the 2^bits steps of a whole turn
+		*/
+		void WriteAngle(float radians, unsigned bits);
+
+		/**
+		* @brief
+		* Bits written so far
+		*/
+		unsigned GetBitsWritten() const;
+
+		/**
+		* @brief
+		* Bytes used by what was written so far, the last one may be partially used
+		*/
+		unsigned GetBytesWritten() const;
+
+		/**
+		* @brief
+		* Bits that can still be written
+		*/
+		unsigned GetBitsLeft() const;
+
+		/**
+		* @brief
+		* Whether something did not fit in the buffer
+		*/
+		bool HasOverflowed() const;
+
+	private:
+		char* mBuffer;
+		unsigned mCapacityBits;
+		unsigned mBitPosition;
+		bool mOverflowed;
+	};
+}
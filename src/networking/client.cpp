@@ -13,18 +13,37 @@
 
 #include "utils.hpp"
 
-#include <sstream>
+#include <algorithm>
+#include <cstring>
 
 namespace CS260
-{	/*	\fn Client
+{
+	namespace
+	{
+		unsigned sInterpolationDelay = 100;
+	}
+
+	/*	\fn Client
 	\brief	Client default constructor
 	*/
-	Client::Client(const std::string& ip_address, uint16_t port, bool verbose)
+	Client::Client(const std::string& ip_address, uint16_t port, bool verbose, bool threaded)
 		:mVerbose(verbose),
 		mSocket(0),
 		mConnected(false),
+		mDisconnected(false),
 		mClose(false),
-		mKeepAliveTimer(0)
+		mKeepAliveTimer(0),
+		mNewestSnapshot(0),
+		mHasSnapshot(false),
+		mNextInput(1),
+		mInputRemainder(0.0f),
+		mShipState{},
+		mHasShipState(false),
+		mServerStats{},
+		mHasServerStats(false),
+		mStartTime(now()),
+		mServerTimeOffset(0),
+		mHasServerTime(false)
 	{	
 
 		// Create UDP socket for the client
@@ -61,8 +80,9 @@ namespace CS260
 
 		SetSocketBlocking(mSocket, false);
 
-		//set the protocol socket
-		mProtocol.SetSocket(mSocket);
+		//start the network thread with the protocol socket
+		mNetwork.SetDeliveryFailedCallback([this](const sockaddr*, Packet_Types type) { HandleDeliveryFailed(type); });
+		mNetwork.Start(mSocket, threaded);
 		if (ConnectToServer())
 		{
 			PrintMessage("Connected to server correctly.");
@@ -78,13 +98,20 @@ namespace CS260
 	{
 		
 		//DisconnectFromServer();
+		//the network thread sends the last messages and stops using the socket
+		mNetwork.Stop();
 		closesocket(mSocket);
 	
 	}
 
-	void Client::Tick()
+	void Client::SetInterpolationDelay(unsigned milliseconds)
+	{
+		sInterpolationDelay = milliseconds;
+	}
+
+	void Client::Tick(unsigned ticks)
 	{
-		mKeepAliveTimer += tickRate;
+		mKeepAliveTimer += tickRate * ticks;
 		
 		// clear the vectors that refer to the previous tick
 		mNewPlayersOnFrame.clear();
@@ -96,37 +123,78 @@ namespace CS260
 		mPlayersDied.clear();
 		mScorePacketsToHandle.clear();
 		mBulletsToCreate.clear();
+		mHasShipState = false;
+		mHasServerStats = false;
 
 		
 		ReceiveMessages();
 
-		//resend unacknowledged messages
-		mProtocol.Tick();
+		//resend unacknowledged messages, when threaded the network thread already does it
+		mNetwork.Tick();
 		
 		HandleTimeOut();
 		
 	}
 
-	void Client::SendPlayerInfo(glm::vec2 pos, glm::vec2 vel,  float rotation, bool input)
+	void Client::Flush()
 	{
-		std::stringstream str;
-		str << "Sending player info Pos: ";
-		str << pos.x;
-		str << ", ";
-		str << pos.y;
-		
-		PrintMessage(str.str());
+		// Every input the server did not apply yet goes again, the newest ones if they do not fit
+		if (mConnected && !mPendingInputs.empty())
 		{
-			//send the packet with my ship info
-			ShipUpdatePacket myShipPacket;
-			myShipPacket.mPlayerInfo.mID = mID;
-			myShipPacket.mPlayerInfo.pos = pos;
-			myShipPacket.mPlayerInfo.vel = vel;
-			myShipPacket.mPlayerInfo.rot = rotation;
-			myShipPacket.mPlayerInfo.inputPressed = input;
-
-			mProtocol.SendPacket(Packet_Types::ShipPacket, &myShipPacket, nullptr);
+			InputCommandsPacket packet;
+			packet.mCount = static_cast<unsigned>(std::min<size_t>(mPendingInputs.size(), MAX_INPUT_COMMANDS));
+			std::copy(mPendingInputs.end() - packet.mCount, mPendingInputs.end(), packet.mCommands);
+			mNetwork.SendPacket(Packet_Types::InputCommands, &packet, packet.GetSize());
 		}
+
+		//also sends the pending acknowledgements, or keeps us alive if nothing was queued
+		mNetwork.Flush();
+	}
+
+	bool Client::Disconnected()
+	{
+		return mDisconnected;
+	}
+
+	InputCommand Client::QueueInput(uint8_t input, float dt)
+	{
+		InputCommand command;
+		command.mSequence = mNextInput++;
+		command.mInput = input;
+		//whole milliseconds, the rounding goes to the next one so fixed steps that are not add up
+		float duration = std::clamp(dt * 1000.0f + mInputRemainder, 0.0f, static_cast<float>(MAX_INPUT_DURATION));
+		command.mDuration = static_cast<uint8_t>(duration + 0.5f);
+		mInputRemainder = duration - command.mDuration;
+
+		// The oldest ones can not be replayed anymore, the next state of our ship corrects them
+		if (mPendingInputs.size() == maxPendingInputs)
+			mPendingInputs.pop_front();
+		mPendingInputs.push_back(command);
+		return command;
+	}
+
+	const std::deque<InputCommand>& Client::GetPendingInputs()
+	{
+		return mPendingInputs;
+	}
+
+	bool Client::GetShipState(PlayerInfo* state)
+	{
+		if (mHasShipState)
+			*state = mShipState;
+		return mHasShipState;
+	}
+
+	bool Client::GetServerStats(ServerStatsPacket* stats)
+	{
+		if (mHasServerStats)
+			*stats = mServerStats;
+		return mHasServerStats;
+	}
+
+	ConnectionStats Client::GetNetworkStats()
+	{
+		return mNetwork.GetTotalStats();
 	}
 
 	std::vector<NewPlayerPacket>  Client::GetNewPlayers()
@@ -170,35 +238,23 @@ namespace CS260
 		PrintMessage("[CLIENT] Sending connection request SYN ");
 
 		SYNPacket packet;
-		mProtocol.SendPacket(Packet_Types::SYN, &packet);
+		mNetwork.SendPacket(Packet_Types::SYN, &packet);
+		mNetwork.Flush();
 		
 		return true;
 	}
 
 	void Client::ReceiveMessages()
 	{
-		WSAPOLLFD poll;
-		poll.fd = mSocket;
-		poll.events = POLLIN;
 		auto clock = now();
 		do
 		{
-			// TODO: Handle timeout 
-			while (WSAPoll(&poll, 1, timeout) > 0)
-			{
-				if (poll.revents & POLLERR)
-				{
-					PrintError("Polling receiving players information");
-				}
-				else
-				{
-					ProtocolPacket packet;
-					unsigned size = sizeof(ProtocolPacket);
-					Packet_Types type;
-					if (mProtocol.ReceivePacket(&packet, &size, &type))
-						HandleReceivedMessage(packet, type);
-				}
-			}
+			ProtocolPacket packet;
+			unsigned size = sizeof(ProtocolPacket);
+			Packet_Types type;
+			// A datagram may carry several messages, the protocol returns them one by one until the socket is empty
+			while (mNetwork.ReceivePacket(&packet, &size, &type))
+				HandleReceivedMessage(packet, size, type);
 		} while (ms_since(clock) < 10000 && !mConnected);
 	}
 
@@ -214,7 +270,14 @@ namespace CS260
 		}
 	}
 
-	void Client::HandleReceivedMessage(ProtocolPacket& packet, Packet_Types type)
+	void Client::HandleDeliveryFailed(Packet_Types type)
+	{
+		// The server did not acknowledge the message after all the tries, assume the connection is lost
+		mClose = true;
+		PrintMessage("Exiting, server did not acknowledge packet of type " + std::to_string(static_cast<int>(type)));
+	}
+
+	void Client::HandleReceivedMessage(ProtocolPacket& packet, unsigned size, Packet_Types type)
 	{
 		mKeepAliveTimer = 0;
 		switch (type)
@@ -227,21 +290,15 @@ namespace CS260
 			break;
 		case Packet_Types::ObjectUpdate:
 			break;
-		case Packet_Types::ShipPacket:
-
-			ShipUpdatePacket recPacket;
-			memcpy(&recPacket, packet.mBuffer.data(), sizeof(recPacket));
-			if (mID != recPacket.mPlayerInfo.mID)
-			{
-				//not my ship, so store the data
-				for (auto& i : mPlayersState) 
-				{
-					if (i.mID == recPacket.mPlayerInfo.mID) 
-					{
-						i = recPacket.mPlayerInfo;
-					}
-				}
-			}
+		case Packet_Types::ShipStates:
+		{
+			// Only the used ships were written
+			ShipStatesPacket recPacket;
+			memcpy(&recPacket, packet.mBuffer.data(), size);
+			UpdateServerTime(recPacket.mTime);
+			for (unsigned i = 0; i < recPacket.mCount; i++)
+				StorePlayerState(recPacket.mShips[i], recPacket.mTime);
+		}
 			break;
 		case Packet_Types::SYN:
 			break;
@@ -254,7 +311,7 @@ namespace CS260
 			mID = receivedPacket.mPlayerID;
 			mColor = receivedPacket.color;
 			// TODO: Send connection ACK properly
-			mProtocol.SendPacket(SYNACK, &receivedPacket, 0);
+			mNetwork.SendPacket(SYNACK, &receivedPacket, nullptr);
 			mConnected = true;
 		}
 			break;
@@ -278,7 +335,8 @@ namespace CS260
 		{
 			PlayerDisconnectACKPacket sendPacket;
 			sendPacket.mPlayerID = mID;
-			mProtocol.SendPacket(Packet_Types::ACKDisconnect, &sendPacket);
+			mNetwork.SendPacket(Packet_Types::ACKDisconnect, &sendPacket);
+			mDisconnected = true;
 		}
 			break;
 			// We were notified that a client was disconnected either by the server or by the client itself
@@ -287,6 +345,7 @@ namespace CS260
 			PlayerDisconnectPacket receivedPacket;
 			::memcpy(&receivedPacket, packet.mBuffer.data(), sizeof(receivedPacket));
 			mDisconnectedPlayersIDs.push_back(receivedPacket.mPlayerID);
+			mInterpolation.erase(receivedPacket.mPlayerID);
 		}
 		break;
 		case Packet_Types::AsteroidCreation:
@@ -320,6 +379,35 @@ namespace CS260
 			mAsteroidsUpdate.push_back(receivedPacket);
 		}
 		break;
+		case Packet_Types::AsteroidSnapshot:
+		{
+			// If its baseline was already forgotten, the server will use a newer one once we acknowledge it
+			if (!DecodeSnapshot(packet.mBuffer.data(), size, mSnapshots, &mSnapshot))
+				break;
+
+			// An older snapshot that arrived late is already stale
+			if (mHasSnapshot && !SequenceGreaterThan(mSnapshot.mID, mNewestSnapshot))
+				break;
+
+			mSnapshots.Store(mSnapshot);
+			mNewestSnapshot = mSnapshot.mID;
+			mHasSnapshot = true;
+
+			// Every asteroid is updated, not only the ones the message carried. The server only leaves out the ones
+			// the dead reckoning from the baseline puts close enough, so this keeps all of them that close
+			mAsteroidsUpdate.insert(mAsteroidsUpdate.end(), mSnapshot.mAsteroids.begin(), mSnapshot.mAsteroids.end());
+
+			SnapshotAckPacket ack;
+			ack.mSnapshotID = mSnapshot.mID;
+			mNetwork.SendPacket(Packet_Types::SnapshotAck, &ack);
+		}
+		break;
+		case Packet_Types::SnapshotAck:
+			break;
+		case Packet_Types::InputCommands:
+			break;
+		case Packet_Types::ShipPacket:
+			break;
 		case Packet_Types::AsteroidDestroy:
 		{
 			AsteroidDestructionPacket receivedPacket;
@@ -336,7 +424,7 @@ namespace CS260
 			{
 				PrintMessage("Received player die ourself");
 				// Acknowledge the die packet
-				mProtocol.SendPacket(Packet_Types::PlayerDie, &receivedPacket);
+				mNetwork.SendPacket(Packet_Types::PlayerDie, &receivedPacket);
 			}
 			else
 				PrintMessage("Received player die remote");
@@ -355,15 +443,59 @@ namespace CS260
 		break;
 
 		case Packet_Types::ScoreUpdate:
-
+		{
 			ScorePacket mCastedPack;
 			memcpy(&mCastedPack, &packet, sizeof(mCastedPack));
 			mScorePacketsToHandle.push_back(mCastedPack);
-
+		}
+			break;
+		case Packet_Types::ServerStats:
+			memcpy(&mServerStats, packet.mBuffer.data(), sizeof(mServerStats));
+			mHasServerStats = true;
 			break;
 		}
 	}
 
+	void Client::StorePlayerState(const PlayerInfo& info, uint32_t time)
+	{
+		if (mID == info.mID)
+		{
+			//a state that arrived late does not include inputs an already received one did
+			if (SequenceGreaterThan(mShipState.mInputSequence, info.mInputSequence))
+				return;
+			mShipState = info;
+			mHasShipState = true;
+
+			//the inputs up to the one the server applied last are already in the state
+			while (!mPendingInputs.empty() && !SequenceGreaterThan(mPendingInputs.front().mSequence, info.mInputSequence))
+				mPendingInputs.pop_front();
+			return;
+		}
+
+		//not my ship, so store the data
+		for (auto& i : mPlayersState)
+		{
+			if (i.mID == info.mID)
+				i = info;
+		}
+		mInterpolation[info.mID].Store(time, info);
+	}
+
+	void Client::UpdateServerTime(uint32_t time)
+	{
+		//the states that took the least to arrive give the closest offset, the rest arrived late
+		int64_t offset = static_cast<int64_t>(time) - ms_since(mStartTime);
+		if (!mHasServerTime || offset > mServerTimeOffset)
+			mServerTimeOffset = offset;
+		mHasServerTime = true;
+	}
+
+	uint32_t Client::GetInterpolationTime()
+	{
+		int64_t time = ms_since(mStartTime) + mServerTimeOffset - sInterpolationDelay;
+		return static_cast<uint32_t>(std::max<int64_t>(time, 0));
+	}
+
 
 	void Client::PrintMessage(const std::string& msg)
 	{
@@ -390,7 +522,15 @@ namespace CS260
 	{
 		PlayerDisconnectPacket packet;
 		packet.mPlayerID = mID;
-		mProtocol.SendPacket(Packet_Types::PlayerDisconnect, &packet);
+		mNetwork.SendPacket(Packet_Types::PlayerDisconnect, &packet);
+		//we may not tick again before closing
+		mNetwork.Flush();
+	}
+
+	bool Client::GetInterpolatedPlayer(unsigned char playerID, PlayerInfo* state)
+	{
+		auto found = mInterpolation.find(playerID);
+		return found != mInterpolation.end() && found->second.Sample(GetInterpolationTime(), state);
 	}
 
 	unsigned char Client::GetPlayerID()
@@ -433,17 +573,6 @@ namespace CS260
 		return mColor;
 	}
 
-	void Client::RequestBullet(unsigned mOwnerID, glm::vec2 vel, glm::vec2 pos, float dir)
-	{
-		//request the bullet creation to the server
-		BulletRequestPacket mPacket;
-		mPacket.mOwnerID = mOwnerID;
-		mPacket.mPos = pos;
-		mPacket.mVel = vel;
-		mPacket.mDir = dir;
-		mProtocol.SendPacket(Packet_Types::BulletRequest, &mPacket);
-	}
-
 	std::vector<BulletCreationPacket> Client::GetBulletsToCreate()
 	{
 
@@ -11,20 +11,26 @@
 *******************************************************************************/
 #pragma once
 
-#include "protocol.hpp"
+#include "interpolation_buffer.hpp"
+#include "network_worker.hpp"
+#include "snapshot.hpp"
 
 #include <glm/glm.hpp>
+#include <deque>
 #include <string>
 #include <vector>
 #include <map>
 
 namespace CS260
 {
+	const unsigned maxPendingInputs = 128; // Inputs kept to replay on top of the states of our ship, about two seconds of frames
+
 	class Client
 	{
-		Protocol mProtocol;
+		NetworkWorker mNetwork;
 		unsigned char mID;
 		bool mConnected;
+		bool mDisconnected; // The server acknowledged our disconnection
 		bool mVerbose;
 		bool mClose;
 		unsigned mKeepAliveTimer;
@@ -40,30 +46,99 @@ namespace CS260
 		glm::vec4 mColor;
 		std::vector<BulletCreationPacket> mBulletsToCreate;
 		std::vector<ScorePacket> mScorePacketsToHandle;
+
+		// Snapshots of the asteroids, the server encodes each one against the newest we acknowledged
+		SnapshotHistory mSnapshots;
+		Snapshot mSnapshot;
+		unsigned short mNewestSnapshot;
+		bool mHasSnapshot;
+
+		// Our ship is moved by the server with our inputs, the ones it did not apply yet are replayed on top of its state
+		std::deque<InputCommand> mPendingInputs;
+		unsigned short mNextInput;
+		float mInputRemainder; // Milliseconds the durations of the commands were rounded by, carried to the next one
+		PlayerInfo mShipState;
+		bool mHasShipState;
+
+		ServerStatsPacket mServerStats;
+		bool mHasServerStats;
+
+		// The other ships are shown a bit in the past, between the states received around that time
+		std::map<unsigned char, InterpolationBuffer> mInterpolation;
+		clock_t::time_point mStartTime;
+		int64_t mServerTimeOffset; // From our clock to the one of the server, as measured by the fastest states
+		bool mHasServerTime;
 		
 	public:
 
 		/*	\fn Client
 		\brief	Client default constructor
+		\param threaded Whether the protocol runs in its own network thread or inline in Tick and Flush
 		*/
-		Client(const std::string& ip_address, uint16_t port, bool verbose);
+		Client(const std::string& ip_address, uint16_t port, bool verbose, bool threaded = true);
 
 		/*	\fn ~Client
 		\brief	Client destructor
 		*/
 		~Client();
 
+		/**
+		* @brief
+		* Sets how far in the past the next clients show the other ships, in milliseconds. It should cover a couple of
+		* ship states so there is usually a state after the time shown
+		*/
+		static void SetInterpolationDelay(unsigned milliseconds);
+
 		/**
 		* @brief
 		* Client update function to receive and handle packets
+		* @param ticks : ticks of tickRate this one stands for, more than one when catching up with missed ones
+		*/
+		void Tick(unsigned ticks = 1);
+
+		/**
+		* @brief
+		* Sends everything queued for the server during this tick, packed together
+		*/
+		void Flush();
+
+		/**
+		* @brief
+		* Queues the input of a simulation step for the server, which sends it until the server applies it to our ship
+		* @param input : InputBits pressed during the step
+		* @param dt : seconds the step lasts
+		* @return
+		* The command, simulate the step with its duration so the prediction matches the server
+		*/
+		InputCommand QueueInput(uint8_t input, float dt);
+
+		/**
+		* @brief
+		* Retrieve the inputs the server did not apply yet in the newest state of our ship, oldest first
+		*/
+		const std::deque<InputCommand>& GetPendingInputs();
+
+		/**
+		* @brief
+		* Retrieve the state of our ship if the server sent a newer one this frame
+		* @return
+		* Whether there was one
+		*/
+		bool GetShipState(PlayerInfo* state);
+
+		/**
+		* @brief
+		* Retrieve the stats of the server if it sent newer ones this frame
+		* @return
+		* Whether there were
 		*/
-		void Tick();
+		bool GetServerStats(ServerStatsPacket* stats);
 
 		/**
 		* @brief
-		* Send the player info of my client
+		* Retrieve the counters of our connection with the server, as of the last network tick
 		*/
-		void SendPlayerInfo(glm::vec2 pos, glm::vec2 vel, float rotation, bool input );
+		ConnectionStats GetNetworkStats();
 
 		/**
 		* @brief
@@ -77,6 +152,14 @@ namespace CS260
 		*/
 		std::vector<PlayerInfo> GetPlayersInfo();
 
+		/**
+		* @brief
+		* Retrieve the state of another player's ship at the time it is shown, interpolated between the states received
+		* @return
+		* False if none was received yet
+		*/
+		bool GetInterpolatedPlayer(unsigned char playerID, PlayerInfo* state);
+
 		/**
 		* @brief
 		* Retrieve whether is connected or not
@@ -95,6 +178,12 @@ namespace CS260
 		*/
 		void NotifyDisconnection();
 
+		/**
+		* @brief
+		* Retrieve whether the server acknowledged the disconnection we notified
+		*/
+		bool Disconnected();
+
 		/**
 		* @brief
 		* Retrieve my player ID
@@ -143,12 +232,6 @@ namespace CS260
 		*/
 		glm::vec4 GetColor();
 
-		/**
-		* @brief
-		* Ask the server to create a bullet for me
-		*/
-		void RequestBullet(unsigned mOwnerID, glm::vec2 vel, glm::vec2 pos , float dir);
-
 		/**
 		* @brief
 		* Retrieve the bullets that need to be created this frame
@@ -186,11 +269,35 @@ namespace CS260
 		*/
 		void HandleTimeOut();
 		
+		/**
+		* @brief
+		* Called by the protocol when a reliable message could not be delivered to the server
+		*/
+		void HandleDeliveryFailed(Packet_Types type);
+
 		/**
 		* @brief
 		* Handle each packet as its type 
 		*/
-		void HandleReceivedMessage(ProtocolPacket& packet, Packet_Types type);
+		void HandleReceivedMessage(ProtocolPacket& packet, unsigned size, Packet_Types type);
+
+		/**
+		* @brief
+		* Stores the received state of a ship at the given time of the server. Ours forgets the inputs it already includes
+		*/
+		void StorePlayerState(const PlayerInfo& info, uint32_t time);
+
+		/**
+		* @brief
+		* Updates the offset to the clock of the server with the time it sent something at
+		*/
+		void UpdateServerTime(uint32_t time);
+
+		/**
+		* @brief
+		* Time in the clock of the server the other ships are shown at
+		*/
+		uint32_t GetInterpolationTime();
 
 		/**
 		* @brief
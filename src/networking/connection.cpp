@@ -0,0 +1,152 @@
+#include "connection.hpp"
+
+#include <cstdlib>
+
+namespace CS260
+{
+	ConnectionStats& ConnectionStats::operator+=(const ConnectionStats& other)
+	{
+		mPacketsSent += other.mPacketsSent;
+		mPacketsReceived += other.mPacketsReceived;
+		mBytesSent += other.mBytesSent;
+		mBytesReceived += other.mBytesReceived;
+		mResends += other.mResends;
+		mDuplicates += other.mDuplicates;
+		mDeliveryFailures += other.mDeliveryFailures;
+		mDeferredMessages += other.mDeferredMessages;
+		mDroppedMessages += other.mDroppedMessages;
+		mSequencedReceived += other.mSequencedReceived;
+		mPacketsLost += other.mPacketsLost;
+		for (unsigned i = 0; i < STATS_MESSAGE_TYPES; i++) {
+			mMessages[i].mSent += other.mMessages[i].mSent;
+			mMessages[i].mReceived += other.mMessages[i].mReceived;
+			mMessages[i].mBytesSent += other.mMessages[i].mBytesSent;
+			mMessages[i].mBytesReceived += other.mMessages[i].mBytesReceived;
+		}
+
+		//the connections whose round trip time is still unknown do not count for the average
+		unsigned timed = mRtt > 0.0f ? mConnections : 0;
+		unsigned otherTimed = other.mRtt > 0.0f ? other.mConnections : 0;
+		if (timed + otherTimed)
+			mRtt = (mRtt * timed + other.mRtt * otherTimed) / (timed + otherTimed);
+		mUnacknowledged += other.mUnacknowledged;
+		mConnections += other.mConnections;
+		return *this;
+	}
+
+	float ConnectionStats::LossRate() const
+	{
+		unsigned long long expected = mSequencedReceived + mPacketsLost;
+		return expected ? static_cast<float>(mPacketsLost) / static_cast<float>(expected) : 0.0f;
+	}
+
+	Connection::Connection(const sockaddr* addr) :
+		mAckPending(false),
+		mAckAged(false),
+		mLastSendTime(now()),
+		mLastReceiveTime(mLastSendTime),
+		mByteAllowance(0),
+		mHasAddress(addr != nullptr),
+		mAddress{},
+		mSequenceNumber(static_cast<uint16_t>(rand())),
+		mRemoteSequence(0),
+		mRemoteAckBits(0),
+		mReceivedAny(false)
+	{
+		if (addr)
+			mAddress = *addr;
+	}
+
+	const sockaddr* Connection::GetAddress() const
+	{
+		return mHasAddress ? &mAddress : nullptr;
+	}
+
+	uint16_t Connection::NextSequence()
+	{
+		return mSequenceNumber++;
+	}
+
+	bool Connection::RecordReceived(uint16_t seq)
+	{
+		if (!mReceivedAny) {
+			mRemoteSequence = seq;
+			mRemoteAckBits = 0;
+			mReceivedAny = true;
+			mReceived.set(seq % DEDUP_WINDOW_SIZE);
+			mStats.mSequencedReceived++;
+			return false;
+		}
+
+		if (SequenceGreaterThan(seq, mRemoteSequence)) {
+			//newer packet, shift the bitfield so the previous newest one becomes bit 0
+			uint16_t shift = static_cast<uint16_t>(seq - mRemoteSequence);
+			mRemoteAckBits = shift > 32 ? 0 : ((shift == 32 ? 0 : mRemoteAckBits << shift) | (1u << (shift - 1)));
+
+			//the sequence numbers we skipped leave the window as not received
+			if (shift >= DEDUP_WINDOW_SIZE)
+				mReceived.reset();
+			else {
+				for (uint16_t skipped = static_cast<uint16_t>(mRemoteSequence + 1); skipped != seq; skipped++)
+					mReceived.reset(skipped % DEDUP_WINDOW_SIZE);
+			}
+
+			//counted as lost until they arrive late
+			mStats.mPacketsLost += shift - 1;
+
+			mRemoteSequence = seq;
+			mReceived.set(seq % DEDUP_WINDOW_SIZE);
+			mStats.mSequencedReceived++;
+			return false;
+		}
+
+		//older packet, we cannot know anymore whether it was received
+		uint16_t distance = static_cast<uint16_t>(mRemoteSequence - seq);
+		if (distance >= DEDUP_WINDOW_SIZE)
+			return true;
+
+		if (distance > 0 && distance <= 32)
+			mRemoteAckBits |= 1u << (distance - 1);
+
+		bool alreadyReceived = mReceived.test(seq % DEDUP_WINDOW_SIZE);
+		mReceived.set(seq % DEDUP_WINDOW_SIZE);
+		if (!alreadyReceived) {
+			//it was counted as lost when a newer one arrived
+			mStats.mSequencedReceived++;
+			if (mStats.mPacketsLost)
+				mStats.mPacketsLost--;
+		}
+		return alreadyReceived;
+	}
+
+	bool Connection::CanAcknowledge(uint16_t seq) const
+	{
+		if (!mReceivedAny || SequenceGreaterThan(seq, mRemoteSequence))
+			return false;
+		return static_cast<uint16_t>(mRemoteSequence - seq) <= 32;
+	}
+
+	uint16_t Connection::GetRemoteSequence() const
+	{
+		return mRemoteSequence;
+	}
+
+	uint32_t Connection::GetRemoteAckBits() const
+	{
+		return mRemoteAckBits;
+	}
+
+	bool Connection::HasReceived() const
+	{
+		return mReceivedAny;
+	}
+
+	ConnectionStats Connection::GetStats() const
+	{
+		ConnectionStats stats = mStats;
+		stats.mUnacknowledged = mUnacknowledgedMessages.Count();
+		stats.mRtt = mRtt.GetRtt();
+		stats.mConnections = 1;
+		return stats;
+	}
+}
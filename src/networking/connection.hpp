@@ -0,0 +1,205 @@
+#pragma once
+#include "networking.hpp"
+#include "retransmit_window.hpp"
+#include "rtt_estimator.hpp"
+#include "utils.hpp"
+
+#include <array>
+#include <bitset>
+#include <vector>
+
+namespace CS260 {
+
+	// Amount of sequence numbers, counting back from the newest one, a connection remembers having received.
+	// Anything older is considered a duplicate, must be a power of two
+	const unsigned DEDUP_WINDOW_SIZE = 1024;
+
+	// Amount of unreliable datagrams, counting back from the last one sent, whose send time is kept to measure the round trip time
+	const unsigned RTT_SAMPLE_WINDOW = 32;
+
+	/**
+	* @brief
+	* Whether sequence number a is newer than b, taking wrapping into account
+	*/
+	inline bool SequenceGreaterThan(uint16_t a, uint16_t b)
+	{
+		return ((a > b) && (a - b <= 32768)) || ((a < b) && (b - a > 32768));
+	}
+
+	//a message waiting for the next flush, the encoded bytes include its type and size prefix
+	struct QueuedMessage
+	{
+		unsigned mOffset;
+		unsigned mSize;
+		//the bytes are in the broadcast buffer instead of the connection one
+		bool mShared;
+	};
+
+	// Message types the stats are kept for, every Packet_Types is below it
+	const unsigned STATS_MESSAGE_TYPES = 32;
+
+	//counters of the messages of one type that went through a connection, the bytes include their type and size prefix
+	struct MessageStats
+	{
+		unsigned long long mSent = 0;
+		unsigned long long mReceived = 0;
+		unsigned long long mBytesSent = 0;
+		unsigned long long mBytesReceived = 0;
+	};
+
+	//counters of what went through a connection since it was created
+	struct ConnectionStats
+	{
+		unsigned long long mPacketsSent = 0;
+		unsigned long long mPacketsReceived = 0;
+		unsigned long long mBytesSent = 0;
+		unsigned long long mBytesReceived = 0;
+		//datagrams sent again because their acknowledgement did not arrive in time
+		unsigned long long mResends = 0;
+		//datagrams received more than once, or too old to tell
+		unsigned long long mDuplicates = 0;
+		//reliable datagrams we gave up on
+		unsigned long long mDeliveryFailures = 0;
+		//reliable messages that went over the byte budget of a flush and waited for the next one
+		unsigned long long mDeferredMessages = 0;
+		//unreliable messages that went over the byte budget of a flush, they would be stale by the next one
+		unsigned long long mDroppedMessages = 0;
+		//sequenced datagrams received from the peer, and those skipped in its sequence that never arrived late
+		unsigned long long mSequencedReceived = 0;
+		unsigned long long mPacketsLost = 0;
+		//messages sent and received of each Packet_Types
+		std::array<MessageStats, STATS_MESSAGE_TYPES> mMessages{};
+
+		//state of the connection when the stats were taken, not counters: the datagrams still waiting for an acknowledgement,
+		//the smoothed round trip time (0 if still unknown) and the connections they cover.
+		//Adding stats averages the round trip times of their connections
+		unsigned mUnacknowledged = 0;
+		float mRtt = 0.0f;
+		unsigned mConnections = 0;
+
+		/**
+		* @brief
+		* Fraction of the datagrams of the peer that were lost, from the gaps in their sequence numbers
+		*/
+		float LossRate() const;
+
+		/**
+		* @brief
+		* Adds the counters of another connection to these
+		*/
+		ConnectionStats& operator+=(const ConnectionStats& other);
+	};
+
+	// State the protocol keeps for each endpoint it talks with: its own sequence space,
+	// the window of sequence numbers already received, the messages waiting for an acknowledgement and the stats
+	class Connection {
+
+	public:
+		/**
+		* @brief
+		*  Constructs the connection with a random first sequence number
+		* @param addr : endpoint of the peer, null for the connected one
+		*/
+		Connection(const sockaddr* addr);
+
+		/**
+		* @brief
+		* Endpoint of the peer, null for the connected one
+		*/
+		const sockaddr* GetAddress() const;
+
+		/**
+		* @brief
+		* Returns the sequence number for the next datagram sent to the peer and advances it
+		*/
+		uint16_t NextSequence();
+
+		/**
+		* @brief
+		* Records a sequence number received from the peer, updating the acknowledgements we send back
+		* @return
+		* Whether it was already received, or is too old to tell
+		*/
+		bool RecordReceived(uint16_t seq);
+
+		/**
+		* @brief
+		* Whether the acknowledgement fields we send cover the given sequence number
+		*/
+		bool CanAcknowledge(uint16_t seq) const;
+
+		/**
+		* @brief
+		* Newest sequence number received from the peer
+		*/
+		uint16_t GetRemoteSequence() const;
+
+		/**
+		* @brief
+		* Bit i set means we also received GetRemoteSequence() - 1 - i
+		*/
+		uint32_t GetRemoteAckBits() const;
+
+		/**
+		* @brief
+		* Whether we received any sequenced datagram yet, otherwise there is nothing to acknowledge
+		*/
+		bool HasReceived() const;
+
+		/**
+		* @brief
+		* The counters of the connection along with its current state, see ConnectionStats
+		*/
+		ConnectionStats GetStats() const;
+
+		//we received a reliable packet and still have not told the peer
+		bool mAckPending;
+		//the acknowledgement has been pending for a whole tick, so send it alone
+		bool mAckAged;
+
+		clock_t::time_point mLastSendTime;
+		clock_t::time_point mLastReceiveTime;
+
+		//messages we have sent but have not been acknowledged, indexed by sequence number with only their actual bytes stored
+		RetransmitWindow mUnacknowledgedMessages;
+
+		//round trip time estimation, used for the resend timeouts
+		RttEstimator mRtt;
+
+		//when the last unreliable datagrams were sent, indexed by sequence number. The reliable ones are timed by their retransmit entry
+		struct SentTime
+		{
+			uint16_t mSeq;
+			bool mTimed;
+			clock_t::time_point mTime;
+		};
+		std::array<SentTime, RTT_SAMPLE_WINDOW> mUnreliableSendTimes{};
+
+		//messages queued since the last flush, in the order they were queued
+		std::vector<QueuedMessage> mReliableQueue;
+		std::vector<QueuedMessage> mUnreliableQueue;
+
+		//encoded messages that were only queued for this peer
+		std::vector<char> mQueuedBytes;
+
+		//bytes that can still be sent during this flush, negative if the last datagram went over the budget
+		long long mByteAllowance;
+
+		ConnectionStats mStats;
+
+	private:
+		bool mHasAddress;
+		sockaddr mAddress;
+
+		//sequence number for the next packet we send to this peer
+		uint16_t mSequenceNumber;
+
+		//newest sequence number received and the bitfield of the 32 previous ones, sent back on every packet
+		uint16_t mRemoteSequence;
+		uint32_t mRemoteAckBits;
+		bool mReceivedAny;
+
+		//bit seq % DEDUP_WINDOW_SIZE is set if seq was received, for the last DEDUP_WINDOW_SIZE sequence numbers
+		std::bitset<DEDUP_WINDOW_SIZE> mReceived;
+	};
+}
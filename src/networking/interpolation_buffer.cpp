@@ -0,0 +1,92 @@
+#include "interpolation_buffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace CS260
+{
+	namespace
+	{
+		/**
+		* @brief
+		* Goes from one angle to the other the shortest way around
+		*/
+		float LerpAngle(float from, float to, float t)
+		{
+			const float turn = 6.28318530718f;
+			return from + std::remainder(to - from, turn) * t;
+		}
+	}
+
+	void InterpolationBuffer::Store(uint32_t time, const PlayerInfo& state)
+	{
+		//usually the newest, so it goes at the end
+		auto position = mEntries.end();
+		while (position != mEntries.begin() && std::prev(position)->mTime > time)
+			--position;
+
+		//the same state again
+		if (position != mEntries.begin() && std::prev(position)->mTime == time)
+			return;
+
+		//older than everything we keep
+		if (position == mEntries.begin() && mEntries.size() == INTERPOLATION_BUFFER_SIZE)
+			return;
+
+		mEntries.insert(position, { time, state });
+		if (mEntries.size() > INTERPOLATION_BUFFER_SIZE)
+			mEntries.pop_front();
+	}
+
+	bool InterpolationBuffer::Sample(uint32_t time, PlayerInfo* state) const
+	{
+		if (mEntries.empty())
+			return false;
+
+		//before everything we have, the oldest is the best we know
+		if (time <= mEntries.front().mTime)
+		{
+			*state = mEntries.front().mState;
+			return true;
+		}
+
+		//past the newest one, keep it moving for a while
+		const Entry& newest = mEntries.back();
+		if (time >= newest.mTime)
+		{
+			float elapsed = static_cast<float>(std::min(time - newest.mTime, MAX_EXTRAPOLATION)) * 0.001f;
+			*state = newest.mState;
+			state->pos += newest.mState.vel * elapsed;
+			return true;
+		}
+
+		//the first state after the time, there is one before it
+		auto next = std::upper_bound(mEntries.begin(), mEntries.end(), time, [](uint32_t t, const Entry& entry) { return t < entry.mTime; });
+		const Entry& from = *std::prev(next);
+		const Entry& to = *next;
+
+		float duration = static_cast<float>(to.mTime - from.mTime) * 0.001f;
+		float t = static_cast<float>(time - from.mTime) * 0.001f / duration;
+
+		//the velocities do not take it there, it jumped. It keeps moving until the time of the jump
+		*state = from.mState;
+		glm::vec2 moved = (from.mState.vel + to.mState.vel) * 0.5f * duration;
+		glm::vec2 error = to.mState.pos - from.mState.pos - moved;
+		if (error.x * error.x + error.y * error.y > INTERPOLATION_SNAP_DISTANCE * INTERPOLATION_SNAP_DISTANCE)
+		{
+			state->pos += from.mState.vel * (t * duration);
+			return true;
+		}
+
+		state->pos = from.mState.pos + (to.mState.pos - from.mState.pos) * t;
+		state->vel = from.mState.vel + (to.mState.vel - from.mState.vel) * t;
+		state->rot = LerpAngle(from.mState.rot, to.mState.rot, t);
+		state->rotSpeed = from.mState.rotSpeed + (to.mState.rotSpeed - from.mState.rotSpeed) * t;
+		return true;
+	}
+
+	void InterpolationBuffer::Clear()
+	{
+		mEntries.clear();
+	}
+}
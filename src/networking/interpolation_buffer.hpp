@@ -0,0 +1,55 @@
+#pragma once
+#include "protocol.hpp"
+
+#include <cstdint>
+#include <deque>
+
+namespace CS260 {
+
+	// States kept per entity, enough for a second of states sent every tick
+	const unsigned INTERPOLATION_BUFFER_SIZE = 64;
+
+	// Longest an entity keeps moving with its last velocity when no newer state arrived, in milliseconds
+	const unsigned MAX_EXTRAPOLATION = 250;
+
+	// Distance between two states the velocities can not explain, the entity was moved to the other one instead (wrapping around the
+	// screen, respawning) so it jumps instead of crossing the screen
+	const float INTERPOLATION_SNAP_DISTANCE = 100.0f;
+
+	// Timestamped states of a remote entity. It is shown a bit in the past, between the two states received around that time,
+	// so late or lost states do not make it stutter
+	class InterpolationBuffer {
+
+	public:
+		/**
+		* @brief
+		* Keeps the state the entity had at the given time, in the clock of the server. States may arrive out of order
+		*/
+		void Store(uint32_t time, const PlayerInfo& state);
+
+		/**
+		* @brief
+		* State of the entity at the given time, interpolated between the states around it. Past the newest one it is
+		* extrapolated for up to MAX_EXTRAPOLATION and then kept
+		* @return
+		* False if there are no states yet
+		*/
+		bool Sample(uint32_t time, PlayerInfo* state) const;
+
+		/**
+		* @brief
+		* Forgets every state
+		*/
+		void Clear();
+
+	private:
+		struct Entry
+		{
+			uint32_t mTime;
+			PlayerInfo mState;
+		};
+
+		//sorted by time, the oldest first
+		std::deque<Entry> mEntries;
+	};
+}
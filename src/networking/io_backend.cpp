@@ -0,0 +1,72 @@
+#include "io_backend.hpp"
+#include "poll_io_backend.hpp"
+#include "mmsg_io_backend.hpp"
+#include "uring_io_backend.hpp"
+#include "simulated_io_backend.hpp"
+
+namespace CS260
+{
+	namespace
+	{
+		IoBackendType sPreferredType = IoBackendType::Batched;
+
+		NetworkConditions sConditions;
+		//backends created with the conditions, each one gets the next seed
+		uint32_t sSimulatedCount = 0;
+
+		//the backend doing the actual I/O
+		std::unique_ptr<IoBackend> CreateSocketBackend(SOCKET socket, IoBackendType type)
+		{
+			if (type == IoBackendType::Default)
+				type = sPreferredType;
+
+#if defined(__linux__) && defined(ASTEROIDS_IO_URING)
+			if (type == IoBackendType::Uring) {
+				auto backend = std::make_unique<UringIoBackend>(socket);
+				if (backend->IsValid())
+					return backend;
+				//the running kernel does not support it, use the next best one
+				type = IoBackendType::Batched;
+			}
+#endif
+#ifdef __linux__
+			if (type != IoBackendType::Poll)
+				return std::make_unique<MmsgIoBackend>(socket);
+#endif
+			return std::make_unique<PollIoBackend>(socket);
+		}
+	}
+
+	std::unique_ptr<IoBackend> IoBackend::Create(SOCKET socket, IoBackendType type)
+	{
+		std::unique_ptr<IoBackend> backend = CreateSocketBackend(socket, type);
+		if (!sConditions.IsActive())
+			return backend;
+
+		NetworkConditions conditions = sConditions;
+		conditions.mSeed += sSimulatedCount++;
+		return std::make_unique<SimulatedIoBackend>(std::move(backend), conditions);
+	}
+
+	void IoBackend::SetNetworkConditions(const NetworkConditions& conditions)
+	{
+		sConditions = conditions;
+	}
+
+	void IoBackend::SetPreferred(IoBackendType type)
+	{
+		if (type != IoBackendType::Default)
+			sPreferredType = type;
+	}
+
+	IoBackendType IoBackend::FromString(const std::string& name)
+	{
+		if (name == "poll")
+			return IoBackendType::Poll;
+		if (name == "batched")
+			return IoBackendType::Batched;
+		if (name == "uring")
+			return IoBackendType::Uring;
+		return IoBackendType::Default;
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "networking.hpp"
+
+#include <memory>
+
+namespace CS260 {
+
+	struct NetworkConditions;
+
+	//datagrams are kept under the usual path MTU so they never get fragmented
+	const unsigned MAX_DATAGRAM_SIZE = 1200;
+
+	enum class IoBackendType {
+		//whatever was chosen with IoBackend::SetPreferred
+		Default,
+		//one system call per datagram, available everywhere
+		Poll,
+		//recvmmsg/sendmmsg batches, Linux only
+		Batched,
+		//io_uring, Linux only and when built with liburing
+		Uring
+	};
+
+	class IoBackend {
+
+	public:
+		virtual ~IoBackend() = default;
+
+		/**
+		* @brief
+		* Sends a datagram, the backend may keep a copy of it until FlushSends is called
+		* @param data : serialized datagram
+		* @param size : size of the datagram
+		* @param addr : endpoint to send it to, if null, sends to the connected endpoint
+		*/
+		virtual void Send(const char* data, unsigned size, const sockaddr* addr) = 0;
+
+		/**
+		* @brief
+		* Sends every datagram still kept by Send
+		*/
+		virtual void FlushSends() = 0;
+
+		/**
+		* @brief
+		* Receives the next datagram without blocking
+		* @param data : out parameter pointing to the bytes of the datagram, valid until the next call
+		* @param size : out parameter for the size of the datagram
+		* @param addr : optional out parameter for the sender, if null, the socket is expected to be connected
+		* @return
+		* False if there is nothing to receive
+		*/
+		virtual bool Receive(const char** data, unsigned* size, sockaddr* addr) = 0;
+
+		/**
+		* @brief
+		* Waits until there is something to receive, Wake is called or the timeout expires
+		* @return
+		* Whether there is something to receive
+		*/
+		virtual bool Wait(unsigned timeoutMs) = 0;
+
+		/**
+		* @brief
+		* Makes the current or the next Wait return early. The only call that can be made from another thread
+		*/
+		virtual void Wake() = 0;
+
+		/**
+		* @brief
+		* Which kind of backend this is
+		*/
+		virtual IoBackendType GetType() const = 0;
+
+		/**
+		* @brief
+		* Creates a backend for the given non blocking socket. If the type is not available
+		* on this platform or build, the best one that is available is used instead
+		*/
+		static std::unique_ptr<IoBackend> Create(SOCKET socket, IoBackendType type = IoBackendType::Default);
+
+		/**
+		* @brief
+		* Chooses the backend created by default, batched by default
+		*/
+		static void SetPreferred(IoBackendType type);
+
+		/**
+		* @brief
+		* Parses the name of a backend (poll, batched, uring), returns Default if it is unknown
+		*/
+		static IoBackendType FromString(const std::string& name);
+
+		/**
+		* @brief
+		* Makes the backends created from now on pretend to be behind the given network, for testing.
+		* Each one gets its own seed, following the one of the conditions
+		*/
+		static void SetNetworkConditions(const NetworkConditions& conditions);
+	};
+}
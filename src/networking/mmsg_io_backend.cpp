@@ -0,0 +1,146 @@
+#ifdef __linux__
+#include "mmsg_io_backend.hpp"
+
+#include <sys/epoll.h>
+#include <cstring>
+
+namespace CS260
+{
+	MmsgIoBackend::MmsgIoBackend(SOCKET socket) :
+		mSocket(socket),
+		mEpoll(epoll_create1(0)),
+		mWakeup(CreateWakeup()),
+		mReceiveSlots(MMSG_BATCH_SIZE * MAX_DATAGRAM_SIZE),
+		mReceiveHeaders{},
+		mReceiveVectors{},
+		mReceiveAddresses{},
+		mReceiveCount(0),
+		mReceiveNext(0),
+		mSendSlots(MMSG_BATCH_SIZE * MAX_DATAGRAM_SIZE),
+		mSendHeaders{},
+		mSendVectors{},
+		mSendAddresses{},
+		mSendCount(0)
+	{
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.fd = mSocket;
+		epoll_ctl(mEpoll, EPOLL_CTL_ADD, mSocket, &event);
+		event.data.fd = mWakeup;
+		epoll_ctl(mEpoll, EPOLL_CTL_ADD, mWakeup, &event);
+
+		//the slots never move, so the vectors only have to point to them once
+		for (unsigned i = 0; i < MMSG_BATCH_SIZE; i++) {
+			mReceiveVectors[i].iov_base = mReceiveSlots.data() + i * MAX_DATAGRAM_SIZE;
+			mReceiveVectors[i].iov_len = MAX_DATAGRAM_SIZE;
+			mSendVectors[i].iov_base = mSendSlots.data() + i * MAX_DATAGRAM_SIZE;
+		}
+	}
+
+	MmsgIoBackend::~MmsgIoBackend()
+	{
+		FlushSends();
+		::close(mEpoll);
+		DestroyWakeup(mWakeup);
+	}
+
+	void MmsgIoBackend::Send(const char* data, unsigned size, const sockaddr* addr)
+	{
+		//not one of our datagrams, it does not fit in a slot
+		if (size > MAX_DATAGRAM_SIZE) {
+			if (addr)
+				sendto(mSocket, data, size, 0, addr, sizeof(sockaddr));
+			else
+				send(mSocket, data, size, 0);
+			return;
+		}
+
+		if (mSendCount == MMSG_BATCH_SIZE)
+			FlushSends();
+
+		unsigned slot = mSendCount++;
+		memcpy(mSendVectors[slot].iov_base, data, size);
+		mSendVectors[slot].iov_len = size;
+
+		msghdr& header = mSendHeaders[slot].msg_hdr;
+		header = msghdr{};
+		header.msg_iov = &mSendVectors[slot];
+		header.msg_iovlen = 1;
+		//without an address it goes to the connected endpoint
+		if (addr) {
+			mSendAddresses[slot] = *addr;
+			header.msg_name = &mSendAddresses[slot];
+			header.msg_namelen = sizeof(sockaddr);
+		}
+	}
+
+	void MmsgIoBackend::FlushSends()
+	{
+		unsigned sent = 0;
+		while (sent < mSendCount) {
+			int result = sendmmsg(mSocket, mSendHeaders.data() + sent, mSendCount - sent, 0);
+			if (result == SOCKET_ERROR) {
+				//the datagram the kernel refused is dropped, as a single sendto would have done
+				if (errno != EINTR)
+					sent++;
+				continue;
+			}
+			sent += static_cast<unsigned>(result);
+		}
+		mSendCount = 0;
+	}
+
+	bool MmsgIoBackend::Receive(const char** data, unsigned* size, sockaddr* addr)
+	{
+		//the last batch was consumed, drain the socket again
+		if (mReceiveNext == mReceiveCount) {
+			for (unsigned i = 0; i < MMSG_BATCH_SIZE; i++) {
+				msghdr& header = mReceiveHeaders[i].msg_hdr;
+				header = msghdr{};
+				header.msg_iov = &mReceiveVectors[i];
+				header.msg_iovlen = 1;
+				header.msg_name = &mReceiveAddresses[i];
+				header.msg_namelen = sizeof(sockaddr);
+			}
+
+			int received = recvmmsg(mSocket, mReceiveHeaders.data(), MMSG_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+			mReceiveNext = 0;
+			mReceiveCount = received == SOCKET_ERROR ? 0 : static_cast<unsigned>(received);
+			if (mReceiveCount == 0)
+				return false;
+		}
+
+		unsigned slot = mReceiveNext++;
+		*data = static_cast<const char*>(mReceiveVectors[slot].iov_base);
+		//anything bigger than a slot is not ours, let the protocol discard it as too small
+		*size = (mReceiveHeaders[slot].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : mReceiveHeaders[slot].msg_len;
+		if (addr)
+			*addr = mReceiveAddresses[slot];
+		return true;
+	}
+
+	bool MmsgIoBackend::Wait(unsigned timeoutMs)
+	{
+		//still datagrams from the last batch
+		if (mReceiveNext != mReceiveCount)
+			return true;
+
+		epoll_event events[2];
+		int ready = epoll_wait(mEpoll, events, 2, (int)timeoutMs);
+
+		bool activity = false;
+		for (int i = 0; i < ready; i++) {
+			if (events[i].data.fd == mWakeup)
+				ClearWakeup(mWakeup);
+			else
+				activity = true;
+		}
+		return activity;
+	}
+
+	void MmsgIoBackend::Wake()
+	{
+		SignalWakeup(mWakeup);
+	}
+}
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+#ifdef __linux__
+#include "io_backend.hpp"
+
+#include <array>
+#include <vector>
+
+namespace CS260 {
+
+	// Amount of datagrams moved by a single recvmmsg/sendmmsg call
+	const unsigned MMSG_BATCH_SIZE = 64;
+
+	// Linux backend, drains the socket and sends the queued datagrams in batches to save system calls
+	class MmsgIoBackend : public IoBackend {
+
+	public:
+		/**
+		* @brief
+		*  Constructs the backend for an already created socket, which it does not own, its epoll instance and wakeup
+		*/
+		MmsgIoBackend(SOCKET socket);
+
+		/**
+		* @brief
+		*  Sends what is left and closes the epoll instance and the wakeup
+		*/
+		~MmsgIoBackend() override;
+
+		/**
+		* @brief
+		* Copies the datagram into the next send slot, sending the whole batch when it is full
+		*/
+		void Send(const char* data, unsigned size, const sockaddr* addr) override;
+
+		/**
+		* @brief
+		* Sends every queued datagram with as few sendmmsg calls as possible
+		*/
+		void FlushSends() override;
+
+		/**
+		* @brief
+		* Returns the next datagram of the last batch, reading a new batch with recvmmsg when it is consumed
+		*/
+		bool Receive(const char** data, unsigned* size, sockaddr* addr) override;
+
+		/**
+		* @brief
+		* Waits on the epoll instance, which has the socket and the wakeup
+		*/
+		bool Wait(unsigned timeoutMs) override;
+		/**
+		* @brief
+		* Signals the wakeup
+		*/
+		void Wake() override;
+
+		IoBackendType GetType() const override { return IoBackendType::Batched; }
+
+	private:
+		SOCKET mSocket;
+		int mEpoll;
+		SOCKET mWakeup;
+
+		//datagrams received by the last recvmmsg, returned one by one
+		std::vector<char> mReceiveSlots;
+		std::array<mmsghdr, MMSG_BATCH_SIZE> mReceiveHeaders;
+		std::array<iovec, MMSG_BATCH_SIZE> mReceiveVectors;
+		std::array<sockaddr, MMSG_BATCH_SIZE> mReceiveAddresses;
+		unsigned mReceiveCount;
+		unsigned mReceiveNext;
+
+		//datagrams waiting for the next sendmmsg
+		std::vector<char> mSendSlots;
+		std::array<mmsghdr, MMSG_BATCH_SIZE> mSendHeaders;
+		std::array<iovec, MMSG_BATCH_SIZE> mSendVectors;
+		std::array<sockaddr, MMSG_BATCH_SIZE> mSendAddresses;
+		unsigned mSendCount;
+	};
+}
+#endif
@@ -0,0 +1,293 @@
+#include "network_worker.hpp"
+
+#include "tick_scheduler.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace CS260
+{
+	NetworkWorker::NetworkWorker() :
+		mConnected(false),
+		mThreaded(false),
+		mRunning(false),
+		mWaiting(false)
+	{
+	}
+
+	NetworkWorker::~NetworkWorker()
+	{
+		Stop();
+	}
+
+	void NetworkWorker::Start(SOCKET socket, bool threaded)
+	{
+		mProtocol.SetSocket(socket);
+
+		//only connected sockets have a peer name
+		sockaddr peer;
+		socklen_t peerSize = sizeof(peer);
+		mConnected = getpeername(socket, &peer, &peerSize) == 0;
+
+		mThreaded = threaded;
+		if (!mThreaded) {
+			mProtocol.SetDeliveryFailedCallback([this](const sockaddr* addr, Packet_Types type) {
+				if (mDeliveryFailedCallback)
+					mDeliveryFailedCallback(addr, type);
+			});
+			return;
+		}
+
+		mOutgoing = std::make_unique<SpscQueue<OutgoingMessage, NETWORK_QUEUE_SIZE>>();
+		mIncoming = std::make_unique<SpscQueue<IncomingMessage, NETWORK_QUEUE_SIZE>>();
+
+		//the failure happens in the network thread, so it is handed to the game thread like a message.
+		//It is only kept here, the queue may be full and the network thread must never wait for the game
+		mProtocol.SetDeliveryFailedCallback([this](const sockaddr* addr, Packet_Types type) {
+			DeliveryFailure failure{ type, addr != nullptr, addr ? *addr : sockaddr{} };
+			mDeliveryFailures.push_back(failure);
+		});
+
+		mRunning.store(true, std::memory_order_release);
+		mThread = std::thread(&NetworkWorker::Run, this);
+	}
+
+	void NetworkWorker::Stop()
+	{
+		if (!mThread.joinable())
+			return;
+
+		mRunning.store(false, std::memory_order_release);
+		mProtocol.Wake();
+		mThread.join();
+	}
+
+	void NetworkWorker::Tick()
+	{
+		if (!mThreaded)
+			mProtocol.Tick();
+	}
+
+	void NetworkWorker::SendPacket(Packet_Types type, const void* packet, const sockaddr* addr)
+	{
+		SendPacket(type, packet, Protocol::GetTypeSize(type), addr);
+	}
+
+	void NetworkWorker::SendPacket(Packet_Types type, const void* packet, unsigned size, const sockaddr* addr)
+	{
+		if (!mThreaded) {
+			mProtocol.SendPacket(type, packet, size, addr);
+			return;
+		}
+
+		OutgoingMessage& message = BeginOutgoing(OutgoingMessage::Send, addr);
+		message.mType = type;
+		message.mSize = std::min(size, Protocol::GetTypeSize(type));
+		memcpy(message.mPayload.data(), packet, message.mSize);
+		EndOutgoing();
+	}
+
+	void NetworkWorker::Broadcast(Packet_Types type, const void* packet, std::shared_ptr<const std::vector<sockaddr>> endpoints)
+	{
+		Broadcast(type, packet, Protocol::GetTypeSize(type), std::move(endpoints));
+	}
+
+	void NetworkWorker::Broadcast(Packet_Types type, const void* packet, unsigned size, std::shared_ptr<const std::vector<sockaddr>> endpoints)
+	{
+		if (!mThreaded) {
+			mProtocol.Broadcast(type, packet, size, *endpoints);
+			return;
+		}
+
+		OutgoingMessage& message = BeginOutgoing(OutgoingMessage::Broadcast, nullptr);
+		message.mType = type;
+		message.mSize = std::min(size, Protocol::GetTypeSize(type));
+		message.mEndpoints = std::move(endpoints);
+		memcpy(message.mPayload.data(), packet, message.mSize);
+		EndOutgoing();
+	}
+
+	void NetworkWorker::Flush()
+	{
+		if (!mThreaded) {
+			mProtocol.Flush();
+			return;
+		}
+
+		BeginOutgoing(OutgoingMessage::Flush, nullptr);
+		EndOutgoing();
+	}
+
+	bool NetworkWorker::ReceivePacket(void* _payload, unsigned* _size, Packet_Types* _type, sockaddr* _addr)
+	{
+		if (!mThreaded)
+			return mProtocol.ReceivePacket(_payload, _size, _type, _addr);
+
+		while (IncomingMessage* message = mIncoming->Front()) {
+			if (message->mDeliveryFailed) {
+				if (mDeliveryFailedCallback)
+					mDeliveryFailedCallback(message->mHasAddress ? &message->mAddress : nullptr, message->mType);
+				mIncoming->Pop();
+				continue;
+			}
+
+			*_type = message->mType;
+			*_size = message->mSize;
+			memcpy(_payload, message->mPayload.data(), message->mSize);
+			if (_addr)
+				*_addr = message->mAddress;
+
+			mIncoming->Pop();
+			return true;
+		}
+		return false;
+	}
+
+	void NetworkWorker::RemovePeer(const sockaddr* addr)
+	{
+		if (!mThreaded) {
+			mProtocol.RemovePeer(addr);
+			return;
+		}
+
+		BeginOutgoing(OutgoingMessage::RemovePeer, addr);
+		EndOutgoing();
+	}
+
+	void NetworkWorker::SetDeliveryFailedCallback(std::function<void(const sockaddr*, Packet_Types)> callback)
+	{
+		mDeliveryFailedCallback = std::move(callback);
+	}
+
+	void NetworkWorker::SetByteBudget(unsigned bytesPerFlush)
+	{
+		mProtocol.SetByteBudget(bytesPerFlush);
+	}
+
+	void NetworkWorker::SetHandshakeRequired(bool required)
+	{
+		mProtocol.SetHandshakeRequired(required);
+	}
+
+	ConnectionStats NetworkWorker::GetTotalStats()
+	{
+		if (!mThreaded)
+			return mProtocol.GetTotalStats();
+
+		std::lock_guard<std::mutex> lock(mStatsMutex);
+		return mTotalStats;
+	}
+
+	void NetworkWorker::Run()
+	{
+		TickScheduler ticks(tickRate);
+
+		while (mRunning.load(std::memory_order_acquire)) {
+			//until a datagram arrives, the game sends something or the next tick. The queue is looked at
+			//after saying we wait, so a message pushed in between either is seen or wakes us
+			mWaiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!mOutgoing->Front())
+				mProtocol.Wait(ticks.GetMsUntilNextTick());
+			mWaiting.store(false, std::memory_order_relaxed);
+
+			ProcessOutgoing();
+			ReceiveIncoming();
+
+			//resends and lone acknowledgements do not wait for the game, once per tick is enough even if some were missed
+			if (ticks.ConsumeTicks() > 0) {
+				mProtocol.Tick();
+				mProtocol.SendAcknowledgements();
+
+				ConnectionStats stats = mProtocol.GetTotalStats();
+				std::lock_guard<std::mutex> lock(mStatsMutex);
+				mTotalStats = stats;
+			}
+		}
+
+		//the last messages of the game, usually telling the other side we are leaving
+		ProcessOutgoing();
+		mProtocol.Flush();
+	}
+
+	void NetworkWorker::ProcessOutgoing()
+	{
+		while (OutgoingMessage* message = mOutgoing->Front()) {
+			const sockaddr* addr = message->mHasAddress ? &message->mAddress : nullptr;
+
+			switch (message->mKind)
+			{
+			case OutgoingMessage::Send:
+				mProtocol.SendPacket(message->mType, message->mPayload.data(), message->mSize, addr);
+				break;
+			case OutgoingMessage::Broadcast:
+				mProtocol.Broadcast(message->mType, message->mPayload.data(), message->mSize, *message->mEndpoints);
+				//release our reference to the list now, not when the slot is reused
+				message->mEndpoints.reset();
+				break;
+			case OutgoingMessage::Flush:
+				mProtocol.Flush();
+				break;
+			case OutgoingMessage::RemovePeer:
+				mProtocol.RemovePeer(addr);
+				break;
+			}
+
+			mOutgoing->Pop();
+		}
+	}
+
+	void NetworkWorker::ReceiveIncoming()
+	{
+		//the failures the queue had no room for first, the rest wait for the next loop
+		unsigned pushed = 0;
+		for (; pushed < mDeliveryFailures.size(); pushed++) {
+			IncomingMessage* message = mIncoming->BeginPush();
+			if (!message)
+				break;
+
+			const DeliveryFailure& failure = mDeliveryFailures[pushed];
+			message->mType = failure.mType;
+			message->mSize = 0;
+			message->mHasAddress = failure.mHasAddress;
+			message->mAddress = failure.mAddress;
+			message->mDeliveryFailed = true;
+			mIncoming->EndPush();
+		}
+		mDeliveryFailures.erase(mDeliveryFailures.begin(), mDeliveryFailures.begin() + pushed);
+
+		while (IncomingMessage* message = mIncoming->BeginPush()) {
+			if (!mProtocol.ReceivePacket(message->mPayload.data(), &message->mSize, &message->mType, mConnected ? nullptr : &message->mAddress))
+				return;
+
+			message->mHasAddress = !mConnected;
+			message->mDeliveryFailed = false;
+			mIncoming->EndPush();
+		}
+	}
+
+	NetworkWorker::OutgoingMessage& NetworkWorker::BeginOutgoing(OutgoingMessage::Kind kind, const sockaddr* addr)
+	{
+		OutgoingMessage* message;
+		//the network thread is always draining the queue, so it is never full for long
+		while (!(message = mOutgoing->BeginPush()))
+			std::this_thread::yield();
+
+		message->mKind = kind;
+		message->mHasAddress = addr != nullptr;
+		if (addr)
+			message->mAddress = *addr;
+		return *message;
+	}
+
+	void NetworkWorker::EndOutgoing()
+	{
+		mOutgoing->EndPush();
+
+		//pairs with the fence of Run, one of us sees what the other did
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (mWaiting.exchange(false, std::memory_order_relaxed))
+			mProtocol.Wake();
+	}
+}
@@ -0,0 +1,218 @@
+#pragma once
+#include "protocol.hpp"
+#include "spsc_queue.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace CS260 {
+
+	// Messages that can be waiting in each direction between the game and the network thread
+	const unsigned NETWORK_QUEUE_SIZE = 1024;
+
+	// Owns the protocol and, when threaded, a network thread doing the socket I/O, acknowledgements and resends.
+	// The game thread exchanges decoded messages with it through lock-free queues, so frame time does not delay them
+	class NetworkWorker {
+
+	public:
+		/**
+		* @brief
+		*  Constructs the worker, nothing runs until Start
+		*/
+		NetworkWorker();
+
+		/**
+		* @brief
+		*  Stops the network thread
+		*/
+		~NetworkWorker();
+
+		/**
+		* @brief
+		* Starts working with a non blocking socket
+		* @param threaded : whether to run the protocol in its own thread or inline in the calls below
+		*/
+		void Start(SOCKET socket, bool threaded = true);
+
+		/**
+		* @brief
+		* Sends the last messages and joins the network thread, call it before closing the socket
+		*/
+		void Stop();
+
+		/**
+		* @brief
+		* Resends unacknowledged messages, the network thread already does it on its own
+		*/
+		void Tick();
+
+		/**
+		* @brief
+		* Queues a packet for an endpoint, see Protocol::SendPacket
+		*/
+		void SendPacket(Packet_Types type, const void* packet, const sockaddr* addr = nullptr);
+
+		/**
+		* @brief
+		* Queues a packet of variable size for an endpoint, see Protocol::SendPacket
+		*/
+		void SendPacket(Packet_Types type, const void* packet, unsigned size, const sockaddr* addr = nullptr);
+
+		/**
+		* @brief
+		* Queues a packet for several endpoints, see Protocol::Broadcast.
+		* The list is shared with the network thread, so it must not be modified afterwards
+		*/
+		void Broadcast(Packet_Types type, const void* packet, std::shared_ptr<const std::vector<sockaddr>> endpoints);
+
+		/**
+		* @brief
+		* Queues a packet of variable size for several endpoints, see Protocol::Broadcast
+		*/
+		void Broadcast(Packet_Types type, const void* packet, unsigned size, std::shared_ptr<const std::vector<sockaddr>> endpoints);
+
+		/**
+		* @brief
+		* Sends everything queued so far, see Protocol::Flush
+		*/
+		void Flush();
+
+		/**
+		* @brief
+		* Returns the next received message, see Protocol::ReceivePacket.
+		* Reports the messages that could not be delivered through the callback too
+		*/
+		bool ReceivePacket(void* _payload, unsigned* _size, Packet_Types* _type, sockaddr* _addr = nullptr);
+
+		/**
+		* @brief
+		* Forgets an endpoint, see Protocol::RemovePeer
+		*/
+		void RemovePeer(const sockaddr* addr = nullptr);
+
+		/**
+		* @brief
+		* Sets the function called, always from the game thread, when a reliable message could not be delivered
+		*/
+		void SetDeliveryFailedCallback(std::function<void(const sockaddr*, Packet_Types)> callback);
+
+		/**
+		* @brief
+		* Limits the bytes sent to each endpoint per flush, see Protocol::SetByteBudget. Call it before Start
+		*/
+		void SetByteBudget(unsigned bytesPerFlush);
+
+		/**
+		* @brief
+		* Ignores new endpoints that do not start with a SYN, see Protocol::SetHandshakeRequired. Call it before Start
+		*/
+		void SetHandshakeRequired(bool required);
+
+		/**
+		* @brief
+		* Counters of every connection of the protocol, see Protocol::GetTotalStats.
+		* When threaded they are the ones of the last tick of the network thread
+		*/
+		ConnectionStats GetTotalStats();
+
+	private:
+		//from the game thread to the network thread
+		struct OutgoingMessage
+		{
+			enum Kind
+			{
+				Send,
+				Broadcast,
+				Flush,
+				RemovePeer
+			};
+
+			Kind mKind;
+			Packet_Types mType;
+			unsigned mSize;
+			bool mHasAddress;
+			sockaddr mAddress;
+			std::shared_ptr<const std::vector<sockaddr>> mEndpoints;
+			std::array<char, MAX_MESSAGE_SIZE> mPayload;
+		};
+
+		//from the network thread to the game thread
+		struct IncomingMessage
+		{
+			Packet_Types mType;
+			unsigned mSize;
+			bool mHasAddress;
+			sockaddr mAddress;
+			//not a received message, a reliable one of this type could not be delivered
+			bool mDeliveryFailed;
+			std::array<char, MAX_MESSAGE_SIZE> mPayload;
+		};
+
+		//a reliable message the protocol gave up on, waiting for room in the incoming queue
+		struct DeliveryFailure
+		{
+			Packet_Types mType;
+			bool mHasAddress;
+			sockaddr mAddress;
+		};
+
+		/**
+		* @brief
+		* Body of the network thread
+		*/
+		void Run();
+
+		/**
+		* @brief
+		* Network thread. Hands the messages of the game to the protocol
+		*/
+		void ProcessOutgoing();
+
+		/**
+		* @brief
+		* Network thread. Hands the delivery failures to the game, then receives and decodes everything available,
+		* as long as there is room for it
+		*/
+		void ReceiveIncoming();
+
+		/**
+		* @brief
+		* Game thread. Waits for a free slot in the outgoing queue
+		*/
+		OutgoingMessage& BeginOutgoing(OutgoingMessage::Kind kind, const sockaddr* addr);
+
+		/**
+		* @brief
+		* Game thread. Hands the message to the network thread, waking it if it is waiting
+		*/
+		void EndOutgoing();
+
+		Protocol mProtocol;
+
+		//the socket is connected, so the messages have no address
+		bool mConnected;
+
+		bool mThreaded;
+		std::atomic<bool> mRunning;
+		std::thread mThread;
+
+		//the network thread is about to wait or waiting, so the next message has to wake it
+		std::atomic<bool> mWaiting;
+
+		//the queues are big, so they only exist when threaded
+		std::unique_ptr<SpscQueue<OutgoingMessage, NETWORK_QUEUE_SIZE>> mOutgoing;
+		std::unique_ptr<SpscQueue<IncomingMessage, NETWORK_QUEUE_SIZE>> mIncoming;
+
+		std::function<void(const sockaddr*, Packet_Types)> mDeliveryFailedCallback;
+
+		//only touched by the network thread, see DeliveryFailure
+		std::vector<DeliveryFailure> mDeliveryFailures;
+
+		//copied by the network thread every tick, as the protocol is not ours to read
+		std::mutex mStatsMutex;
+		ConnectionStats mTotalStats;
+	};
+}
@@ -34,6 +34,56 @@ namespace CS260
         int errorCode = ioctlsocket(fd, FIONBIO, &mode);      
         if(errorCode == SOCKET_ERROR)
             throw std::runtime_error("Error setting blocking socket: " + std::to_string(WSAGetLastError()));
+    }
+
+    /**
+     * @brief
+     *  Winsock has no equivalent of SO_REUSEPORT
+     */
+    bool SetSocketReusePort(SOCKET)
+    {
+        return false;
+    }
+
+    /**
+     * @brief
+     *  Winsock can only poll sockets, so the wakeup is a loopback socket sending to itself
+     */
+    SOCKET CreateWakeup()
+    {
+        SOCKET wakeup = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (wakeup == INVALID_SOCKET)
+            throw std::runtime_error("Error creating wakeup socket: " + std::to_string(WSAGetLastError()));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int size = sizeof(addr);
+        if (bind(wakeup, reinterpret_cast<sockaddr*>(&addr), size) == SOCKET_ERROR
+            || getsockname(wakeup, reinterpret_cast<sockaddr*>(&addr), &size) == SOCKET_ERROR
+            || connect(wakeup, reinterpret_cast<sockaddr*>(&addr), size) == SOCKET_ERROR)
+            throw std::runtime_error("Error binding wakeup socket: " + std::to_string(WSAGetLastError()));
+
+        SetSocketBlocking(wakeup, false);
+        return wakeup;
+    }
+
+    void SignalWakeup(SOCKET wakeup)
+    {
+        char signal = 0;
+        send(wakeup, &signal, 1, 0);
+    }
+
+    void ClearWakeup(SOCKET wakeup)
+    {
+        char signals[64];
+        while (recv(wakeup, signals, sizeof(signals), 0) > 0)
+            ;
+    }
+
+    void DestroyWakeup(SOCKET wakeup)
+    {
+        closesocket(wakeup);
     }
 
 
@@ -76,7 +126,81 @@ namespace CS260
         }
     }
 
+    /**
+     * @brief
+     *  Lets several sockets bind the same port, the kernel hashes each sender to one of them
+     * @param fd
+     */
+    bool SetSocketReusePort(SOCKET fd)
+    {
+#ifdef SO_REUSEPORT
+        int enable = 1;
+        return setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == 0;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * @brief
+     *  The wakeup is an eventfd, a single counter the kernel can poll
+     */
+    SOCKET CreateWakeup()
+    {
+        SOCKET wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeup == SOCKET_ERROR)
+            throw std::runtime_error("Error creating wakeup: " + std::to_string(WSAGetLastError()));
+        return wakeup;
+    }
+
+    void SignalWakeup(SOCKET wakeup)
+    {
+        uint64_t signal = 1;
+        ssize_t written = write(wakeup, &signal, sizeof(signal));
+        (void)written; // Only fails when the counter is full, it is signaled anyway
+    }
+
+    void ClearWakeup(SOCKET wakeup)
+    {
+        // Reading resets the counter
+        uint64_t signals;
+        ssize_t consumed = read(wakeup, &signals, sizeof(signals));
+        (void)consumed;
+    }
+
+    void DestroyWakeup(SOCKET wakeup)
+    {
+        ::close(wakeup);
+    }
+
 #endif
+
+    bool WaitForActivity(SOCKET fd, unsigned timeoutMs)
+    {
+        WSAPOLLFD poll;
+        poll.fd = fd;
+        poll.events = POLLIN;
+        poll.revents = 0;
+        return WSAPoll(&poll, 1, static_cast<int>(timeoutMs)) > 0;
+    }
+
+    bool WaitForActivity(SOCKET fd, SOCKET wakeup, unsigned timeoutMs)
+    {
+        WSAPOLLFD polls[2];
+        polls[0].fd = fd;
+        polls[1].fd = wakeup;
+        for (WSAPOLLFD& poll : polls) {
+            poll.events = POLLIN;
+            poll.revents = 0;
+        }
+
+        if (WSAPoll(polls, 2, static_cast<int>(timeoutMs)) <= 0)
+            return false;
+
+        if (polls[1].revents)
+            ClearWakeup(wakeup);
+        return polls[0].revents != 0;
+    }
 
     in_addr ToIpv4(std::string const& addr)
     {
@@ -96,6 +220,17 @@ namespace CS260
 
         return result;
     }
+
+    uint64_t EndpointKey(const sockaddr* addr)
+    {
+        if (!addr)
+            return 0;
+
+        // A sockaddr may not be aligned like a sockaddr_in, so copy it instead of casting it
+        sockaddr_in addrIn;
+        memcpy(&addrIn, addr, sizeof(addrIn));
+        return (static_cast<uint64_t>(addrIn.sin_addr.s_addr) << 16) | addrIn.sin_port;
+    }
    
 
 }
\ No newline at end of file
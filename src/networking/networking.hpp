@@ -3,6 +3,7 @@
 
 #include <string>
 #include <iostream>
+#include <cstdint>
 
 #ifdef __linux__
 #include <sys/socket.h> // sockets
@@ -13,6 +14,7 @@
 #include <errno.h>      // Errors
 #include <unistd.h>     // close()
 #include <fcntl.h>      // Non-Blocking sockets
+#include <sys/eventfd.h> // Wakeups
 // Porting from windows code
 #define WSAGetLastError() errno                          // In windows, errors are stored in WSAGetLastError, most errors are similar
 #define WSAPoll(fds, c, timeout) ::poll(fds, c, timeout) // In windows, there is native poll. ALMOST similar.
@@ -59,12 +61,50 @@ namespace CS260
      */
     void SetSocketReuseAddress(SOCKET fd, bool reuse);
 
+    /**
+     * @brief
+     *  Lets several sockets bind the same port, the kernel spreads the senders among them.
+     *  Returns false if the platform does not support it
+     */
+    bool SetSocketReusePort(SOCKET fd);
+
     /**
      * @brief
      *  Waits for a socket to have activity
      */
     bool WaitForActivity(SOCKET fd, unsigned timeoutMs);
 
+    /**
+     * @brief
+     *  Waits for a socket to have activity or for the wakeup to be signaled, which is cleared.
+     *  Returns whether the socket has activity
+     */
+    bool WaitForActivity(SOCKET fd, SOCKET wakeup, unsigned timeoutMs);
+
+    /**
+     * @brief
+     *  Creates a handle that can be waited on with a socket and signaled from another thread
+     */
+    SOCKET CreateWakeup();
+
+    /**
+     * @brief
+     *  Makes the waits on the wakeup return until it is cleared
+     */
+    void SignalWakeup(SOCKET wakeup);
+
+    /**
+     * @brief
+     *  Clears every signal of the wakeup
+     */
+    void ClearWakeup(SOCKET wakeup);
+
+    /**
+     * @brief
+     *  Destroys the wakeup
+     */
+    void DestroyWakeup(SOCKET wakeup);
+
     /**
      * @brief
      *  Converts a c-string into an ip address. Throws if fails.
@@ -76,5 +116,11 @@ namespace CS260
      *  Converts an address to an std::string
      */
     std::string ToString(in_addr const& addr);
+
+    /**
+     * @brief
+     *  Packs the ipv4 address and port of an endpoint into a single key. Null means the connected endpoint (key 0)
+     */
+    uint64_t EndpointKey(const sockaddr* addr);
 }
 #endif // __NETWORKING_HPP__
@@ -0,0 +1,267 @@
+#include "packet_serialization.hpp"
+
+#include "quantization.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace CS260
+{
+	namespace
+	{
+		float VelocityResolution(float limit)
+		{
+			return 2.0f * limit / static_cast<float>(NET_VELOCITY_STEPS);
+		}
+
+		void WritePlayerInfo(BitWriter& writer, const PlayerInfo& info)
+		{
+			writer.WriteBits(info.mID, 8);
+			WritePosition(writer, info.pos);
+			writer.WriteAngle(info.rot, NET_ANGLE_BITS);
+			WriteVelocity(writer, info.vel, NET_SHIP_SPEED_LIMIT);
+			writer.WriteFloat(info.rotSpeed, 0.0f, NET_ROT_SPEED_LIMIT, NET_ROT_SPEED_RESOLUTION);
+			writer.WriteBool(info.inputPressed);
+			writer.WriteBits(info.mInputSequence, 16);
+		}
+
+		PlayerInfo ReadPlayerInfo(BitReader& reader)
+		{
+			PlayerInfo info{};
+			info.mID = static_cast<unsigned char>(reader.ReadBits(8));
+			info.pos = ReadPosition(reader);
+			info.rot = reader.ReadAngle(NET_ANGLE_BITS);
+			info.vel = ReadVelocity(reader, NET_SHIP_SPEED_LIMIT);
+			info.rotSpeed = reader.ReadFloat(0.0f, NET_ROT_SPEED_LIMIT, NET_ROT_SPEED_RESOLUTION);
+			info.inputPressed = reader.ReadBool();
+			info.mInputSequence = static_cast<unsigned short>(reader.ReadBits(16));
+			return info;
+		}
+
+		void WriteShip(BitWriter& writer, const ShipUpdatePacket& ship)
+		{
+			WritePlayerInfo(writer, ship.mPlayerInfo);
+		}
+
+		ShipUpdatePacket ReadShip(BitReader& reader)
+		{
+			ShipUpdatePacket ship{};
+			ship.mPlayerInfo = ReadPlayerInfo(reader);
+			return ship;
+		}
+
+		//the time, the count and then the used ships
+		void WriteShipStates(BitWriter& writer, const ShipStatesPacket& states)
+		{
+			writer.WriteBits(states.mTime, 32);
+			unsigned count = std::min(states.mCount, MAX_SHIP_STATES);
+			writer.WriteInt(static_cast<int32_t>(count), 0, MAX_SHIP_STATES);
+			for (unsigned i = 0; i < count; i++)
+				WritePlayerInfo(writer, states.mShips[i]);
+		}
+
+		/**
+		* @brief
+		* Reads the ship states into the given packet, only the used ships are written
+		* @return
+		* The size of the packet, 0 if the bytes are not valid ship states
+		*/
+		unsigned ReadShipStates(BitReader& reader, unsigned size, void* packet)
+		{
+			ShipStatesPacket* states = static_cast<ShipStatesPacket*>(packet);
+			unsigned time = reader.ReadBits(32);
+			unsigned count = static_cast<unsigned>(reader.ReadInt(0, MAX_SHIP_STATES));
+			for (unsigned i = 0; i < count && !reader.HasOverflowed(); i++)
+				states->mShips[i] = ReadPlayerInfo(reader);
+			if (reader.HasOverflowed() || reader.GetBytesRead() != size)
+				return 0;
+			states->mTime = time;
+			states->mCount = count;
+			return states->GetSize();
+		}
+
+		//the count, the sequence of the first command and then the input and duration of each one
+		void WriteInputCommands(BitWriter& writer, const InputCommandsPacket& commands)
+		{
+			unsigned count = std::min(commands.mCount, MAX_INPUT_COMMANDS);
+			writer.WriteInt(static_cast<int32_t>(count), 0, MAX_INPUT_COMMANDS);
+			if (count == 0)
+				return;
+			writer.WriteBits(commands.mCommands[0].mSequence, 16);
+			for (unsigned i = 0; i < count; i++)
+			{
+				writer.WriteBits(commands.mCommands[i].mInput, NET_INPUT_BITS);
+				writer.WriteBits(commands.mCommands[i].mDuration, 8);
+			}
+		}
+
+		/**
+		* @brief
+		* Reads the input commands into the given packet, only the used commands are written
+		* @return
+		* The size of the packet, 0 if the bytes are not valid input commands
+		*/
+		unsigned ReadInputCommands(BitReader& reader, unsigned size, void* packet)
+		{
+			InputCommandsPacket* commands = static_cast<InputCommandsPacket*>(packet);
+			unsigned count = static_cast<unsigned>(reader.ReadInt(0, MAX_INPUT_COMMANDS));
+			unsigned short sequence = count ? static_cast<unsigned short>(reader.ReadBits(16)) : 0;
+			for (unsigned i = 0; i < count && !reader.HasOverflowed(); i++)
+			{
+				commands->mCommands[i].mSequence = static_cast<unsigned short>(sequence + i);
+				commands->mCommands[i].mInput = static_cast<uint8_t>(reader.ReadBits(NET_INPUT_BITS));
+				commands->mCommands[i].mDuration = static_cast<uint8_t>(reader.ReadBits(8));
+			}
+			if (reader.HasOverflowed() || reader.GetBytesRead() != size)
+				return 0;
+			commands->mCount = count;
+			return commands->GetSize();
+		}
+
+		void WriteAsteroid(BitWriter& writer, const AsteroidUpdatePacket& asteroid)
+		{
+			writer.WriteBits(asteroid.mID, 16);
+			WritePosition(writer, asteroid.mPosition);
+			WriteVelocity(writer, asteroid.mVelocity, NET_ASTEROID_SPEED_LIMIT);
+		}
+
+		AsteroidUpdatePacket ReadAsteroid(BitReader& reader)
+		{
+			AsteroidUpdatePacket asteroid{};
+			asteroid.mID = static_cast<unsigned short>(reader.ReadBits(16));
+			asteroid.mPosition = ReadPosition(reader);
+			asteroid.mVelocity = ReadVelocity(reader, NET_ASTEROID_SPEED_LIMIT);
+			return asteroid;
+		}
+
+		void WriteBullet(BitWriter& writer, const BulletCreationPacket& bullet)
+		{
+			//owners are player ids and bullets use the 16 bit ids of the game objects
+			writer.WriteInt(static_cast<int32_t>(bullet.mOwnerID), 0, UINT8_MAX);
+			WritePosition(writer, bullet.mPos);
+			WriteVelocity(writer, bullet.mVel, NET_BULLET_SPEED_LIMIT);
+			writer.WriteAngle(bullet.mDir, NET_ANGLE_BITS);
+			writer.WriteBits(bullet.mObjectID, 16);
+		}
+
+		BulletCreationPacket ReadBullet(BitReader& reader)
+		{
+			BulletCreationPacket bullet{};
+			bullet.mOwnerID = static_cast<unsigned>(reader.ReadInt(0, UINT8_MAX));
+			bullet.mPos = ReadPosition(reader);
+			bullet.mVel = ReadVelocity(reader, NET_BULLET_SPEED_LIMIT);
+			bullet.mDir = reader.ReadAngle(NET_ANGLE_BITS);
+			bullet.mObjectID = reader.ReadBits(16);
+			return bullet;
+		}
+
+		/**
+		* @brief
+		* Copies a packet read from the bits if all of them were used and nothing was missing
+		*/
+		template <typename T>
+		unsigned Finish(const BitReader& reader, unsigned size, const T& read, void* packet)
+		{
+			if (reader.HasOverflowed() || reader.GetBytesRead() != size)
+				return 0;
+			memcpy(packet, &read, sizeof(T));
+			return sizeof(T);
+		}
+	}
+
+	unsigned SerializePacket(Packet_Types type, const void* packet, unsigned size, char* buffer)
+	{
+		//the bit packed encodings are always smaller than the structures
+		BitWriter writer(buffer, size);
+
+		switch (type)
+		{
+		case Packet_Types::ShipPacket:
+			WriteShip(writer, *static_cast<const ShipUpdatePacket*>(packet));
+			return writer.GetBytesWritten();
+		case Packet_Types::AsteroidUpdate:
+			WriteAsteroid(writer, *static_cast<const AsteroidUpdatePacket*>(packet));
+			return writer.GetBytesWritten();
+		case Packet_Types::BulletCreation:
+			WriteBullet(writer, *static_cast<const BulletCreationPacket*>(packet));
+			return writer.GetBytesWritten();
+		case Packet_Types::ShipStates:
+			WriteShipStates(writer, *static_cast<const ShipStatesPacket*>(packet));
+			return writer.GetBytesWritten();
+		case Packet_Types::InputCommands:
+			WriteInputCommands(writer, *static_cast<const InputCommandsPacket*>(packet));
+			return writer.GetBytesWritten();
+		default:
+			memcpy(buffer, packet, size);
+			return size;
+		}
+	}
+
+	unsigned DeserializePacket(Packet_Types type, const char* buffer, unsigned size, void* packet)
+	{
+		BitReader reader(buffer, size);
+
+		switch (type)
+		{
+		case Packet_Types::ShipPacket:
+			return Finish(reader, size, ReadShip(reader), packet);
+		case Packet_Types::AsteroidUpdate:
+			return Finish(reader, size, ReadAsteroid(reader), packet);
+		case Packet_Types::BulletCreation:
+			return Finish(reader, size, ReadBullet(reader), packet);
+		case Packet_Types::ShipStates:
+			return ReadShipStates(reader, size, packet);
+		case Packet_Types::InputCommands:
+			return ReadInputCommands(reader, size, packet);
+		default:
+		{
+			unsigned typeSize = Protocol::GetTypeSize(type);
+			bool validSize = Protocol::HasVariableSize(type) ? size <= typeSize : size == typeSize;
+			if (size == 0 || !validSize)
+				return 0;
+			memcpy(packet, buffer, size);
+			return size;
+		}
+		}
+	}
+
+	void WritePosition(BitWriter& writer, glm::vec2 position)
+	{
+		writer.WriteFloat(position.x, -NET_POSITION_LIMIT, NET_POSITION_LIMIT, NET_POSITION_RESOLUTION);
+		writer.WriteFloat(position.y, -NET_POSITION_LIMIT, NET_POSITION_LIMIT, NET_POSITION_RESOLUTION);
+	}
+
+	glm::vec2 ReadPosition(BitReader& reader)
+	{
+		glm::vec2 position;
+		position.x = reader.ReadFloat(-NET_POSITION_LIMIT, NET_POSITION_LIMIT, NET_POSITION_RESOLUTION);
+		position.y = reader.ReadFloat(-NET_POSITION_LIMIT, NET_POSITION_LIMIT, NET_POSITION_RESOLUTION);
+		return position;
+	}
+
+	void WriteVelocity(BitWriter& writer, glm::vec2 velocity, float limit)
+	{
+		writer.WriteFloat(velocity.x, -limit, limit, VelocityResolution(limit));
+		writer.WriteFloat(velocity.y, -limit, limit, VelocityResolution(limit));
+	}
+
+	glm::vec2 ReadVelocity(BitReader& reader, float limit)
+	{
+		glm::vec2 velocity;
+		velocity.x = reader.ReadFloat(-limit, limit, VelocityResolution(limit));
+		velocity.y = reader.ReadFloat(-limit, limit, VelocityResolution(limit));
+		return velocity;
+	}
+
+	glm::vec2 QuantizePosition(glm::vec2 position)
+	{
+		return { QuantizeRoundTrip(position.x, -NET_POSITION_LIMIT, NET_POSITION_LIMIT, NET_POSITION_RESOLUTION),
+			QuantizeRoundTrip(position.y, -NET_POSITION_LIMIT, NET_POSITION_LIMIT, NET_POSITION_RESOLUTION) };
+	}
+
+	glm::vec2 QuantizeVelocity(glm::vec2 velocity, float limit)
+	{
+		return { QuantizeRoundTrip(velocity.x, -limit, limit, VelocityResolution(limit)),
+			QuantizeRoundTrip(velocity.y, -limit, limit, VelocityResolution(limit)) };
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "protocol.hpp"
+#include "bit_reader.hpp"
+#include "bit_writer.hpp"
+
+namespace CS260 {
+
+	// Ranges the game state is quantized to on the wire, values outside them are clamped.
+	// Positions cover the play field of windows up to 3600 pixels wide plus the margin the asteroids wrap at (AST_SIZE_MAX),
+	// 16 bits per component
+	const float NET_POSITION_LIMIT = 2048.0f;
+	const float NET_POSITION_RESOLUTION = 1.0f / 16.0f;
+
+	// Steps each velocity component is divided in whatever its limit, 14 bits
+	const unsigned NET_VELOCITY_STEPS = 1 << 14;
+
+	// Asteroids are kept under twice AST_VEL_MAX, bullets impart a bit more
+	const float NET_ASTEROID_SPEED_LIMIT = 256.0f;
+	// Ships accelerate at SHIP_ACCEL_FORWARD against the dampening, well under this
+	const float NET_SHIP_SPEED_LIMIT = 512.0f;
+	// BULLET_SPEED plus the speed of the ship firing it
+	const float NET_BULLET_SPEED_LIMIT = 2048.0f;
+
+	// Bits of the angles, a step is under a tenth of a degree
+	const unsigned NET_ANGLE_BITS = 12;
+
+	// Ships turn at up to SHIP_ROT_SPEED radians per second, 10 bits
+	const float NET_ROT_SPEED_LIMIT = 4.0f;
+	const float NET_ROT_SPEED_RESOLUTION = 1.0f / 256.0f;
+
+	// Bits of the input of a command, see InputBits
+	const unsigned NET_INPUT_BITS = 5;
+
+	/**
+	* @brief
+	* Writes a packet the way it goes on the wire. The types with a quantized encoding are bit packed,
+	* the rest are copied as they are
+	* @param size : size of the packet in memory, GetTypeSize unless the type has variable size
+	* @param buffer : where to write it, with room for at least size bytes
+	* @return
+	* The bytes written
+	*/
+	unsigned SerializePacket(Packet_Types type, const void* packet, unsigned size, char* buffer);
+
+	/**
+	* @brief
+	* Reads a packet written by SerializePacket back into its structure
+	* @param packet : where to write it, with room for GetTypeSize bytes
+	* @return
+	* The size of the packet in memory, 0 if the bytes are not a valid packet of that type
+	*/
+	unsigned DeserializePacket(Packet_Types type, const char* buffer, unsigned size, void* packet);
+
+	/**
+	* @brief
+	* Writes the position of an object in the play field
+	*/
+	void WritePosition(BitWriter& writer, glm::vec2 position);
+
+	/**
+	* @brief
+	* Reads a position written by WritePosition
+	*/
+	glm::vec2 ReadPosition(BitReader& reader);
+
+	/**
+	* @brief
+	* Writes a velocity whose components are within the given limit
+	*/
+	void WriteVelocity(BitWriter& writer, glm::vec2 velocity, float limit);
+
+	/**
+	* @brief
+	* Reads a velocity written by WriteVelocity with the same limit
+	*/
+	glm::vec2 ReadVelocity(BitReader& reader, float limit);
+
+	/**
+	* @brief
+	* Value a position has once read on the other side
+	*/
+	glm::vec2 QuantizePosition(glm::vec2 position);
+
+	/**
+	* @brief
+	* Value a velocity has once read on the other side
+	*/
+	glm::vec2 QuantizeVelocity(glm::vec2 velocity, float limit);
+}
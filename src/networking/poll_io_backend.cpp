@@ -0,0 +1,59 @@
+#include "poll_io_backend.hpp"
+
+namespace CS260
+{
+	PollIoBackend::PollIoBackend(SOCKET socket) :
+		mSocket(socket),
+		mWakeup(CreateWakeup())
+	{
+	}
+
+	PollIoBackend::~PollIoBackend()
+	{
+		DestroyWakeup(mWakeup);
+	}
+
+	void PollIoBackend::Send(const char* data, unsigned size, const sockaddr* addr)
+	{
+		//check whether we need to send it to an endpoint or to the connected one
+		if (addr)
+			sendto(mSocket, data, (int)size, 0, addr, (int)sizeof(sockaddr));
+		else
+			send(mSocket, data, (int)size, 0);
+	}
+
+	void PollIoBackend::FlushSends()
+	{
+	}
+
+	bool PollIoBackend::Receive(const char** data, unsigned* size, sockaddr* addr)
+	{
+		int received;
+
+		if (addr) { // we dont  know who we are receiving from
+			socklen_t addr_size = sizeof(*addr);
+			received = recvfrom(mSocket, mBuffer.data(), (int)mBuffer.size(), 0, addr, &addr_size);
+		}
+		else { // we do know
+			received = recv(mSocket, mBuffer.data(), (int)mBuffer.size(), 0);
+		}
+
+		// Nothing left or any error, this will not update the Keep alive timer so in case of multiple errors diconnection happens
+		if (received == SOCKET_ERROR)
+			return false;
+
+		*data = mBuffer.data();
+		*size = static_cast<unsigned>(received);
+		return true;
+	}
+
+	bool PollIoBackend::Wait(unsigned timeoutMs)
+	{
+		return WaitForActivity(mSocket, mWakeup, timeoutMs);
+	}
+
+	void PollIoBackend::Wake()
+	{
+		SignalWakeup(mWakeup);
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "io_backend.hpp"
+
+#include <array>
+
+namespace CS260 {
+
+	// Portable backend, one system call per datagram
+	class PollIoBackend : public IoBackend {
+
+	public:
+		/**
+		* @brief
+		*  Constructs the backend for an already created socket, which it does not own
+		*/
+		PollIoBackend(SOCKET socket);
+
+		/**
+		* @brief
+		*  Destroys the wakeup
+		*/
+		~PollIoBackend() override;
+
+		/**
+		* @brief
+		* Sends the datagram right away
+		*/
+		void Send(const char* data, unsigned size, const sockaddr* addr) override;
+
+		/**
+		* @brief
+		* Nothing to do, every datagram was already sent
+		*/
+		void FlushSends() override;
+
+		/**
+		* @brief
+		* Receives a single datagram from the socket
+		*/
+		bool Receive(const char** data, unsigned* size, sockaddr* addr) override;
+
+		/**
+		* @brief
+		* Polls the socket and the wakeup
+		*/
+		bool Wait(unsigned timeoutMs) override;
+
+		/**
+		* @brief
+		* Signals the wakeup
+		*/
+		void Wake() override;
+
+		IoBackendType GetType() const override { return IoBackendType::Poll; }
+
+	private:
+		SOCKET mSocket;
+		SOCKET mWakeup;
+
+		//last datagram received
+		std::array<char, MAX_DATAGRAM_SIZE> mBuffer;
+	};
+}
@@ -0,0 +1,33 @@
+#include "priority_accumulator.hpp"
+
+namespace CS260
+{
+	void PriorityAccumulator::Accumulate(uint16_t id, float priority)
+	{
+		mPriorities[id] += priority;
+	}
+
+	float PriorityAccumulator::GetPriority(uint16_t id) const
+	{
+		auto found = mPriorities.find(id);
+		return found != mPriorities.end() ? found->second : 0.0f;
+	}
+
+	void PriorityAccumulator::Reset(uint16_t id)
+	{
+		//kept instead of erased, the entity accumulates again on the next update
+		auto found = mPriorities.find(id);
+		if (found != mPriorities.end())
+			found->second = 0.0f;
+	}
+
+	void PriorityAccumulator::Remove(uint16_t id)
+	{
+		mPriorities.erase(id);
+	}
+
+	void PriorityAccumulator::Clear()
+	{
+		mPriorities.clear();
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+
+namespace CS260 {
+
+	// Priority of each entity replicated to a peer. On every update the entities gain priority by how much they matter to it,
+	// the ones sent go back to none and the ones that did not fit keep theirs, so they go before the others the next time
+	class PriorityAccumulator {
+
+	public:
+		/**
+		* @brief
+		* Adds to the priority of the entity
+		*/
+		void Accumulate(uint16_t id, float priority);
+
+		/**
+		* @brief
+		* Priority accumulated by the entity since it was last sent, 0 if it was never accumulated
+		*/
+		float GetPriority(uint16_t id) const;
+
+		/**
+		* @brief
+		* The entity was sent, it starts accumulating again
+		*/
+		void Reset(uint16_t id);
+
+		/**
+		* @brief
+		* Forgets an entity that is not replicated anymore
+		*/
+		void Remove(uint16_t id);
+
+		/**
+		* @brief
+		* Forgets every entity
+		*/
+		void Clear();
+
+	private:
+		std::unordered_map<uint16_t, float> mPriorities;
+	};
+}
@@ -1,184 +1,534 @@
 #include "protocol.hpp"
 
 #include "networking.hpp"
+#include "packet_serialization.hpp"
 
 #include "utils.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 
 namespace CS260 
 {
+	namespace
+	{
+		/**
+		* @brief
+		* Serializes the header without padding, in network byte order
+		*/
+		void WriteHeader(char* buffer, const PacketHeader& header)
+		{
+			uint16_t seq = htons(header.mSeq);
+			uint16_t ack = htons(header.mAck);
+			uint32_t ackBits = htonl(header.mAckBits);
+			memcpy(buffer, &seq, 2);
+			memcpy(buffer + 2, &ack, 2);
+			memcpy(buffer + 4, &ackBits, 4);
+			buffer[8] = static_cast<char>(header.mFlags);
+			buffer[9] = static_cast<char>(header.mMessageCount);
+		}
+
+		/**
+		* @brief
+		* Deserializes a header written by WriteHeader
+		*/
+		PacketHeader ReadHeader(const char* buffer)
+		{
+			PacketHeader header;
+			memcpy(&header.mSeq, buffer, 2);
+			memcpy(&header.mAck, buffer + 2, 2);
+			memcpy(&header.mAckBits, buffer + 4, 4);
+			header.mSeq = ntohs(header.mSeq);
+			header.mAck = ntohs(header.mAck);
+			header.mAckBits = ntohl(header.mAckBits);
+			header.mFlags = static_cast<uint8_t>(buffer[8]);
+			header.mMessageCount = static_cast<uint8_t>(buffer[9]);
+			return header;
+		}
+
+		/**
+		* @brief
+		* Encodes a message prefixed by its type and size at the end of the given bytes.
+		* The bytes keep their capacity between flushes, so this does not allocate once warmed up
+		* @return
+		* The size of the message on the wire, header included
+		*/
+		unsigned AppendMessage(std::vector<char>& bytes, Packet_Types type, const void* packet, unsigned packetSize)
+		{
+			size_t offset = bytes.size();
+			bytes.resize(offset + MESSAGE_HEADER_SIZE + packetSize);
+
+			//serialize in place and drop what the encoding did not use
+			unsigned wireSize = packetSize ? SerializePacket(type, packet, packetSize, bytes.data() + offset + MESSAGE_HEADER_SIZE) : 0;
+			//the peer takes an empty message as a corrupt one and drops the rest of the datagram
+			assert(wireSize > 0 && "messages cannot be empty");
+			bytes.resize(offset + MESSAGE_HEADER_SIZE + wireSize);
+
+			bytes[offset] = static_cast<char>(type);
+			uint16_t size = htons(static_cast<uint16_t>(wireSize));
+			memcpy(bytes.data() + offset + 1, &size, 2);
+			return MESSAGE_HEADER_SIZE + wireSize;
+		}
+	}
+
 	Protocol::Protocol():
-		mSocket(0)
+		mSocket(0),
+		mByteBudget(0),
+		mHandshakeRequired(false),
+		mReceiveData(nullptr),
+		mReceiveSize(0),
+		mReceiveOffset(0),
+		mReceiveAddress{}
 	{
 		// Initialize the networking library
 		NetworkCreate();
-		mSequenceNumber = rand() % now_ns() + 1;
 	}
 
 	Protocol::~Protocol()
 	{
+		//the backend may still have datagrams to send
+		mIo.reset();
 		NetworkDestroy();
 	}
 	void Protocol::Tick()
 	{
-		//for each message sent that hasnt been ack
-		for (auto & message : mUnacknowledgedMessages) {
-			//increase how much time has passed since we sent it
-			std::get<1>(message) += tickRate;
-			//if more time than the resend time has passed
-			if (std::get<1>(message) > mResendTime) {
-				//need to resend the message
+		auto currentTime = now();
+
+		//messages we gave up on, handled after iterating as the callback may send new ones
+		std::vector<std::pair<RetransmitWindow::Entry, Packet_Types>> failedMessages;
+
+		for (auto it = mConnections.begin(); it != mConnections.end();) {
+			Connection& connection = it->second;
+
+			//the peer went away, forget about it, giving up on everything it did not acknowledge yet
+			if (currentTime - connection.mLastReceiveTime > std::chrono::milliseconds(peerIdleTimeout)) {
+				connection.mUnacknowledgedMessages.ForEach([&](RetransmitWindow::Entry& message, char* data) {
+					failedMessages.emplace_back(message, static_cast<Packet_Types>(data[PACKET_HEADER_SIZE]));
+					connection.mStats.mDeliveryFailures++;
+				});
+				mForgottenStats += connection.mStats;
+				it = mConnections.erase(it);
+				continue;
+			}
 
-				if (std::get<2>(message)) { // there is a sockaddr pointer
+			//for each message sent that hasnt been ack
+			connection.mUnacknowledgedMessages.ForEach([&](RetransmitWindow::Entry& message, char* data) {
+				//only resend it once its deadline has passed
+				if (currentTime < message.mDeadline)
+					return;
 
-					sendto(mSocket, std::get<0>(message).data(), (int)std::get<0>(message).size(), 0, std::get<2>(message), (int)sizeof(sockaddr));
+				//resent too many times, stop trying, reporting the first message it carried
+				if (message.mTries >= MAX_RESEND_TRIES) {
+					failedMessages.emplace_back(message, static_cast<Packet_Types>(data[PACKET_HEADER_SIZE]));
+					return;
 				}
-				else { //there is not
 
-					send(mSocket, std::get<0>(message).data(), (int)std::get<0>(message).size(), 0);
+				//need to resend the message, only its actual bytes, with the newest acknowledgements
+				WriteAcks(connection, data);
+				SendRaw(connection, data, message.mSize);
+				connection.mStats.mResends++;
+				//resends count against the budget of the next flush
+				connection.mByteAllowance -= message.mSize;
 
-				}
+				//wait longer each time we resend it
+				message.mTries++;
+				message.mDeadline = currentTime + std::chrono::microseconds(static_cast<long long>(connection.mRtt.GetTimeout(message.mTries) * 1000.0f));
+			});
+
+			++it;
+		}
+		mIo->FlushSends();
+
+		for (auto& [message, type] : failedMessages) {
+			const sockaddr* addr = message.mHasAddress ? &message.mAddress : nullptr;
+			auto found = mConnections.find(EndpointKey(addr));
+			if (found != mConnections.end()) {
+				found->second.mUnacknowledgedMessages.Acknowledge(message.mSeq);
+				found->second.mStats.mDeliveryFailures++;
 			}
+
+			if (mDeliveryFailedCallback)
+				mDeliveryFailedCallback(addr, type);
 		}
+	}
+	void Protocol::SendPacket(Packet_Types _type, const void* _packet, const sockaddr* _addr)
+	{
+		SendPacket(_type, _packet, GetTypeSize(_type), _addr);
+	}
+
+	void Protocol::SendPacket(Packet_Types _type, const void* _packet, unsigned _size, const sockaddr* _addr)
+	{
+		bool needsAck = false;
+		unsigned mPacketSize = std::min(_size, GetTypeSize(_type, &needsAck));
+
+		Connection& connection = GetConnection(_addr);
 
+		QueuedMessage message{ static_cast<unsigned>(connection.mQueuedBytes.size()), 0, false };
+		message.mSize = AppendMessage(connection.mQueuedBytes, _type, _packet, mPacketSize);
 
+		//reliable messages are packed apart, so that resending them does not resend stale unreliable ones
+		(needsAck ? connection.mReliableQueue : connection.mUnreliableQueue).push_back(message);
 	}
-	void Protocol::SendPacket(Packet_Types _type, void* _packet, const sockaddr* _addr)
+
+	void Protocol::Broadcast(Packet_Types _type, const void* _packet, std::span<const sockaddr> _endpoints)
 	{
-		std::array<char, 8192 > mBuffer{};
+		Broadcast(_type, _packet, GetTypeSize(_type), _endpoints);
+	}
 
+	void Protocol::Broadcast(Packet_Types _type, const void* _packet, unsigned _size, std::span<const sockaddr> _endpoints)
+	{
 		bool needsAck = false;
-		unsigned mPacketSize = GetTypeSize(_type, &needsAck);
-		
-		//construct the header of the packet
-		PacketHeader mHeader{ mSequenceNumber , 0, needsAck, _type };
-		mSequenceNumber++;
+		unsigned mPacketSize = std::min(_size, GetTypeSize(_type, &needsAck));
 
-		//store the ehader on the actual buffer
-		memcpy(mBuffer.data(), &mHeader, sizeof(PacketHeader));
-		//store the actual payload in the buffer
-		memcpy(mBuffer.data() + sizeof(PacketHeader), _packet, mPacketSize);
+		//encode it once, every connection only stores where it is
+		QueuedMessage message{ static_cast<unsigned>(mBroadcastBytes.size()), 0, true };
+		message.mSize = AppendMessage(mBroadcastBytes, _type, _packet, mPacketSize);
 
-		//check whether we need to send it to an endpoint or to the connected one
-		if (_addr)
-			sendto(mSocket, mBuffer.data(), sizeof(PacketHeader) + mPacketSize, 0, _addr, sizeof(sockaddr));
-		else 
-			send(mSocket, mBuffer.data(), sizeof(PacketHeader) + mPacketSize, 0); 
+		for (const sockaddr& endpoint : _endpoints) {
+			Connection& connection = GetConnection(&endpoint);
+			(needsAck ? connection.mReliableQueue : connection.mUnreliableQueue).push_back(message);
+		}
+	}
 
-		//check whether we need to store it in those to resend if not acknowledged
-		if (needsAck)
-			mUnacknowledgedMessages.push_back(std::tuple< std::array<char, 8192>, unsigned,const sockaddr*>(mBuffer, 0, _addr));
+	void Protocol::Flush()
+	{
+		for (auto& [key, connection] : mConnections) {
+			//what went over the last budget is paid back first
+			connection.mByteAllowance = mByteBudget ? std::min<long long>(connection.mByteAllowance + mByteBudget, mByteBudget) : 0;
+
+			//reliable messages go first, they cannot be dropped
+			unsigned sentReliable = FlushQueue(connection, connection.mReliableQueue, true, mByteBudget != 0);
+			unsigned sentUnreliable = FlushQueue(connection, connection.mUnreliableQueue, false, mByteBudget != 0);
+
+			connection.mStats.mDroppedMessages += connection.mUnreliableQueue.size() - sentUnreliable;
+			connection.mUnreliableQueue.clear();
+			DeferReliable(connection, sentReliable);
+		}
+
+		//every connection has already packed the messages broadcast to it
+		mBroadcastBytes.clear();
+
+		//also sends the datagrams the backend kept
+		SendAcknowledgements();
 	}
 
-	bool Protocol::ReceivePacket(void* _payload, unsigned *_size, Packet_Types* _type, sockaddr * _addr)
+	void Protocol::SendAcknowledgements()
 	{
+		auto currentTime = now();
+
+		for (auto& [key, connection] : mConnections) {
+			//nothing was sent to the peer during the whole last tick to carry the acknowledgement, or we have been quiet for too long
+			bool sendAck = connection.mAckPending && connection.mAckAged;
+			bool sendKeepAlive = currentTime - connection.mLastSendTime > std::chrono::milliseconds(keepAliveInterval);
+			if (sendAck || sendKeepAlive) {
+				std::array<char, PACKET_HEADER_SIZE> ackPack;
+				WriteHeader(ackPack.data(), PacketHeader{ 0, 0, 0, PacketHeader::Unsequenced, 0 });
+				WriteAcks(connection, ackPack.data());
+				SendRaw(connection, ackPack.data(), PACKET_HEADER_SIZE);
+			}
+			connection.mAckAged = connection.mAckPending;
+		}
 
-		std::array<char, 8192> mBuffer{};
-		//boolean to keep track if we already handled this packet
-		bool alreadyReceived = false;
+		mIo->FlushSends();
+	}
+
+	bool Protocol::Wait(unsigned timeoutMs)
+	{
+		//still messages of the last datagram
+		if (mReceiveOffset < mReceiveSize)
+			return true;
+		return mIo->Wait(timeoutMs);
+	}
 
-		int received;
+	void Protocol::Wake()
+	{
+		mIo->Wake();
+	}
+
+	bool Protocol::ReceivePacket(void* _payload, unsigned *_size, Packet_Types* _type, sockaddr * _addr)
+	{
+		//store empty out paramteres as dummy, in case there is nothing to handle
+		*_type = Packet_Types::VoidPacket;
+		*_size = 0;
 
-		if (_addr){ // we dont  know who we are receiving from
-			int addr_size = sizeof(*_addr);
-			
-			received = recvfrom(mSocket, mBuffer.data(), (int)mBuffer.size(), 0, _addr, &addr_size);
-			// Do nothing , this will not update the Keep alive timer so in case of multiple errors diconnection happens
-			if (received == SOCKET_ERROR)
+		//all the messages of the last datagram were returned, read the next one
+		if (mReceiveOffset >= mReceiveSize) {
+			if (!ReceiveDatagram(_addr))
 				return false;
 		}
-		else { // we do know
-			
-			received = recv(mSocket, mBuffer.data(), (int)mBuffer.size(), 0);
+		else if (_addr) {
+			*_addr = mReceiveAddress;
+		}
 
-			// If received any error
-			// Do nothing			
-			if (received == SOCKET_ERROR)
-				return false;
+		//only acknowledgements, a duplicate or not one of our packets
+		if (mReceiveOffset + MESSAGE_HEADER_SIZE > mReceiveSize) {
+			mReceiveOffset = mReceiveSize;
+			return true;
 		}
 
-		//cast the header message
-		if (received > 0)
-		{
-			PacketHeader mHeader;
-			memcpy(&mHeader, mBuffer.data(), sizeof(mHeader));
-
-			//in case we need to acknowledge the packet
-			if (mHeader.mNeedsAcknowledgement) {
-				for (auto& i : mLast100AckMessages) {
-					//we already received so dont handle it anymore
-					if (i == mHeader.mSeq) {
-						alreadyReceived = true;
-					}
-				}
+		//unpack the next message
+		Packet_Types type = static_cast<Packet_Types>(static_cast<uint8_t>(mReceiveData[mReceiveOffset]));
+		uint16_t size;
+		memcpy(&size, mReceiveData + mReceiveOffset + 1, 2);
+		size = ntohs(size);
+		mReceiveOffset += MESSAGE_HEADER_SIZE;
 
-				if (!alreadyReceived) {
-					//create the acknowledgement void packet
-					PacketHeader mAckHeader = { 0 , mHeader.mSeq , false, Packet_Types::VoidPacket };
-					std::array<char, 8192> ackPack;
-					memcpy(&ackPack, &mAckHeader, sizeof(mAckHeader));
+		//the rest of the datagram cannot be trusted if the message does not decode as its type
+		unsigned packetSize = 0;
+		if (mReceiveOffset + size <= mReceiveSize)
+			packetSize = DeserializePacket(type, mReceiveData + mReceiveOffset, size, _payload);
+		if (packetSize == 0) {
+			mReceiveOffset = mReceiveSize;
+			return true;
+		}
 
-					//send the ack packet
-					if (_addr) {
+		//store in the out parameters
+		*_type = type;
+		*_size = packetSize;
+		mReceiveOffset += size;
 
-						int sent = sendto(mSocket, ackPack.data(), sizeof(mAckHeader), 0, _addr, sizeof(sockaddr));
-						//std::cout << WSAGetLastError();
+		return true;
+	}
 
-					}
-					else {
+	bool Protocol::ReceiveDatagram(sockaddr* _addr)
+	{
+		unsigned received;
 
-						int sent = send(mSocket, ackPack.data(), sizeof(PacketHeader), 0);
-					}
+		// Do nothing if there is nothing or an error, this will not update the Keep alive timer so in case of multiple errors diconnection happens
+		if (!mIo->Receive(&mReceiveData, &received, _addr))
+			return false;
+		if (_addr)
+			mReceiveAddress = *_addr;
 
-					//add it to the ones we received, so that if we receive it again we discard it 
-					mLast100AckMessages.push_back(mHeader.mSeq);
+		//nothing to unpack unless the header says so
+		mReceiveOffset = 0;
+		mReceiveSize = 0;
 
-					//if the size is greater than 100 remove the first one
-					if (mLast100AckMessages.size() > 100) {
-						mLast100AckMessages.pop_front();
-					}
-				}
-			}
+		//ignore anything too small to be one of our packets
+		if (received < PACKET_HEADER_SIZE)
+			return true;
 
+		PacketHeader mHeader = ReadHeader(mReceiveData);
 
-			//in case it was an acknowledgement{
-			if (mHeader.mAck != 0) {
+		//only known endpoints, or new ones we let in, get a connection
+		uint64_t key = EndpointKey(_addr);
+		auto found = mConnections.find(key);
+		if (found == mConnections.end()) {
+			if (_addr && !AcceptsNewPeer(mHeader, received))
+				return true;
+			found = mConnections.try_emplace(key, _addr).first;
+		}
 
-				//erase the message if we just received its ack
-				auto erased = std::erase_if(mUnacknowledgedMessages, [&](std::tuple<std::array<char, 8192>,unsigned, const sockaddr*> a) {
+		Connection& connection = found->second;
+		connection.mLastReceiveTime = now();
+		connection.mStats.mPacketsReceived++;
+		connection.mStats.mBytesReceived += received;
 
-					PacketHeader mThisHeader;
-					memcpy(&mThisHeader, std::get<0>(a).data(), sizeof(mThisHeader));
+		//remove the messages the peer acknowledged on this packet
+		ProcessAcks(connection, mHeader);
 
-					if (mHeader.mAck == mThisHeader.mSeq) {
-						return true; //we found the element we received the ack from
-					}
-					return false;
-					});
+		//packets only carrying acknowledgements have nothing else to handle
+		if (mHeader.mFlags & PacketHeader::Unsequenced)
+			return true;
 
+		//boolean to keep track if we already handled this packet
+		bool alreadyReceived = connection.RecordReceived(mHeader.mSeq);
+		if (alreadyReceived)
+			connection.mStats.mDuplicates++;
+
+		if (mHeader.mFlags & PacketHeader::NeedsAcknowledgement) {
+			//we will send back the acknowledgement in the next packet we send
+			connection.mAckPending = true;
+
+			//too old for the acknowledgement fields, acknowledge it on its own so the sender stops resending it
+			if (!connection.CanAcknowledge(mHeader.mSeq)) {
+				std::array<char, PACKET_HEADER_SIZE> ackPack;
+				WriteHeader(ackPack.data(), PacketHeader{ 0, mHeader.mSeq, 0, PacketHeader::Unsequenced | PacketHeader::HasAcks, 0 });
+				SendRaw(connection, ackPack.data(), PACKET_HEADER_SIZE);
 			}
+		}
 
-			
-			//if we need to handle it
-			if (!alreadyReceived){
+		//if we need to handle it, its messages are unpacked by ReceivePacket
+		if (!alreadyReceived) {
+			mReceiveOffset = PACKET_HEADER_SIZE;
+			mReceiveSize = received;
+
+			//counted here since ReceivePacket does not look the connection up again
+			for (unsigned offset = PACKET_HEADER_SIZE; offset + MESSAGE_HEADER_SIZE <= received;) {
+				uint16_t size;
+				memcpy(&size, mReceiveData + offset + 1, 2);
+				unsigned messageSize = MESSAGE_HEADER_SIZE + ntohs(size);
+				CountMessage(connection, mReceiveData + offset, messageSize, false);
+				offset += messageSize;
+			}
+		}
+		return true;
+	}
 
-				//store in the out parameters
-				*_type = mHeader.mPackType;
+	void Protocol::CountMessage(Connection& connection, const char* message, unsigned size, bool sent)
+	{
+		uint8_t type = static_cast<uint8_t>(message[0]);
+		if (type >= STATS_MESSAGE_TYPES)
+			return;
+
+		MessageStats& stats = connection.mStats.mMessages[type];
+		if (sent) {
+			stats.mSent++;
+			stats.mBytesSent += size;
+		}
+		else {
+			stats.mReceived++;
+			stats.mBytesReceived += size;
+		}
+	}
 
-				unsigned mPacketSize = GetTypeSize(mHeader.mPackType);
+	bool Protocol::AcceptsNewPeer(const PacketHeader& header, unsigned size) const
+	{
+		if (mConnections.size() >= MAX_PEERS)
+			return false;
+		if (!mHandshakeRequired)
+			return true;
+
+		//the SYN goes first in the first datagram of a client
+		return !(header.mFlags & PacketHeader::Unsequenced) && size >= PACKET_HEADER_SIZE + MESSAGE_HEADER_SIZE &&
+			static_cast<uint8_t>(mReceiveData[PACKET_HEADER_SIZE]) == Packet_Types::SYN;
+	}
+
+	Connection& Protocol::GetConnection(const sockaddr* addr)
+	{
+		//a single lookup by address and port, however many peers there are
+		return mConnections.try_emplace(EndpointKey(addr), addr).first->second;
+	}
 
-				*_size = mPacketSize;
-				memcpy(_payload, mBuffer.data() + sizeof(PacketHeader), mPacketSize);
+	void Protocol::WriteAcks(Connection& connection, char* buffer)
+	{
+		uint16_t ack = htons(connection.GetRemoteSequence());
+		uint32_t ackBits = htonl(connection.GetRemoteAckBits());
+		memcpy(buffer + 2, &ack, 2);
+		memcpy(buffer + 4, &ackBits, 4);
+		buffer[8] = static_cast<char>((buffer[8] & ~PacketHeader::HasAcks) | (connection.HasReceived() ? PacketHeader::HasAcks : 0));
+
+		//the peer will know about everything we received so far
+		connection.mAckPending = false;
+		connection.mAckAged = false;
+	}
+
+	void Protocol::SendRaw(Connection& connection, const char* data, unsigned size)
+	{
+		//check whether we need to send it to an endpoint or to the connected one
+		mIo->Send(data, size, connection.GetAddress());
+
+		connection.mLastSendTime = now();
+		connection.mStats.mPacketsSent++;
+		connection.mStats.mBytesSent += size;
+	}
+
+	unsigned Protocol::FlushQueue(Connection& connection, std::vector<QueuedMessage>& queue, bool reliable, bool budgeted)
+	{
+		std::array<char, MAX_DATAGRAM_SIZE> datagram;
+		unsigned size = PACKET_HEADER_SIZE;
+		uint8_t messageCount = 0;
+		unsigned sent = 0;
+
+		for (const QueuedMessage& message : queue) {
+			//the budget of this flush is used, the rest waits
+			if (budgeted && connection.mByteAllowance <= 0)
+				break;
+
+			//the message does not fit, send what we have and start another datagram
+			if (messageCount && (size + message.mSize > MAX_DATAGRAM_SIZE || messageCount == UINT8_MAX)) {
+				SendDatagram(connection, datagram.data(), size, messageCount, reliable);
+				size = PACKET_HEADER_SIZE;
+				messageCount = 0;
 			}
-			else {
+			if (messageCount == 0)
+				connection.mByteAllowance -= PACKET_HEADER_SIZE;
+
+			const std::vector<char>& bytes = message.mShared ? mBroadcastBytes : connection.mQueuedBytes;
+			memcpy(datagram.data() + size, bytes.data() + message.mOffset, message.mSize);
+			CountMessage(connection, datagram.data() + size, message.mSize, true);
+			size += message.mSize;
+			messageCount++;
+			connection.mByteAllowance -= message.mSize;
+			sent++;
+		}
+
+		if (messageCount)
+			SendDatagram(connection, datagram.data(), size, messageCount, reliable);
+
+		return sent;
+	}
+
+	void Protocol::DeferReliable(Connection& connection, unsigned sent)
+	{
+		std::vector<QueuedMessage>& queue = connection.mReliableQueue;
+		connection.mStats.mDeferredMessages += queue.size() - sent;
+
+		//the broadcast bytes are cleared after the flush, so every deferred message gets its own copy
+		mDeferredBytes.clear();
+		for (unsigned i = sent; i < queue.size(); i++) {
+			QueuedMessage message = queue[i];
+			const std::vector<char>& bytes = message.mShared ? mBroadcastBytes : connection.mQueuedBytes;
+			queue[i - sent] = QueuedMessage{ static_cast<unsigned>(mDeferredBytes.size()), message.mSize, false };
+			mDeferredBytes.insert(mDeferredBytes.end(), bytes.begin() + message.mOffset, bytes.begin() + message.mOffset + message.mSize);
+		}
+		queue.resize(queue.size() - sent);
+
+		//swapped instead of copied, the buffers keep their capacity
+		connection.mQueuedBytes.swap(mDeferredBytes);
+	}
+
+	void Protocol::SendDatagram(Connection& connection, char* data, unsigned size, uint8_t messageCount, bool reliable)
+	{
+		//construct the header of the packet, with the acknowledgements piggybacked
+		PacketHeader mHeader{ connection.NextSequence(), 0, 0, static_cast<uint8_t>(reliable ? PacketHeader::NeedsAcknowledgement : 0), messageCount };
+		WriteHeader(data, mHeader);
+		WriteAcks(connection, data);
 
-				//store empty out paramteres as dummy
-				*_type = Packet_Types::VoidPacket;
-				*_size = 0;
+		SendRaw(connection, data, size);
 
+		//check whether we need to store it in those to resend if not acknowledged
+		if (reliable) {
+			auto deadline = now() + std::chrono::microseconds(static_cast<long long>(connection.mRtt.GetTimeout() * 1000.0f));
+			connection.mUnacknowledgedMessages.Insert(mHeader.mSeq, data, size, connection.GetAddress(), deadline);
+		}
+		//otherwise only its send time is kept, a peer that mostly receives unreliable ones can also measure the round trip time
+		else
+			connection.mUnreliableSendTimes[mHeader.mSeq % RTT_SAMPLE_WINDOW] = Connection::SentTime{ mHeader.mSeq, true, now() };
+	}
+
+	void Protocol::ProcessAcks(Connection& connection, const PacketHeader& header)
+	{
+		auto acknowledge = [&](uint16_t seq) {
+			//erase the message if we just received its ack
+			RetransmitWindow::Entry acked;
+			if (connection.mUnacknowledgedMessages.Acknowledge(seq, &acked) && acked.mTries == 0) {
+				//only measure messages that were not resent, otherwise we cannot know which copy was acknowledged
+				float rtt = std::chrono::duration<float, std::milli>(now() - acked.mSentTime).count();
+				connection.mRtt.AddSample(rtt);
 			}
+		};
+
+		//nothing to acknowledge yet
+		if (!(header.mFlags & PacketHeader::HasAcks))
+			return;
+
+		//only the newest one the peer received is timed, the older ones were acknowledged on earlier packets too
+		Connection::SentTime& sent = connection.mUnreliableSendTimes[header.mAck % RTT_SAMPLE_WINDOW];
+		if (sent.mTimed && sent.mSeq == header.mAck) {
+			connection.mRtt.AddSample(std::chrono::duration<float, std::milli>(now() - sent.mTime).count());
+			sent.mTimed = false;
+		}
+
+		if (connection.mUnacknowledgedMessages.Count() == 0)
+			return;
+
+		acknowledge(header.mAck);
+		for (uint16_t i = 0; i < 32; i++) {
+			if (header.mAckBits & (1u << i))
+				acknowledge(static_cast<uint16_t>(header.mAck - 1 - i));
 		}
-		return true;
 	}
 
 	unsigned Protocol::GetTypeSize(Packet_Types type, bool* needsACKPtr)
@@ -242,11 +592,7 @@ namespace CS260
 			needsACK = true;
 			break;
 		case Packet_Types::PlayerDie:
-			packetSize = sizeof(AsteroidUpdatePacket);
-			needsACK = true;
-			break;
-		case Packet_Types::BulletRequest:
-			packetSize =  sizeof(BulletRequestPacket);
+			packetSize = sizeof(PlayerDiePacket);
 			needsACK = true;
 			break;
 		case Packet_Types::BulletCreation:
@@ -260,6 +606,27 @@ namespace CS260
 		case Packet_Types::ScoreUpdate:
 			packetSize = sizeof(ScorePacket);
 			needsACK = true;
+			break;
+		case Packet_Types::AsteroidSnapshot:
+			packetSize = MAX_MESSAGE_SIZE;
+			needsACK = false;
+			break;
+		case Packet_Types::SnapshotAck:
+			packetSize = sizeof(SnapshotAckPacket);
+			needsACK = false;
+			break;
+		case Packet_Types::ShipStates:
+			packetSize = sizeof(ShipStatesPacket);
+			needsACK = false;
+			break;
+		case Packet_Types::InputCommands:
+			packetSize = sizeof(InputCommandsPacket);
+			needsACK = false;
+			break;
+		case Packet_Types::ServerStats:
+			packetSize = sizeof(ServerStatsPacket);
+			needsACK = false;
+			break;
 		}
 		
 		//store in the out param
@@ -269,9 +636,104 @@ namespace CS260
 		return packetSize;
 	}
 
-	void Protocol::SetSocket(SOCKET _s)
+	bool Protocol::HasVariableSize(Packet_Types type)
+	{
+		return type == Packet_Types::AsteroidSnapshot || type == Packet_Types::ShipStates || type == Packet_Types::InputCommands;
+	}
+
+	const char* Protocol::GetTypeName(Packet_Types type)
+	{
+		switch (type) {
+		case Packet_Types::VoidPacket: return "VoidPacket";
+		case Packet_Types::ObjectUpdate: return "ObjectUpdate";
+		case Packet_Types::ShipPacket: return "ShipPacket";
+		case Packet_Types::ObjectCreation: return "ObjectCreation";
+		case Packet_Types::ObjectDestruction: return "ObjectDestruction";
+		case Packet_Types::SYN: return "SYN";
+		case Packet_Types::SYNACK: return "SYNACK";
+		case Packet_Types::NewPlayer: return "NewPlayer";
+		case Packet_Types::PlayerDisconnect: return "PlayerDisconnect";
+		case Packet_Types::ACKDisconnect: return "ACKDisconnect";
+		case Packet_Types::NotifyPlayerDisconnection: return "NotifyPlayerDisconnection";
+		case Packet_Types::AsteroidCreation: return "AsteroidCreation";
+		case Packet_Types::AsteroidUpdate: return "AsteroidUpdate";
+		case Packet_Types::AsteroidDestroy: return "AsteroidDestroy";
+		case Packet_Types::PlayerDie: return "PlayerDie";
+		case Packet_Types::BulletCreation: return "BulletCreation";
+		case Packet_Types::BulletDestruction: return "BulletDestruction";
+		case Packet_Types::ScoreUpdate: return "ScoreUpdate";
+		case Packet_Types::AsteroidSnapshot: return "AsteroidSnapshot";
+		case Packet_Types::SnapshotAck: return "SnapshotAck";
+		case Packet_Types::ShipStates: return "ShipStates";
+		case Packet_Types::InputCommands: return "InputCommands";
+		case Packet_Types::ServerStats: return "ServerStats";
+		}
+		return "Unknown";
+	}
+
+	void Protocol::SetSocket(SOCKET _s, IoBackendType _type)
 	{
 		mSocket = _s;
+		mIo = IoBackend::Create(_s, _type);
+	}
+
+	void Protocol::SetDeliveryFailedCallback(std::function<void(const sockaddr*, Packet_Types)> callback)
+	{
+		mDeliveryFailedCallback = std::move(callback);
+	}
+
+	float Protocol::GetRtt(const sockaddr* _addr) const
+	{
+		auto found = mConnections.find(EndpointKey(_addr));
+		if (found == mConnections.end())
+			return 0.0f;
+		return found->second.mRtt.GetRtt();
+	}
+
+	ConnectionStats Protocol::GetStats(const sockaddr* _addr) const
+	{
+		auto found = mConnections.find(EndpointKey(_addr));
+		if (found == mConnections.end())
+			return ConnectionStats();
+		return found->second.GetStats();
+	}
+
+	ConnectionStats Protocol::GetTotalStats() const
+	{
+		ConnectionStats total = mForgottenStats;
+		for (const auto& [key, connection] : mConnections)
+			total += connection.GetStats();
+		return total;
+	}
+
+	void Protocol::SetByteBudget(unsigned bytesPerFlush)
+	{
+		mByteBudget = bytesPerFlush;
+	}
+
+	IoBackendType Protocol::GetIoBackendType() const
+	{
+		return mIo ? mIo->GetType() : IoBackendType::Default;
+	}
+
+	void Protocol::RemovePeer(const sockaddr* _addr)
+	{
+		auto found = mConnections.find(EndpointKey(_addr));
+		if (found == mConnections.end())
+			return;
+
+		//the last messages we queued for it are usually telling it that it is gone, whatever the budget
+		FlushQueue(found->second, found->second.mReliableQueue, true, false);
+		FlushQueue(found->second, found->second.mUnreliableQueue, false, false);
+		mIo->FlushSends();
+
+		mForgottenStats += found->second.mStats;
+		mConnections.erase(found);
+	}
+
+	void Protocol::SetHandshakeRequired(bool required)
+	{
+		mHandshakeRequired = required;
 	}
 	
 }
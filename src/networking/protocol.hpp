@@ -1,5 +1,7 @@
 #pragma once
 #include "networking.hpp"
+#include "io_backend.hpp"
+#include "connection.hpp"
 
 #include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
@@ -7,7 +9,10 @@
 #include <vector>
 #include <queue>
 #include <array>
-#include <list>
+#include <cstddef>
+#include <unordered_map>
+#include <functional>
+#include <span>
 
 #include <tuple>
 
@@ -19,6 +24,13 @@ namespace CS260 {
 	const unsigned tickRate = 16;
 	const unsigned timeOutTimer = 1000;
 
+	//if we have not sent anything to a peer for this long, send an empty packet so it does not time us out
+	const unsigned keepAliveInterval = 200;
+	//peers we have not heard from for this long are forgotten
+	const unsigned peerIdleTimeout = 5000;
+	//endpoints a protocol talks with at most, datagrams from new ones past it are ignored
+	const unsigned MAX_PEERS = 1024;
+
 	enum Packet_Types {
 
 		VoidPacket,
@@ -37,21 +49,50 @@ namespace CS260 {
 		AsteroidDestroy,
 		PlayerDie,
 		BulletCreation,	
-		BulletRequest,
 		BulletDestruction,
-		ScoreUpdate
+		ScoreUpdate,
+		AsteroidSnapshot,
+		SnapshotAck,
+		ShipStates,
+		InputCommands,
+		ServerStats
 	};
 
+	static_assert(Packet_Types::ServerStats < STATS_MESSAGE_TYPES, "the stats are not kept for every message type");
+
 	
 	struct PacketHeader {
 
-		unsigned mSeq;
-		unsigned mAck;
-		bool mNeedsAcknowledgement;
-		Packet_Types mPackType;
+		enum Flags : uint8_t
+		{
+			NeedsAcknowledgement = 1 << 0,
+			//packets only carrying acknowledgements do not consume a sequence number
+			Unsequenced = 1 << 1,
+			//the acknowledgement fields are valid, we had received something from the peer when sending it
+			HasAcks = 1 << 2
+		};
+
+		//wrapping sequence number of this packet, per peer
+		uint16_t mSeq;
+		//newest sequence number we received from the peer
+		uint16_t mAck;
+		//bit i set means we also received mAck - 1 - i
+		uint32_t mAckBits;
+		uint8_t mFlags;
+		//amount of messages packed after the header
+		uint8_t mMessageCount;
 
 	};
 
+	//the header is serialized field by field, so there is no padding on the wire
+	const unsigned PACKET_HEADER_SIZE = 10;
+
+	//every message packed in a datagram is prefixed by its type (1 byte) and its size (2 bytes)
+	const unsigned MESSAGE_HEADER_SIZE = 3;
+
+	// Biggest message that fits in a datagram on its own
+	const unsigned MAX_MESSAGE_SIZE = MAX_DATAGRAM_SIZE - PACKET_HEADER_SIZE - MESSAGE_HEADER_SIZE;
+
 	struct ProtocolPacket
 	{
 		std::array<char, MAX_BUFFER_SIZE > mBuffer;
@@ -85,7 +126,9 @@ namespace CS260 {
 		glm::vec2 pos;
 		float rot;
 		glm::vec2 vel;
+		float rotSpeed; //builds up while turning
 		bool inputPressed; //for particles
+		unsigned short mInputSequence; //last input command of the player the server applied to the ship
 	};
 
 	struct NewPlayerPacket
@@ -99,14 +142,6 @@ namespace CS260 {
 		PlayerInfo mPlayerInfo;
 	}; 
 
-	struct BulletRequestPacket 
-	{
-		glm::vec2 mPos;
-		glm::vec2 mVel;
-		unsigned mOwnerID;
-		float mDir;
-	};
-
 	struct BulletCreationPacket 
 	{
 		unsigned mOwnerID;
@@ -176,6 +211,87 @@ namespace CS260 {
 		unsigned mPlayerID;
 		unsigned CurrentScore;
 	};
+
+	struct SnapshotAckPacket
+	{
+		// Newest snapshot the client received, the server encodes the next ones against it
+		unsigned short mSnapshotID;
+	};
+
+	// Ships in a ship states packet, as many as fit in a message before being bit packed
+	const unsigned MAX_SHIP_STATES = (MAX_MESSAGE_SIZE - 2 * sizeof(unsigned)) / sizeof(PlayerInfo);
+
+	struct ShipStatesPacket
+	{
+		// Milliseconds in the clock of the server when the ships had these states
+		unsigned mTime;
+		// Only the first ones are used, and sent
+		unsigned mCount;
+		PlayerInfo mShips[MAX_SHIP_STATES];
+
+		/**
+		* @brief
+		* Size of the packet with only the used ships
+		*/
+		unsigned GetSize() const { return static_cast<unsigned>(offsetof(ShipStatesPacket, mShips) + mCount * sizeof(PlayerInfo)); }
+	};
+	static_assert(sizeof(ShipStatesPacket) <= MAX_MESSAGE_SIZE, "The ship states have to fit in a message");
+
+	// What the player is pressing, the server moves the ships with it
+	enum InputBits : uint8_t
+	{
+		InputThrust = 1 << 0,
+		InputReverse = 1 << 1,
+		InputLeft = 1 << 2,
+		InputRight = 1 << 3,
+		InputFire = 1 << 4
+	};
+
+	// Longest a single command is simulated for, in milliseconds
+	const unsigned MAX_INPUT_DURATION = 255;
+
+	struct InputCommand
+	{
+		// Consecutive for each player, wrapping
+		unsigned short mSequence;
+		uint8_t mInput;
+		// Milliseconds simulated with the input
+		uint8_t mDuration;
+	};
+
+	// Commands in an input commands packet, the newest ones the server did not apply yet.
+	// Each command is resent in the next packets until the server applies it, so losing some packets loses no input
+	const unsigned MAX_INPUT_COMMANDS = 32;
+
+	struct InputCommandsPacket
+	{
+		// Only the first ones are used, and sent. Their sequences follow the one of the first
+		unsigned mCount;
+		InputCommand mCommands[MAX_INPUT_COMMANDS];
+
+		/**
+		* @brief
+		* Size of the packet with only the used commands
+		*/
+		unsigned GetSize() const { return static_cast<unsigned>(offsetof(InputCommandsPacket, mCommands) + mCount * sizeof(InputCommand)); }
+	};
+
+	// How the server is doing, sent to the clients every so often
+	struct ServerStatsPacket
+	{
+		// Milliseconds since the previous stats, what these cover
+		unsigned mInterval;
+		// Ticks of the server in that time, and the microseconds each one took from Tick to Flush
+		unsigned mTicks;
+		unsigned mTickTimeAverage;
+		unsigned mTickTimeMax;
+		unsigned mPlayers;
+		// Per second, over all the sockets of the server
+		unsigned mPacketsSent;
+		unsigned mPacketsReceived;
+		unsigned mBytesSent;
+		unsigned mBytesReceived;
+	};
 	
 	class Protocol {
 	
@@ -200,30 +316,139 @@ namespace CS260 {
 		
 		/**
 		* @brief
-		* Sends a packet given its type and the content
+		* Queues a packet given its type and the content, it is sent on the next Flush
 		* @param type : type of the packet
 		* @param packet : content of the packet
 		* @param sockaddr : address to send the packet to, if null, sends to the connected endpoint
 		*/
-		void SendPacket(Packet_Types, void* packet, const sockaddr* = nullptr);
+		void SendPacket(Packet_Types, const void* packet, const sockaddr* = nullptr);
+
+		/**
+		* @brief
+		* Queues a packet of a type with variable size, see HasVariableSize
+		* @param size : actual size of the content, at most GetTypeSize of the type
+		*/
+		void SendPacket(Packet_Types, const void* packet, unsigned size, const sockaddr* = nullptr);
+
+		/**
+		* @brief
+		* Queues the same packet for several endpoints. The message is encoded only once and every
+		* endpoint queue references it, so only the datagram headers are built per endpoint
+		* @param type : type of the packet
+		* @param packet : content of the packet
+		* @param endpoints : addresses to send the packet to
+		*/
+		void Broadcast(Packet_Types, const void* packet, std::span<const sockaddr> endpoints);
+
+		/**
+		* @brief
+		* Queues the same packet of variable size for several endpoints, see the one above
+		* @param size : actual size of the content, at most GetTypeSize of the type
+		*/
+		void Broadcast(Packet_Types, const void* packet, unsigned size, std::span<const sockaddr> endpoints);
+
+		/**
+		* @brief
+		* Packs the messages queued for each endpoint into as few datagrams as possible and sends them.
+		* Reliable and unreliable messages go in different datagrams, so only the reliable ones get resent.
+		* Also sends the pending acknowledgements and keeps alive the endpoints we did not send anything to
+		*/
+		void Flush();
 
 		/**
 		* @brief
-		* Receives a packet and fills the information as out parameters
+		* Sends the acknowledgements that have been pending for a whole tick and keeps alive the endpoints
+		* we did not send anything to, without sending the queued messages
+		*/
+		void SendAcknowledgements();
+
+		/**
+		* @brief
+		* Waits until there is something to receive, Wake is called or the timeout expires
+		* @return
+		* Whether there is something to receive
+		*/
+		bool Wait(unsigned timeoutMs);
+
+		/**
+		* @brief
+		* Makes the current or the next Wait return early, can be called from another thread
+		*/
+		void Wake();
+
+		/**
+		* @brief
+		* Receives a packet and fills the information as out parameters.
+		* The messages of a datagram are returned one per call before reading the next datagram
 		* @param _payload : out parameter for the actual packet contentes
 		* @param _size : out parameter for the size of the pacekt
 		* @param _type : out parameter for the type of the packet
 		* @param _addr : optional out parameter for the endpoint of the sender of the packet
+		* @return
+		* False when there is nothing left to receive
 		*/
 		bool ReceivePacket(void* _payload, unsigned* _size, Packet_Types* _type, sockaddr* _addr = nullptr);
 		
 		/**
 		* @brief
-		* Socket settor to know with which socket the protocol is working with
+		* Socket settor to know with which socket the protocol is working with, creating the backend used for its I/O
+		* @param type : backend to use, the preferred one by default
 		*/
-		void SetSocket(SOCKET);
-		
-	private:
+		void SetSocket(SOCKET, IoBackendType type = IoBackendType::Default);
+
+		/**
+		* @brief
+		* Sets the function called when a reliable message could not be delivered after all the resend tries,
+		* or was still unacknowledged when its endpoint was forgotten for being idle
+		* @param callback : receives the endpoint the message was sent to (null for the connected one) and its type
+		*/
+		void SetDeliveryFailedCallback(std::function<void(const sockaddr*, Packet_Types)> callback);
+
+		/**
+		* @brief
+		* Smoothed round trip time to the given endpoint, 0 if still unknown
+		*/
+		float GetRtt(const sockaddr* = nullptr) const;
+
+		/**
+		* @brief
+		* Counters of the connection with the given endpoint, all 0 if we are not talking with it
+		*/
+		ConnectionStats GetStats(const sockaddr* = nullptr) const;
+
+		/**
+		* @brief
+		* Counters of every connection since the protocol was created, the forgotten ones included
+		*/
+		ConnectionStats GetTotalStats() const;
+
+		/**
+		* @brief
+		* Limits the bytes sent to each endpoint on every flush, 0 for no limit. The reliable messages that do not fit
+		* wait for the next flush in the order they were queued, the unreliable ones are dropped.
+		* Going over the budget with the last datagram is paid back on the next flush
+		*/
+		void SetByteBudget(unsigned bytesPerFlush);
+
+		/**
+		* @brief
+		* Backend actually used for the socket, it may differ from the requested one if that one is not available
+		*/
+		IoBackendType GetIoBackendType() const;
+
+		/**
+		* @brief
+		* Forgets everything about an endpoint, including the messages still waiting for its acknowledgement.
+		* The messages queued for it are sent before
+		*/
+		void RemovePeer(const sockaddr* = nullptr);
+
+		/**
+		* @brief
+		* Only lets a new endpoint in with a datagram starting with a SYN, anything else from an endpoint we are not
+		* talking with is ignored without acknowledging it. For listening sockets, so stray or spoofed datagrams do not create connections
+		*/
+		void SetHandshakeRequired(bool required);
 
 		/**
 		* @brief
@@ -232,23 +457,119 @@ namespace CS260 {
 		* @return
 		* The size of that kind of packet
 		*/
-		unsigned GetTypeSize(Packet_Types type, bool* needsACK = nullptr);
-		
-		//actual sequence number of the protocol for when sending packets
-		unsigned mSequenceNumber;
+		static unsigned GetTypeSize(Packet_Types type, bool* needsACK = nullptr);
+
+		/**
+		* @brief
+		* Whether the packets of a type can be smaller than GetTypeSize, which is then their maximum size
+		*/
+		static bool HasVariableSize(Packet_Types type);
+
+		/**
+		* @brief
+		* Name of a type as it is written in Packet_Types, "Unknown" if it is not one
+		*/
+		static const char* GetTypeName(Packet_Types type);
 		
-		//messages we have sent but have not been acknowledged, we store the message, the time we have sent it ago, and to who we have sent it
-		std::vector<std::tuple<std::array<char, 8192>, unsigned, const sockaddr*>> mUnacknowledgedMessages;
+	private:
+
+		/**
+		* @brief
+		* Finds the connection of an endpoint, creating it the first time
+		*/
+		Connection& GetConnection(const sockaddr* addr);
+
+		/**
+		* @brief
+		* Whether a datagram from an endpoint we are not talking with can start a connection, see SetHandshakeRequired and MAX_PEERS
+		*/
+		bool AcceptsNewPeer(const PacketHeader& header, unsigned size) const;
+
+		/**
+		* @brief
+		* Writes the acknowledgement fields for the given connection into an already serialized header
+		*/
+		void WriteAcks(Connection& connection, char* buffer);
+
+		/**
+		* @brief
+		* Sends an already serialized datagram through the connection
+		*/
+		void SendRaw(Connection& connection, const char* data, unsigned size);
+
+		/**
+		* @brief
+		* Packs the given queue of the connection into datagrams and sends them
+		* @param budgeted : whether to stop once the connection runs out of byte allowance
+		* @return
+		* The amount of messages sent from the start of the queue, the caller removes them
+		*/
+		unsigned FlushQueue(Connection& connection, std::vector<QueuedMessage>& queue, bool reliable, bool budgeted);
+
+		/**
+		* @brief
+		* Keeps the reliable messages that did not fit in the budget for the next flush, moving their bytes to the connection
+		*/
+		void DeferReliable(Connection& connection, unsigned sent);
+
+		/**
+		* @brief
+		* Writes the header of a packed datagram, sends it and keeps it for resending if it is reliable
+		*/
+		void SendDatagram(Connection& connection, char* data, unsigned size, uint8_t messageCount, bool reliable);
+
+		/**
+		* @brief
+		* Adds an encoded message to the stats of its type
+		* @param size : bytes of the message, its type and size prefix included
+		*/
+		void CountMessage(Connection& connection, const char* message, unsigned size, bool sent);
+
+		/**
+		* @brief
+		* Reads the next datagram from the socket and processes its header
+		* @return
+		* False if there was nothing to read
+		*/
+		bool ReceiveDatagram(sockaddr* _addr);
+
+		/**
+		* @brief
+		* Removes from the window the messages acknowledged by a received header
+		*/
+		void ProcessAcks(Connection& connection, const PacketHeader& header);
 
 		//socket we are working with
 		SOCKET mSocket;
 
-		//time to resend an unacknowledged message
-		const unsigned mResendTime = 300;
+		//sends and receives the datagrams of the socket, batching the system calls when the platform allows it
+		std::unique_ptr<IoBackend> mIo;
+
+		//every endpoint we are talking with by its address and port, the connected one has key 0
+		std::unordered_map<uint64_t, Connection> mConnections;
+
+		//counters of the connections that were already forgotten
+		ConnectionStats mForgottenStats;
+
+		//called when we give up resending a message
+		std::function<void(const sockaddr*, Packet_Types)> mDeliveryFailedCallback;
+
+		//messages broadcast since the last flush, encoded once for all their endpoints
+		std::vector<char> mBroadcastBytes;
+
+		//bytes each connection can send per flush, 0 for no limit
+		unsigned mByteBudget;
+
+		//new endpoints have to start with a SYN
+		bool mHandshakeRequired;
 
-		const unsigned tickRate = 16;
+		//where the deferred messages are moved before becoming the queued bytes of their connection
+		std::vector<char> mDeferredBytes;
 
-		//to not handle the same message twice, we store the last 100 messages we received, to check against them
-		std::list<unsigned> mLast100AckMessages{};
+		//last datagram received, owned by the backend, its messages are returned one by one from the offset
+		const char* mReceiveData;
+		unsigned mReceiveSize;
+		unsigned mReceiveOffset;
+		sockaddr mReceiveAddress;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace CS260 {
+
+	/**
+	* @brief
+	* Amount of bits needed to store every integer from 0 to maxValue
+	*/
+	inline unsigned BitsRequired(uint32_t maxValue)
+	{
+		unsigned bits = 0;
+		while (bits < 32 && (maxValue >> bits) != 0)
+			bits++;
+		return bits;
+	}
+
+	/**
+	* @brief
+	* Biggest quantized value of a float in [min, max) with the given resolution.
+	* A range that is a power of two times the resolution uses all the bits it needs
+	*/
+	inline uint32_t QuantizedMax(float min, float max, float resolution)
+	{
+		return static_cast<uint32_t>(std::ceil((max - min) / resolution)) - 1;
+	}
+
+	/**
+	* @brief
+	* Maps a float, clamped to [min, max), to the closest step of the given resolution
+	*/
+	inline uint32_t QuantizeFloat(float value, float min, float max, float resolution)
+	{
+		float clamped = std::clamp(value, min, max);
+		return std::min(static_cast<uint32_t>(std::lround((clamped - min) / resolution)), QuantizedMax(min, max, resolution));
+	}
+
+	/**
+	* @brief
+	* Inverse of QuantizeFloat
+	*/
+	inline float DequantizeFloat(uint32_t quantized, float min, float max, float resolution)
+	{
+		return min + static_cast<float>(std::min(quantized, QuantizedMax(min, max, resolution))) * resolution;
+	}
+
+	/**
+	* @brief
+	* Value a float has after being quantized and dequantized, what the other side reads
+	*/
+	inline float QuantizeRoundTrip(float value, float min, float max, float resolution)
+	{
+		return DequantizeFloat(QuantizeFloat(value, min, max, resolution), min, max, resolution);
+	}
+
+	/**
+	* @brief
+	* Maps an angle in radians, of any turn, to one of the 2^bits steps of a whole turn
+	*/
+	inline uint32_t QuantizeAngle(float radians, unsigned bits)
+	{
+		const float turn = 6.28318530718f;
+		float normalized = radians / turn - std::floor(radians / turn);
+		uint32_t steps = 1u << bits;
+		return static_cast<uint32_t>(std::lround(normalized * steps)) & (steps - 1);
+	}
+
+	/**
+	* @brief
+	* Inverse of QuantizeAngle, the result is in [-PI, PI)
+	*/
+	inline float DequantizeAngle(uint32_t quantized, unsigned bits)
+	{
+		const float turn = 6.28318530718f;
+		float radians = static_cast<float>(quantized) / static_cast<float>(1u << bits) * turn;
+		return radians >= turn * 0.5f ? radians - turn : radians;
+	}
+}
@@ -0,0 +1,28 @@
+#include "relevance.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace CS260
+{
+	float RelevanceScore(glm::vec2 viewer, glm::vec2 viewExtents, glm::vec2 position)
+	{
+		if (viewExtents.x <= 0.0f || viewExtents.y <= 0.0f)
+			return 1.0f;
+
+		//distance outside of the view, in view sizes along the axis it is furthest on
+		float outside = std::max(std::abs(position.x - viewer.x) / viewExtents.x, std::abs(position.y - viewer.y) / viewExtents.y) - 1.0f;
+		if (outside <= 0.0f)
+			return 1.0f;
+		return std::max(0.0f, 1.0f - outside / RELEVANCE_FADE);
+	}
+
+	Relevance ClassifyRelevance(float score)
+	{
+		if (score >= 1.0f)
+			return Relevance::Full;
+		if (score > 0.0f)
+			return Relevance::Reduced;
+		return Relevance::None;
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace CS260 {
+
+	// How far past the edges of the view an entity is still replicated at a reduced rate, in view sizes
+	const float RELEVANCE_FADE = 0.5f;
+
+	// An entity of reduced relevance gets one of every RELEVANCE_REDUCED_INTERVAL updates
+	const unsigned RELEVANCE_REDUCED_INTERVAL = 4;
+
+	// How a client gets the updates of an entity
+	enum class Relevance
+	{
+		None,    // Not replicated, the client keeps the last state it got
+		Reduced, // One of every RELEVANCE_REDUCED_INTERVAL updates
+		Full     // Every update
+	};
+
+	/**
+	* @brief
+	* Scores how much an entity matters to a client by its distance to the view around the ship of the client:
+	* 1 inside the view, fading to 0 at RELEVANCE_FADE view sizes outside of it
+	* @param viewer : position of the ship of the client, the center of its view
+	* @param viewExtents : half the size of the view, zero for no view bounds, where everything scores 1
+	*/
+	float RelevanceScore(glm::vec2 viewer, glm::vec2 viewExtents, glm::vec2 position);
+
+	/**
+	* @brief
+	* Relevance of an entity with the given score
+	*/
+	Relevance ClassifyRelevance(float score);
+}
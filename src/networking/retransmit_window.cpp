@@ -0,0 +1,142 @@
+#include "retransmit_window.hpp"
+
+#include <cstring>
+
+namespace CS260
+{
+	RetransmitWindow::RetransmitWindow() :
+		mOrderFront(0),
+		mOrderBack(0),
+		mSlab(RETRANSMIT_SLAB_SIZE),
+		mHead(0),
+		mTail(0),
+		mCount(0)
+	{
+	}
+
+	void RetransmitWindow::Insert(unsigned seq, const char* data, unsigned size, const sockaddr* addr, clock_t::time_point deadline)
+	{
+		Entry& entry = mEntries[seq & (RETRANSMIT_WINDOW_SIZE - 1)];
+
+		//a whole window of messages went by and this one was never acknowledged, drop it
+		if (entry.mInUse)
+		{
+			entry.mInUse = false;
+			mCount--;
+		}
+
+		//the insertion order is full too, so make room for the new one
+		if (mOrderBack - mOrderFront == RETRANSMIT_WINDOW_SIZE)
+			EvictOldest();
+
+		unsigned offset = Allocate(size);
+		memcpy(mSlab.data() + offset, data, size);
+		mHead = offset + size;
+
+		entry.mSeq = seq;
+		entry.mOffset = offset;
+		entry.mSize = size;
+		entry.mSentTime = now();
+		entry.mDeadline = deadline;
+		entry.mTries = 0;
+		entry.mInUse = true;
+		entry.mHasAddress = addr != nullptr;
+		if (addr)
+			entry.mAddress = *addr;
+
+		mOrder[mOrderBack++ & (RETRANSMIT_WINDOW_SIZE - 1)] = seq;
+		mCount++;
+	}
+
+	bool RetransmitWindow::Acknowledge(unsigned seq, Entry* acked)
+	{
+		Entry& entry = mEntries[seq & (RETRANSMIT_WINDOW_SIZE - 1)];
+
+		//either it was already acknowledged or the slot belongs to another message
+		if (!entry.mInUse || entry.mSeq != seq)
+			return false;
+
+		if (acked)
+			*acked = entry;
+
+		entry.mInUse = false;
+		mCount--;
+
+		Reclaim();
+		return true;
+	}
+
+	unsigned RetransmitWindow::Count() const
+	{
+		return mCount;
+	}
+
+	unsigned RetransmitWindow::Allocate(unsigned size)
+	{
+		while (true)
+		{
+			//nothing pending, the whole slab is free
+			if (mOrderFront == mOrderBack)
+			{
+				mHead = 0;
+				mTail = 0;
+				return 0;
+			}
+
+			//the used bytes are [tail, head), so there is room at the end and at the start
+			if (mHead >= mTail)
+			{
+				if (size <= RETRANSMIT_SLAB_SIZE - mHead)
+					return mHead;
+				if (size < mTail)
+					return 0;
+			}
+			//the used bytes wrapped around, the only room is between head and tail
+			else if (mHead + size < mTail)
+			{
+				return mHead;
+			}
+
+			EvictOldest();
+		}
+	}
+
+	void RetransmitWindow::Reclaim()
+	{
+		while (mOrderFront != mOrderBack)
+		{
+			unsigned seq = mOrder[mOrderFront & (RETRANSMIT_WINDOW_SIZE - 1)];
+			const Entry& entry = mEntries[seq & (RETRANSMIT_WINDOW_SIZE - 1)];
+
+			//the oldest message is still pending, its bytes are where the used region starts
+			if (entry.mInUse && entry.mSeq == seq)
+			{
+				mTail = entry.mOffset;
+				return;
+			}
+			mOrderFront++;
+		}
+
+		//everything was acknowledged
+		mHead = 0;
+		mTail = 0;
+	}
+
+	void RetransmitWindow::EvictOldest()
+	{
+		if (mOrderFront == mOrderBack)
+			return;
+
+		unsigned seq = mOrder[mOrderFront & (RETRANSMIT_WINDOW_SIZE - 1)];
+		Entry& entry = mEntries[seq & (RETRANSMIT_WINDOW_SIZE - 1)];
+
+		if (entry.mInUse && entry.mSeq == seq)
+		{
+			entry.mInUse = false;
+			mCount--;
+		}
+		mOrderFront++;
+
+		Reclaim();
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include "networking.hpp"
+#include "utils.hpp"
+
+#include <array>
+#include <vector>
+
+namespace CS260 {
+
+	// Amount of unacknowledged messages that can be tracked at the same time for a peer, must be a power of two
+	const unsigned RETRANSMIT_WINDOW_SIZE = 256;
+
+	// Bytes reserved for the serialized messages waiting for an acknowledgement of a peer
+	const unsigned RETRANSMIT_SLAB_SIZE = 64 * 1024;
+
+	class RetransmitWindow {
+
+	public:
+		struct Entry
+		{
+			unsigned mSeq;
+			unsigned mOffset;
+			unsigned mSize;
+			//when we first sent it, to measure the round trip time
+			clock_t::time_point mSentTime;
+			//when we have to resend it if the acknowledgement has not arrived
+			clock_t::time_point mDeadline;
+			//how many times we have resent it
+			unsigned mTries;
+			bool mInUse;
+			//if there is no address, it was sent to the connected endpoint
+			bool mHasAddress;
+			sockaddr mAddress;
+		};
+
+		/**
+		* @brief
+		*  Constructs an empty window, the slab is allocated once here
+		*/
+		RetransmitWindow();
+
+		/**
+		* @brief
+		* Stores a copy of the exact bytes of a sent datagram until it gets acknowledged.
+		* If there is no room left, the oldest messages are dropped to make space for it
+		* @param seq : sequence number of the datagram
+		* @param data : serialized datagram (header + payload)
+		* @param size : actual size of the datagram
+		* @param addr : endpoint the datagram was sent to, null for the connected one
+		* @param deadline : time at which the datagram has to be resent
+		*/
+		void Insert(unsigned seq, const char* data, unsigned size, const sockaddr* addr, clock_t::time_point deadline);
+
+		/**
+		* @brief
+		* Removes the message with the given sequence number
+		* @param acked : optional out parameter for the information of the removed message
+		* @return
+		* Whether the message was still waiting for the acknowledgement
+		*/
+		bool Acknowledge(unsigned seq, Entry* acked = nullptr);
+
+		/**
+		* @brief
+		* Calls the given function with every pending message, from oldest to newest.
+		* The bytes are writable so the header can be refreshed before resending
+		*/
+		template <typename Fn>
+		void ForEach(Fn&& fn)
+		{
+			for (unsigned i = mOrderFront; i != mOrderBack; ++i)
+			{
+				Entry& entry = mEntries[mOrder[i & (RETRANSMIT_WINDOW_SIZE - 1)] & (RETRANSMIT_WINDOW_SIZE - 1)];
+				if (entry.mInUse && entry.mSeq == mOrder[i & (RETRANSMIT_WINDOW_SIZE - 1)])
+					fn(entry, mSlab.data() + entry.mOffset);
+			}
+		}
+
+		/**
+		* @brief
+		* Amount of messages waiting for an acknowledgement
+		*/
+		unsigned Count() const;
+
+	private:
+
+		/**
+		* @brief
+		* Finds room for a message of the given size in the slab, evicting the oldest messages if needed
+		* @return
+		* Offset in the slab where the message can be written
+		*/
+		unsigned Allocate(unsigned size);
+
+		/**
+		* @brief
+		* Pops the already released messages from the front of the insertion order, reclaiming their bytes
+		*/
+		void Reclaim();
+
+		/**
+		* @brief
+		* Drops the oldest pending message
+		*/
+		void EvictOldest();
+
+		//messages indexed by sequence number
+		std::array<Entry, RETRANSMIT_WINDOW_SIZE> mEntries{};
+
+		//sequence numbers in the order they were inserted, used to reclaim the slab as a ring
+		std::array<unsigned, RETRANSMIT_WINDOW_SIZE> mOrder{};
+		unsigned mOrderFront;
+		unsigned mOrderBack;
+
+		//exact serialized bytes of the pending messages
+		std::vector<char> mSlab;
+		unsigned mHead;
+		unsigned mTail;
+
+		unsigned mCount;
+	};
+}
@@ -0,0 +1,50 @@
+#include "rtt_estimator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace CS260
+{
+	RttEstimator::RttEstimator() :
+		mHasSamples(false),
+		mSmoothedRtt(0.0f),
+		mRttVariation(0.0f),
+		mTimeout(INITIAL_RTO)
+	{
+	}
+
+	void RttEstimator::AddSample(float rttMs)
+	{
+		if (!mHasSamples)
+		{
+			//first measurement, take it as is
+			mSmoothedRtt = rttMs;
+			mRttVariation = rttMs * 0.5f;
+			mHasSamples = true;
+		}
+		else
+		{
+			//alpha = 1/8, beta = 1/4
+			mRttVariation = 0.75f * mRttVariation + 0.25f * std::fabs(mSmoothedRtt - rttMs);
+			mSmoothedRtt = 0.875f * mSmoothedRtt + 0.125f * rttMs;
+		}
+
+		mTimeout = std::clamp(mSmoothedRtt + 4.0f * mRttVariation, MIN_RTO, MAX_RTO);
+	}
+
+	float RttEstimator::GetTimeout(unsigned tries) const
+	{
+		//exponential backoff, capped so that a long outage does not make us wait forever
+		return std::min(mTimeout * static_cast<float>(1u << std::min(tries, 16u)), MAX_RTO);
+	}
+
+	float RttEstimator::GetRtt() const
+	{
+		return mSmoothedRtt;
+	}
+
+	float RttEstimator::GetRttVariation() const
+	{
+		return mRttVariation;
+	}
+}
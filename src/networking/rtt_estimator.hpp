@@ -0,0 +1,54 @@
+#pragma once
+
+namespace CS260 {
+
+	//retransmission timeout used until we have the first round trip sample of a peer
+	const float INITIAL_RTO = 300.0f;
+	const float MIN_RTO = 50.0f;
+	const float MAX_RTO = 2000.0f;
+
+	//amount of times a message is resent before giving up on it
+	const unsigned MAX_RESEND_TRIES = 8;
+
+	class RttEstimator {
+
+	public:
+		/**
+		* @brief
+		*  Constructs an estimator without samples, using the initial timeout
+		*/
+		RttEstimator();
+
+		/**
+		* @brief
+		* Feeds a new round trip measurement, smoothing it the same way TCP does (RFC 6298)
+		* @param rttMs : time between sending a message and receiving its acknowledgement
+		*/
+		void AddSample(float rttMs);
+
+		/**
+		* @brief
+		* Timeout to wait for an acknowledgement before resending a message
+		* @param tries : how many times the message was already resent, the timeout doubles each time
+		*/
+		float GetTimeout(unsigned tries = 0) const;
+
+		/**
+		* @brief
+		* Smoothed round trip time, 0 if there are no samples yet
+		*/
+		float GetRtt() const;
+
+		/**
+		* @brief
+		* Smoothed round trip time variation
+		*/
+		float GetRttVariation() const;
+
+	private:
+		bool mHasSamples;
+		float mSmoothedRtt;
+		float mRttVariation;
+		float mTimeout;
+	};
+}
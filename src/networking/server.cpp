@@ -15,10 +15,23 @@
 
 #include "utils.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 namespace CS260
 {
-	ClientInfo::ClientInfo(sockaddr endpoint, PlayerInfo playerInfo, glm::vec4 col):
+	namespace
+	{
+		unsigned sShardCount = 1;
+		glm::vec2 sViewExtents = { 0, 0 };
+		unsigned sClientByteBudget = 0;
+		unsigned sShipStatesInterval = 50;
+		unsigned sStatsInterval = 0;
+	}
+
+	ClientInfo::ClientInfo(sockaddr endpoint, PlayerInfo playerInfo, glm::vec4 col, unsigned shard):
 		mEndpoint(endpoint),
+		mShard(shard),
 		mAliveTimer(0),
 		mDisconnecting(false),
 		mDisconnectTimeout(0),
@@ -26,84 +39,190 @@ namespace CS260
 		mPlayerInfo(playerInfo),
 		color(col),
 		mDead(false),
-		mRemainingLifes(3)
+		mRemainingLifes(3),
+		mAckedSnapshot(0),
+		mHasAckedSnapshot(false),
+		mLastInput(0),
+		mHasInput(false),
+		mInputTime(maxInputTimeAhead)
 	{
 	}
 
 	Server::Server(bool verbose, const std::string& ip_address, uint16_t port) :
-	mVerbose(verbose)
+	mVerbose(verbose),
+	mReceivingShard(0),
+	mUpdateAsteroidsTimer(0),
+	mUpdateShipsTimer(0),
+	mShipStatesCount(0),
+	mSnapshotID(0),
+	mStartTime(now()),
+	mInputClock(mStartTime),
+	mStatsStart(mStartTime),
+	mTickStart(mStartTime),
+	mStatsTicks(0),
+	mTickTimeTotal(0),
+	mTickTimeMax(0)
 	{
 		mCurrentID = rand() % 255 + 1;
-		// Create UDP socket for the Server
-		mSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-
-		if (mSocket == INVALID_SOCKET)
-		{
-			CS260::NetworkDestroy();
-			PrintError("Creating server socket");
-			throw std::runtime_error("Error creating server socket");
-		}
-		else
-			PrintMessage("Created socket successfully.");
 
 		mEndpoint.sin_family = AF_INET;
 		mEndpoint.sin_addr = CS260::ToIpv4(ip_address);
 		mEndpoint.sin_port = htons(port);
 
-		// Bind the server socket
-		if (bind(mSocket, reinterpret_cast<sockaddr*>(&mEndpoint), sizeof(mEndpoint)) == SOCKET_ERROR)
+		unsigned shardCount = sShardCount;
+		while (mShards.size() < shardCount)
 		{
-			closesocket(mSocket);
-			CS260::NetworkDestroy();
-			PrintError("Binding socket");
-			throw std::runtime_error("Error binding server socket");
+			// Create UDP socket for the Server
+			SOCKET shardSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+			if (shardSocket == INVALID_SOCKET)
+			{
+				for (auto& shard : mShards)
+					closesocket(shard->mSocket);
+				CS260::NetworkDestroy();
+				PrintError("Creating server socket");
+				throw std::runtime_error("Error creating server socket");
+			}
+			else
+				PrintMessage("Created socket successfully.");
+
+			// Every shard binds the same port, the kernel hashes each client to one of them
+			if (shardCount > 1 && !SetSocketReusePort(shardSocket))
+			{
+				PrintMessage("SO_REUSEPORT is not available, using a single socket.");
+				shardCount = 1;
+			}
+
+			// Bind the server socket
+			if (bind(shardSocket, reinterpret_cast<sockaddr*>(&mEndpoint), sizeof(mEndpoint)) == SOCKET_ERROR)
+			{
+				closesocket(shardSocket);
+				for (auto& shard : mShards)
+					closesocket(shard->mSocket);
+				CS260::NetworkDestroy();
+				PrintError("Binding socket");
+				throw std::runtime_error("Error binding server socket");
+			}
+			else
+				PrintMessage("Bound socket.");
+
+			// If the system chose the port, the rest of the shards have to use the same one
+			socklen_t endpointSize = sizeof(mEndpoint);
+			getsockname(shardSocket, reinterpret_cast<sockaddr*>(&mEndpoint), &endpointSize);
+
+			SetSocketBlocking(shardSocket, false);
+
+			mShards.push_back(std::make_unique<ServerShard>());
+			mShards.back()->mSocket = shardSocket;
+			mShards.back()->mClientEndpoints = std::make_shared<const std::vector<sockaddr>>();
 		}
-		else
-			PrintMessage("Bound socket.");
 
-		SetSocketBlocking(mSocket, false);
+		// The network threads start working right away
+		for (auto& shard : mShards)
+		{
+			shard->mNetwork.SetByteBudget(sClientByteBudget);
+			shard->mNetwork.SetHandshakeRequired(true);
+			shard->mNetwork.SetDeliveryFailedCallback([this](const sockaddr* endpoint, Packet_Types type) { HandleDeliveryFailed(endpoint, type); });
+			shard->mNetwork.Start(shard->mSocket);
+		}
 
-		mProtocol.SetSocket(mSocket);
+		if (mShards.size() > 1)
+			PrintMessage("Receiving with " + std::to_string(mShards.size()) + " sockets.");
 
 		srand(static_cast<unsigned int>(time(0)));
 	}
 
 	Server::~Server()
 	{
-		closesocket(mSocket);
+		// The network threads have to stop using the sockets first
+		for (auto& shard : mShards)
+			shard->mNetwork.Stop();
+		for (auto& shard : mShards)
+			closesocket(shard->mSocket);
 	}
 
-	void Server::Tick()
+	void Server::SetShardCount(unsigned count)
 	{
+		sShardCount = count > 0 ? count : 1;
+	}
+
+	void Server::SetViewExtents(glm::vec2 halfExtents)
+	{
+		sViewExtents = halfExtents;
+	}
+
+	void Server::SetClientByteBudget(unsigned bytesPerTick)
+	{
+		sClientByteBudget = bytesPerTick;
+	}
+
+	void Server::SetShipStatesInterval(unsigned milliseconds)
+	{
+		sShipStatesInterval = milliseconds;
+	}
+
+	void Server::SetStatsInterval(unsigned milliseconds)
+	{
+		sStatsInterval = milliseconds;
+	}
+
+	void Server::Tick(unsigned ticks)
+	{
+		mTickStart = now();
+
 		// Update the timer that updates the asteroids
 		// Below, when needed it will send the current state of the asteroids to the clients
-		mUpdateAsteroidsTimer += tickRate;
+		mUpdateAsteroidsTimer += tickRate * ticks;
+		mUpdateShipsTimer += tickRate * ticks;
 		
+		// The input time of the clients grows with the clock, whatever the ticks, the rest of a millisecond is kept for the next tick
+		auto inputElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(mTickStart - mInputClock);
+		mInputClock += inputElapsed;
+
 		// Update Keep alive timer
 		for (auto& client : mClients)
-			client.mAliveTimer += tickRate;
+		{
+			client.mAliveTimer += tickRate * ticks;
+			client.mInputTime = static_cast<unsigned>(std::min<long long>(client.mInputTime + inputElapsed.count(), maxInputTimeAhead));
+		}
 		
 		// Clear all the vectors that are used to send data to the clients
 		// To fill them again if needed below
 		mNewPlayersOnFrame.clear();
 		mDisconnectedPlayersIDs.clear();
-		mBulletsToCreate.clear();
+		mInputsOnFrame.clear();
 
 		
 		// Handle all the receive packets
 		ReceivePackets();
 
-		// Resend unacknowledged messages if necessary
-		mProtocol.Tick();
-		
-		// This is to avoid having the clients disconnecting while they are playing by their own
-		SendVoidPackets();
+		// Resend unacknowledged messages if necessary, when threaded the network threads already do it
+		for (auto& shard : mShards)
+			shard->mNetwork.Tick();
 
 		// Disconnect players if their timer runs out
 		CheckTimeoutPlayer();
 
 		// Handle save disconnection with clients
 		HandleDisconnection();
+
+		// Clients are only added and removed during the tick, so broadcasts until the next one use this list
+		UpdateClientEndpoints();
+	}
+
+	void Server::Flush()
+	{
+		unsigned tickTime = static_cast<unsigned>(std::chrono::duration_cast<std::chrono::microseconds>(now() - mTickStart).count());
+		mStatsTicks++;
+		mTickTimeTotal += tickTime;
+		mTickTimeMax = std::max(mTickTimeMax, tickTime);
+
+		if (sStatsInterval > 0 && ms_since(mStatsStart) >= sStatsInterval)
+			SendServerStats();
+
+		// The protocol also sends the pending acknowledgements and keeps the clients alive if we did not send them anything
+		for (auto& shard : mShards)
+			shard->mNetwork.Flush();
 	}
 
 	int Server::PlayerCount()
@@ -111,6 +230,14 @@ namespace CS260
 		return static_cast<int>(mClients.size());
 	}
 
+	ConnectionStats Server::GetNetworkStats()
+	{
+		ConnectionStats totals;
+		for (auto& shard : mShards)
+			totals += shard->mNetwork.GetTotalStats();
+		return totals;
+	}
+
 	const std::vector<NewPlayerPacket>& Server::GetNewPlayers()
 	{
 		return mNewPlayersOnFrame;
@@ -126,16 +253,60 @@ namespace CS260
 		return mDisconnectedPlayersIDs;
 	}
 
-	const std::vector<BulletRequestPacket>& Server::GetBulletsToCreate()
+	const std::vector<PlayerInput>& Server::GetPlayerInputs()
 	{
-		return mBulletsToCreate;
+		return mInputsOnFrame;
 	}
 
-	void Server::SendPlayerInfo(sockaddr _endpoint, PlayerInfo _playerinfo)
+	void Server::SendShipStates(const std::vector<PlayerInfo>& ships)
 	{
-		ShipUpdatePacket mPacket;
-		mPacket.mPlayerInfo = _playerinfo;
-		mProtocol.SendPacket(Packet_Types::ShipPacket, &mPacket, &_endpoint);
+		// The ship of each client is where its view is
+		for (auto& ship : ships)
+		{
+			if (ClientInfo* client = FindClientByID(ship.mID))
+				client->mPlayerInfo = ship;
+		}
+
+		// The clients interpolate between the states, so they do not need one every tick
+		if (mUpdateShipsTimer < sShipStatesInterval)
+			return;
+		mUpdateShipsTimer = sShipStatesInterval ? mUpdateShipsTimer - sShipStatesInterval : 0;
+		mShipStatesCount++;
+		mShipStates.mTime = ms_since(mStartTime);
+
+		// Everything is relevant to everyone, so every client gets the same packets, encoded once
+		if (sViewExtents.x <= 0.0f || sViewExtents.y <= 0.0f)
+		{
+			for (size_t first = 0; first < ships.size(); first += MAX_SHIP_STATES)
+			{
+				mShipStates.mCount = static_cast<unsigned>(std::min<size_t>(ships.size() - first, MAX_SHIP_STATES));
+				std::copy_n(ships.begin() + first, mShipStates.mCount, mShipStates.mShips);
+				BroadcastToClients(Packet_Types::ShipStates, &mShipStates, mShipStates.GetSize());
+			}
+			return;
+		}
+
+		// Otherwise each client gets the ships it has to know about
+		for (auto& client : mClients)
+		{
+			auto& network = mShards[client.mShard]->mNetwork;
+			mShipStates.mCount = 0;
+			for (auto& ship : ships)
+			{
+				// Its own ship is always sent, it tells the client which of its inputs were applied
+				if (ship.mID != client.mPlayerInfo.mID && !ShouldSendShip(client, ship))
+					continue;
+
+				mShipStates.mShips[mShipStates.mCount++] = ship;
+				if (mShipStates.mCount == MAX_SHIP_STATES)
+				{
+					network.SendPacket(Packet_Types::ShipStates, &mShipStates, mShipStates.GetSize(), &client.mEndpoint);
+					mShipStates.mCount = 0;
+				}
+			}
+			if (mShipStates.mCount)
+				network.SendPacket(Packet_Types::ShipStates, &mShipStates, mShipStates.GetSize(), &client.mEndpoint);
+		}
 	}
 
 	void Server::SendAsteroidCreation(unsigned short id, glm::vec2 position, glm::vec2 velocity, float scale, float angle)
@@ -149,8 +320,7 @@ namespace CS260
 		packet.mVelocity = velocity;
 
 		// Send the packet to all clients safely, the protocol will take care of it
-		for (auto& client : mClients)
-			mProtocol.SendPacket(Packet_Types::AsteroidCreation, &packet, &client.mEndpoint);
+		BroadcastToClients(Packet_Types::AsteroidCreation, &packet);
 		
 		// Insert the current asteroid information in the server copy of the alive asteroids list
 		mAliveAsteroids.push_back(packet);
@@ -176,28 +346,49 @@ namespace CS260
 		packet.mPosition = pos;
 		packet.mVelocity = vel;
 
-		for (auto& client : mClients)
-			mProtocol.SendPacket(Packet_Types::AsteroidUpdate, &packet, &client.mEndpoint);
+		SendToRelevantClients(Packet_Types::AsteroidUpdate, &packet, pos);
 	}
 
 	void Server::SendAsteroidsUpdate()
 	{
 		// The timer updated in the tick function will be used in here
-		if (mUpdateAsteroidsTimer > updateAsteroids)
+		if (mUpdateAsteroidsTimer < snapshotInterval)
+			return;
+		// Keep the remainder, so on average there is one snapshot every interval even if it is not a multiple of the tick
+		mUpdateAsteroidsTimer -= snapshotInterval;
+
+		mSnapshot.mID = mSnapshotID++;
+		mSnapshot.mTime = ms_since(mStartTime);
+		mSnapshot.mAsteroids.clear();
+		for (auto& asteroid : mAliveAsteroids)
+			mSnapshot.mAsteroids.push_back({ asteroid.mObjectID, asteroid.mPosition, asteroid.mVelocity });
+		std::sort(mSnapshot.mAsteroids.begin(), mSnapshot.mAsteroids.end(), [](const AsteroidUpdatePacket& a, const AsteroidUpdatePacket& b) { return a.mID < b.mID; });
+
+		// The asteroids steer toward the ships, the clients dead reckon them with these
+		mSnapshot.mShips.clear();
+		for (auto& client : mClients)
+			mSnapshot.mShips.push_back(client.mPlayerInfo.pos);
+
+		// With a budget, a snapshot takes its share and what does not fit goes by priority.
+		// The header and the ships always go, however small the budget
+		std::array<char, MAX_MESSAGE_SIZE> buffer;
+		unsigned capacity = static_cast<unsigned>(buffer.size());
+		if (sClientByteBudget)
+			capacity = std::min(capacity, std::max(static_cast<unsigned>(sClientByteBudget * SNAPSHOT_BUDGET_SHARE), GetSnapshotMinimumSize(mSnapshot, true)));
+
+		for (auto& client : mClients)
 		{
-			for (auto& asteroid : mAliveAsteroids)
-			{
-				AsteroidUpdatePacket packet;
-				packet.mID = asteroid.mObjectID;
-				packet.mPosition = asteroid.mPosition;
-				packet.mVelocity = asteroid.mVelocity;
+			// Without a baseline the client gets everything
+			const Snapshot* baseline = client.mHasAckedSnapshot ? client.mSnapshots.Find(client.mAckedSnapshot) : nullptr;
+			const Snapshot& snapshot = GetRelevantSnapshot(client, baseline);
+			unsigned size = EncodeSnapshot(snapshot, baseline, buffer.data(), capacity, &mEncodedSnapshot, &client.mPriorities);
 
-				for (auto& client : mClients)
-				{
-					mProtocol.SendPacket(Packet_Types::AsteroidUpdate, &packet, &client.mEndpoint);
-				}
-			}
-			mUpdateAsteroidsTimer = 0;
+			// Did not fit, an empty message would make the client drop the rest of the datagram
+			if (size == 0)
+				continue;
+			client.mSnapshots.Store(mEncodedSnapshot);
+
+			mShards[client.mShard]->mNetwork.SendPacket(Packet_Types::AsteroidSnapshot, buffer.data(), size, &client.mEndpoint);
 		}
 	}
 
@@ -215,9 +406,9 @@ namespace CS260
 				client.mDead = true;
 				client.mRemainingLifes = remainingLifes;
 			}
-
-			mProtocol.SendPacket(Packet_Types::PlayerDie, &packet, &client.mEndpoint);
 		}
+
+		BroadcastToClients(Packet_Types::PlayerDie, &packet);
 	}
 
 	void Server::SendAsteroidDestroyPacket(unsigned short objectID)
@@ -226,82 +417,66 @@ namespace CS260
 		
 		AsteroidDestructionPacket packet;
 		packet.mObjectId = objectID;
-		for (auto& client : mClients)
-			mProtocol.SendPacket(Packet_Types::AsteroidDestroy, &packet, &client.mEndpoint);
+		BroadcastToClients(Packet_Types::AsteroidDestroy, &packet);
 	}
 
 	void Server::SendBulletToAllClients(BulletCreationPacket mBullet)
 	{
-		for (auto& client : mClients)
-			mProtocol.SendPacket(Packet_Types::BulletCreation, &mBullet, &client.mEndpoint);
+		SendToRelevantClients(Packet_Types::BulletCreation, &mBullet, mBullet.mPos);
 	}
 
 	void Server::SendBulletDestroyPacket(BulletDestroyPacket& packet)
 	{
-		for (auto& client : mClients)
-			mProtocol.SendPacket(Packet_Types::BulletDestruction, &packet, &client.mEndpoint);
+		BroadcastToClients(Packet_Types::BulletDestruction, &packet);
 	}
 
 	void Server::ReceivePackets()
 	{
 		sockaddr senderAddres;
-		socklen_t size = sizeof(senderAddres);
-		WSAPOLLFD poll;
-		poll.fd = mSocket;
-		poll.events = POLLIN;
+		ProtocolPacket packet;
+		Packet_Types type;
+		unsigned size = 0;
 
-		// TODO: Handle timeout 
-		while (WSAPoll(&poll, 1, timeout) > 0)
+		// A datagram may carry several messages, the protocol returns them one by one until the socket is empty
+		// Every shard feeds the same simulation, the replies go back through the shard the packet came from
+		for (mReceivingShard = 0; mReceivingShard < mShards.size(); mReceivingShard++)
 		{
-			if (poll.revents & POLLERR)
-			{
-				PrintError("Polling receiving players information");
-			}
-			else
-			{
-				ProtocolPacket packet;
-				Packet_Types type;
-				unsigned size = 0;
-
-				mProtocol.ReceivePacket(&packet, &size, &type, &senderAddres);
+			while (mShards[mReceivingShard]->mNetwork.ReceivePacket(&packet, &size, &type, &senderAddres))
 				HandleReceivedPacket(packet, type, senderAddres);
-			}
 		}
 	}
 	
 	void Server::sendScorePacket(ScorePacket _packet)
 	{
-		for (auto& client : mClients)
-			mProtocol.SendPacket(Packet_Types::ScoreUpdate, &_packet, &client.mEndpoint);
-	}
-	
-	void Server::SendVoidPackets()
-	{
-		for (auto& client : mClients)
-		{
-			mProtocol.SendPacket(Packet_Types::VoidPacket, 0, &client.mEndpoint);
-		}
+		BroadcastToClients(Packet_Types::ScoreUpdate, &_packet);
 	}
 	
 	void Server::HandleReceivedPacket(ProtocolPacket& packet, Packet_Types type, sockaddr& senderAddress)
 	{
 		switch (type) 
 		{
-		case Packet_Types::ShipPacket:
+		case Packet_Types::InputCommands:
 		{
-			if (!mClients.empty())
+			// The sender is found by its endpoint, it can only move its own ship
+			InputCommandsPacket* mCastedPacket = reinterpret_cast<InputCommandsPacket*>(&packet);
+			ClientInfo* client = FindClient(&senderAddress);
+			if (!client)
+				break;
+			client->mAliveTimer = 0;
+
+			// The commands are resent until applied, only the newer ones are new
+			for (unsigned i = 0; i < mCastedPacket->mCount; i++)
 			{
-				for (auto& i : mClients)
-				{
-					if (ShipUpdatePacket* mCastedPacket = reinterpret_cast<ShipUpdatePacket*>(&packet))
-					{
-						if (i.mPlayerInfo.mID == mCastedPacket->mPlayerInfo.mID)
-						{
-							i.mPlayerInfo = mCastedPacket->mPlayerInfo;
-							i.mAliveTimer = 0;
-						}
-					}
-				}
+				InputCommand command = mCastedPacket->mCommands[i];
+				if (client->mHasInput && !SequenceGreaterThan(command.mSequence, client->mLastInput))
+					continue;
+				client->mLastInput = command.mSequence;
+				client->mHasInput = true;
+
+				// The commands cannot add up to more time than went by in the server, a faster clock is cut down to it
+				command.mDuration = static_cast<uint8_t>(std::min<unsigned>(command.mDuration, client->mInputTime));
+				client->mInputTime -= command.mDuration;
+				mInputsOnFrame.push_back({ client->mPlayerInfo.mID, command });
 			}
 		}
 			break;
@@ -317,7 +492,7 @@ namespace CS260
 			SYNACKpacket.color = color;
 
 			PrintMessage("Sending SYNACK to client with id " + std::to_string(static_cast<int>(SYNACKpacket.mPlayerID)));
-			mProtocol.SendPacket(Packet_Types::SYNACK, &SYNACKpacket, &senderAddress);
+			mShards[mReceivingShard]->mNetwork.SendPacket(Packet_Types::SYNACK, &SYNACKpacket, &senderAddress);
 		}			
 			break;
 		case Packet_Types::SYNACK:
@@ -334,15 +509,13 @@ namespace CS260
 			::memcpy(&receivedPacket, packet.mBuffer.data(), sizeof(receivedPacket));
 			
 			PlayerDisconnectACKPacket disconnectPacket;
-			mProtocol.SendPacket(Packet_Types::ACKDisconnect, &disconnectPacket, &senderAddress);
+			mShards[mReceivingShard]->mNetwork.SendPacket(Packet_Types::ACKDisconnect, &disconnectPacket, &senderAddress);
 			
-			for (auto& client : mClients)
+			ClientInfo* client = FindClient(&senderAddress);
+			if (client && client->mPlayerInfo.mID == receivedPacket.mPlayerID)
 			{
-				if (client.mPlayerInfo.mID == receivedPacket.mPlayerID)
-				{
-					client.mDisconnecting = true;
-					client.mAliveTimer = 0;
-				}
+				client->mDisconnecting = true;
+				client->mAliveTimer = 0;
 			}
 			break;
 		}
@@ -352,12 +525,14 @@ namespace CS260
 			PlayerDisconnectACKPacket receivedPacket;
 			::memcpy(&receivedPacket, packet.mBuffer.data(), sizeof(receivedPacket));
 
+			ClientInfo* client = FindClient(&senderAddress);
+			if (!client || client->mPlayerInfo.mID != receivedPacket.mPlayerID)
+				break;
+
 			// Remove the client from the list
-			mClients.erase(std::remove_if(mClients.begin(), mClients.end(), [&receivedPacket](ClientInfo& client)
-				{ 
-					return client.mPlayerInfo.mID == receivedPacket.mPlayerID;
-				}),
-				mClients.end());
+			mShards[client->mShard]->mNetwork.RemovePeer(&client->mEndpoint);
+			mClients.erase(mClients.begin() + (client - mClients.data()));
+			RebuildClientIndices();
 			mDisconnectedPlayersIDs.push_back(receivedPacket.mPlayerID);
 			
 			NotifyPlayerDisconnection(receivedPacket.mPlayerID);
@@ -371,25 +546,44 @@ namespace CS260
 			
 			// When receiving a player die packet message from a client it means
 			// that it already received the die packet and is ready to keep playing
-			for (auto& client : mClients)
-			{
-				if (client.mPlayerInfo.mID == receivedPacket.mPlayerID)
-					client.mDead = false;
-			}				
+			ClientInfo* client = FindClient(&senderAddress);
+			if (client && client->mPlayerInfo.mID == receivedPacket.mPlayerID)
+				client->mDead = false;
 			break;
 		}
-		case Packet_Types::BulletRequest:
+		case Packet_Types::SnapshotAck:
 		{
+			SnapshotAckPacket receivedPacket;
+			::memcpy(&receivedPacket, packet.mBuffer.data(), sizeof(receivedPacket));
 
-			BulletRequestPacket rcpk;
-			size_t size = sizeof(BulletRequestPacket);
-
-			::memcpy(&rcpk, packet.mBuffer.data(), size);
-
-			mBulletsToCreate.push_back(rcpk); // add it to the vector for the state_ingame to generate the bullets afterwards
-
+			// The acknowledgements are unreliable, so an older one may arrive late
+			ClientInfo* client = FindClient(&senderAddress);
+			if (client && (!client->mHasAckedSnapshot || SequenceGreaterThan(receivedPacket.mSnapshotID, client->mAckedSnapshot)))
+			{
+				client->mAckedSnapshot = receivedPacket.mSnapshotID;
+				client->mHasAckedSnapshot = true;
+			}
 			break;
 		}
+		case Packet_Types::AsteroidSnapshot:
+			break;
+		case Packet_Types::ShipStates:
+			break;
+		case Packet_Types::ShipPacket:
+		case Packet_Types::VoidPacket:
+		case Packet_Types::ObjectCreation:
+		case Packet_Types::ObjectDestruction:
+		case Packet_Types::ObjectUpdate:
+		case Packet_Types::NewPlayer:
+		case Packet_Types::NotifyPlayerDisconnection:
+		case Packet_Types::AsteroidCreation:
+		case Packet_Types::AsteroidUpdate:
+		case Packet_Types::AsteroidDestroy:
+		case Packet_Types::BulletCreation:
+		case Packet_Types::BulletDestruction:
+		case Packet_Types::ScoreUpdate:
+		case Packet_Types::ServerStats:
+			break;
 		}
 	}
 
@@ -409,7 +603,7 @@ namespace CS260
 
 		// Send to the current clients the information of the new client
 		for (auto& client : mClients)
-			mProtocol.SendPacket(Packet_Types::NewPlayer, &newPlayerPacket, &client.mEndpoint);
+			mShards[client.mShard]->mNetwork.SendPacket(Packet_Types::NewPlayer, &newPlayerPacket, &client.mEndpoint);
 
 		PrintMessage("Sending current clients information");
 
@@ -422,21 +616,62 @@ namespace CS260
 			newPlayerPacket.mPlayerInfo.rot = client.mPlayerInfo.rot;
 			newPlayerPacket.color = client.color;
 			newPlayerPacket.mRemainingLifes = client.mRemainingLifes;
-			mProtocol.SendPacket(Packet_Types::NewPlayer, &newPlayerPacket, &senderAddress);
+			mShards[mReceivingShard]->mNetwork.SendPacket(Packet_Types::NewPlayer, &newPlayerPacket, &senderAddress);
 		}
 
 		// Send to the new client the information of the current asteroids
 		for (auto& asteroid : mAliveAsteroids)
-			mProtocol.SendPacket(Packet_Types::AsteroidCreation, &asteroid, &senderAddress);
+			mShards[mReceivingShard]->mNetwork.SendPacket(Packet_Types::AsteroidCreation, &asteroid, &senderAddress);
 
 		newPlayerPacket.mPlayerInfo.mID = packet.mPlayerID;
 		newPlayerPacket.mPlayerInfo.pos = { 0,0 };
 		newPlayerPacket.mPlayerInfo.rot = 0;
 
 		// Add the new client to the players list
-		mClients.push_back(ClientInfo(senderAddress, newPlayerPacket.mPlayerInfo, packet.color));
+		mClientIndices[EndpointKey(&senderAddress)] = static_cast<unsigned>(mClients.size());
+		mClients.push_back(ClientInfo(senderAddress, newPlayerPacket.mPlayerInfo, packet.color, mReceivingShard));
+	}
+
+	ClientInfo* Server::FindClient(const sockaddr* endpoint)
+	{
+		auto found = mClientIndices.find(EndpointKey(endpoint));
+		if (found == mClientIndices.end())
+			return nullptr;
+		return &mClients[found->second];
+	}
+
+	ClientInfo* Server::FindClientByID(unsigned char playerID)
+	{
+		for (auto& client : mClients)
+		{
+			if (client.mPlayerInfo.mID == playerID)
+				return &client;
+		}
+		return nullptr;
+	}
+
+	void Server::RebuildClientIndices()
+	{
+		// Nothing was removed, the positions are still right
+		if (mClientIndices.size() == mClients.size())
+			return;
+
+		mClientIndices.clear();
+		for (unsigned i = 0; i < mClients.size(); i++)
+			mClientIndices[EndpointKey(&mClients[i].mEndpoint)] = i;
 	}
 	
+	void Server::HandleDeliveryFailed(const sockaddr* endpoint, Packet_Types type)
+	{
+		if (ClientInfo* client = FindClient(endpoint))
+		{
+			PrintMessage("Gave up delivering packet of type " + std::to_string(static_cast<int>(type)) + " to client with id " + std::to_string(static_cast<int>(client->mPlayerInfo.mID)));
+			
+			// The client is not answering, let the timeout logic disconnect it
+			client->mAliveTimer = timeOutTimer + 1;
+		}
+	}
+
 	void Server::CheckTimeoutPlayer()
 	{
 		for (auto& discconectClient : mClients)
@@ -447,7 +682,7 @@ namespace CS260
 				packet.mPlayerID = discconectClient.mPlayerInfo.mID;
 				
 				// Force the client to disconnect
-				mProtocol.SendPacket(Packet_Types::PlayerDisconnect, &packet, &discconectClient.mEndpoint);
+				mShards[discconectClient.mShard]->mNetwork.SendPacket(Packet_Types::PlayerDisconnect, &packet, &discconectClient.mEndpoint);
 
 				// Update the game state
 				mDisconnectedPlayersIDs.push_back(discconectClient.mPlayerInfo.mID);
@@ -457,9 +692,15 @@ namespace CS260
 			}
 		}
 		// Remove the client from the list
-		mClients.erase(std::remove_if(mClients.begin(), mClients.end(), [](ClientInfo& client) 
-			{ return client.mAliveTimer > timeOutTimer; }),
+		mClients.erase(std::remove_if(mClients.begin(), mClients.end(), [this](ClientInfo& client) 
+			{ 
+				if (client.mAliveTimer <= timeOutTimer)
+					return false;
+				mShards[client.mShard]->mNetwork.RemovePeer(&client.mEndpoint);
+				return true;
+			}),
 			mClients.end());
+		RebuildClientIndices();
 	}
 
 	void Server::NotifyPlayerDisconnection(unsigned char playerID)
@@ -469,8 +710,9 @@ namespace CS260
 
 		for (auto& client : mClients)
 		{
+			client.mRelevantShips.reset(playerID);
 			if(client.mPlayerInfo.mID != playerID)
-				mProtocol.SendPacket(Packet_Types::NotifyPlayerDisconnection, &packet, &client.mEndpoint);
+				mShards[client.mShard]->mNetwork.SendPacket(Packet_Types::NotifyPlayerDisconnection, &packet, &client.mEndpoint);
 		}
 	}
 
@@ -489,7 +731,7 @@ namespace CS260
 					{
 						client.mDisconnectTries++;
 						PlayerDisconnectACKPacket disconnectPacket;
-						mProtocol.SendPacket(Packet_Types::ACKDisconnect, &disconnectPacket, &client.mEndpoint);
+						mShards[client.mShard]->mNetwork.SendPacket(Packet_Types::ACKDisconnect, &disconnectPacket, &client.mEndpoint);
 					}
 					// If not update the timer
 					else
@@ -504,11 +746,161 @@ namespace CS260
 			}
 		}
 
-		mClients.erase(std::remove_if(mClients.begin(), mClients.end(), [](ClientInfo& client)
+		mClients.erase(std::remove_if(mClients.begin(), mClients.end(), [this](ClientInfo& client)
 			{
-				return client.mDisconnectTries >= disconnectTries;
+				if (client.mDisconnectTries < disconnectTries)
+					return false;
+				mShards[client.mShard]->mNetwork.RemovePeer(&client.mEndpoint);
+				return true;
 			}),
 			mClients.end());
+		RebuildClientIndices();
+	}
+
+	void Server::UpdateClientEndpoints()
+	{
+		for (unsigned i = 0; i < mShards.size(); i++)
+		{
+			auto& shard = *mShards[i];
+
+			// Nothing changed, keep sharing the same list
+			unsigned matched = 0;
+			bool changed = false;
+			for (auto& client : mClients)
+			{
+				if (client.mShard != i)
+					continue;
+				if (matched == shard.mClientEndpoints->size() || EndpointKey(&client.mEndpoint) != EndpointKey(&(*shard.mClientEndpoints)[matched]))
+				{
+					changed = true;
+					break;
+				}
+				matched++;
+			}
+			if (!changed && matched == shard.mClientEndpoints->size())
+				continue;
+
+			auto endpoints = std::make_shared<std::vector<sockaddr>>();
+			for (auto& client : mClients)
+			{
+				if (client.mShard == i)
+					endpoints->push_back(client.mEndpoint);
+			}
+			shard.mClientEndpoints = std::move(endpoints);
+		}
+	}
+
+	void Server::SendServerStats()
+	{
+		ConnectionStats totals = GetNetworkStats();
+
+		unsigned interval = ms_since(mStatsStart);
+		auto perSecond = [interval](unsigned long long current, unsigned long long previous) {
+			return static_cast<unsigned>((current - previous) * 1000 / std::max(interval, 1u));
+		};
+
+		ServerStatsPacket stats;
+		stats.mInterval = interval;
+		stats.mTicks = mStatsTicks;
+		stats.mTickTimeAverage = mStatsTicks > 0 ? static_cast<unsigned>(mTickTimeTotal / mStatsTicks) : 0;
+		stats.mTickTimeMax = mTickTimeMax;
+		stats.mPlayers = static_cast<unsigned>(mClients.size());
+		stats.mPacketsSent = perSecond(totals.mPacketsSent, mStatsTotals.mPacketsSent);
+		stats.mPacketsReceived = perSecond(totals.mPacketsReceived, mStatsTotals.mPacketsReceived);
+		stats.mBytesSent = perSecond(totals.mBytesSent, mStatsTotals.mBytesSent);
+		stats.mBytesReceived = perSecond(totals.mBytesReceived, mStatsTotals.mBytesReceived);
+		BroadcastToClients(Packet_Types::ServerStats, &stats);
+
+		mStatsStart = now();
+		mStatsTicks = 0;
+		mTickTimeTotal = 0;
+		mTickTimeMax = 0;
+		mStatsTotals = totals;
+	}
+
+	void Server::BroadcastToClients(Packet_Types type, const void* packet)
+	{
+		BroadcastToClients(type, packet, Protocol::GetTypeSize(type));
+	}
+
+	void Server::BroadcastToClients(Packet_Types type, const void* packet, unsigned size)
+	{
+		for (auto& shard : mShards)
+		{
+			if (!shard->mClientEndpoints->empty())
+				shard->mNetwork.Broadcast(type, packet, size, shard->mClientEndpoints);
+		}
+	}
+
+	void Server::SendToRelevantClients(Packet_Types type, const void* packet, glm::vec2 position)
+	{
+		// Everything is relevant to everyone, keep sharing the encoding
+		if (sViewExtents.x <= 0.0f || sViewExtents.y <= 0.0f)
+		{
+			BroadcastToClients(type, packet);
+			return;
+		}
+
+		for (auto& client : mClients)
+		{
+			if (GetRelevance(client, position) != Relevance::None)
+				mShards[client.mShard]->mNetwork.SendPacket(type, packet, &client.mEndpoint);
+		}
+	}
+
+	bool Server::ShouldSendShip(ClientInfo& client, const PlayerInfo& ship)
+	{
+		// Entering and leaving the view are always sent, so the client starts from the right state and keeps the last one
+		Relevance relevance = GetRelevance(client, ship.pos);
+		bool wasRelevant = client.mRelevantShips[ship.mID];
+		client.mRelevantShips[ship.mID] = relevance != Relevance::None;
+		if (relevance == Relevance::None)
+			return wasRelevant;
+
+		// Spread the reduced updates of the ships over the ticks
+		return relevance == Relevance::Full || !wasRelevant || (mShipStatesCount + ship.mID) % RELEVANCE_REDUCED_INTERVAL == 0;
+	}
+
+	Relevance Server::GetRelevance(const ClientInfo& client, glm::vec2 position) const
+	{
+		return ClassifyRelevance(RelevanceScore(client.mPlayerInfo.pos, sViewExtents, position));
+	}
+
+	const Snapshot& Server::GetRelevantSnapshot(ClientInfo& client, const Snapshot* baseline)
+	{
+		bool filtered = sViewExtents.x > 0.0f && sViewExtents.y > 0.0f;
+
+		mRelevantSnapshot.mID = mSnapshot.mID;
+		mRelevantSnapshot.mTime = mSnapshot.mTime;
+		mRelevantSnapshot.mAsteroids.clear();
+		mRelevantSnapshot.mShips.clear();
+		for (auto& other : mClients)
+		{
+			// The far ships do not steer the asteroids the client sees
+			if (filtered && (&other == &client || GetRelevance(client, other.mPlayerInfo.pos) != Relevance::None))
+				mRelevantSnapshot.mShips.push_back(other.mPlayerInfo.pos);
+		}
+		for (auto& asteroid : mSnapshot.mAsteroids)
+		{
+			float score = RelevanceScore(client.mPlayerInfo.pos, sViewExtents, asteroid.mPosition);
+			client.mPriorities.Accumulate(asteroid.mID, score);
+			if (!filtered)
+				continue;
+
+			// Leaving the view removes it from the snapshots of the client, entering adds it back whole
+			Relevance relevance = ClassifyRelevance(score);
+			if (relevance == Relevance::None)
+				continue;
+
+			// Out of its turn the client keeps what it has, so nothing is sent for it
+			AsteroidUpdatePacket predicted;
+			if (relevance == Relevance::Reduced && (mSnapshot.mID + asteroid.mID) % RELEVANCE_REDUCED_INTERVAL != 0 &&
+				baseline && PredictAsteroid(*baseline, asteroid.mID, mSnapshot.mTime, &predicted))
+				mRelevantSnapshot.mAsteroids.push_back(predicted);
+			else
+				mRelevantSnapshot.mAsteroids.push_back(asteroid);
+		}
+		return filtered ? mRelevantSnapshot : mSnapshot;
 	}
 
 	void Server::PrintMessage(const std::string& msg)
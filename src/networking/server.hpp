@@ -10,9 +10,13 @@
 	Implementation for all the functionalities required by the server.
 *******************************************************************************/
 #pragma once
-#include "protocol.hpp"
+#include "network_worker.hpp"
+#include "relevance.hpp"
+#include "snapshot.hpp"
 
+#include <bitset>
 #include <glm/glm.hpp>
+#include <unordered_map>
 #include <vector>
 
 namespace CS260
@@ -22,10 +26,11 @@ namespace CS260
 		/*	\fn ClientInfo
 		\brief ClientInfo constructor initializes the endpoint and the player information
 		*/
-		ClientInfo(sockaddr endpoint, PlayerInfo playerInfo, glm::vec4 color);
+		ClientInfo(sockaddr endpoint, PlayerInfo playerInfo, glm::vec4 color, unsigned shard);
 		
 		// Networking
 		sockaddr mEndpoint;
+		unsigned mShard; // Socket the client talks to, the kernel always picks the same one for an endpoint
 		unsigned mAliveTimer;
 
 		// Disconnection
@@ -38,26 +43,80 @@ namespace CS260
 		glm::vec4 color;
 		unsigned short mRemainingLifes;
 		bool mDead = false;
+
+		// Snapshots
+		SnapshotHistory mSnapshots; // What the client has after each snapshot we sent it
+		unsigned short mAckedSnapshot;
+		bool mHasAckedSnapshot;
+
+		// Inputs
+		unsigned short mLastInput; // Newest input command received from the client, the older ones are ignored
+		bool mHasInput;
+		unsigned mInputTime; // Milliseconds of input the client can still be applied, it grows with the server clock
+
+		// Relevance
+		std::bitset<256> mRelevantShips; // Ships, by player id, whose updates the client is getting
+		PriorityAccumulator mPriorities; // Of the asteroids, the ones left out of a full snapshot go first in the next ones
 	};
 	
 	const unsigned disconnectTries = 3; // In fact, there is a total of 4 tries because the first one is not counted
-	const unsigned updateAsteroids = 5000;
+
+	const unsigned maxInputTimeAhead = 500; // Milliseconds of input a client can save up, for the commands that arrive together after a hitch
+
+	// An input command received from a player, to apply to its ship
+	struct PlayerInput
+	{
+		unsigned char mPlayerID;
+		InputCommand mCommand;
+	};
+
+	// One of the sockets bound to the server port, with its own network thread and sessions
+	struct ServerShard
+	{
+		SOCKET mSocket;
+		NetworkWorker mNetwork;
+
+		// Endpoints of the clients of this shard, contiguous so the same message can be broadcast to all of them
+		// Shared with the network thread, so it is replaced instead of modified
+		std::shared_ptr<const std::vector<sockaddr>> mClientEndpoints;
+	};
 
 	class Server
 	{
 		unsigned char mCurrentID;
-		Protocol mProtocol;
 		bool mVerbose;
-		SOCKET mSocket;
+		std::vector<std::unique_ptr<ServerShard>> mShards;
+		unsigned mReceivingShard; // Shard the packet being handled came from
 		sockaddr_in mEndpoint;
 		std::vector<ClientInfo> mClients;
+		std::unordered_map<uint64_t, unsigned> mClientIndices; // Position in mClients of each client by its endpoint
 		std::vector<NewPlayerPacket> mNewPlayersOnFrame;
 		
 		std::vector<unsigned char> mDisconnectedPlayersIDs;
 		std::vector<AsteroidCreationPacket> mAliveAsteroids;
 		unsigned mUpdateAsteroidsTimer;
-
-		std::vector<BulletRequestPacket> mBulletsToCreate;
+		unsigned mUpdateShipsTimer;
+		unsigned mShipStatesCount; // Times the states of the ships were sent
+
+		// Snapshots of the asteroids, each client gets only what changed since the last one it acknowledged
+		unsigned short mSnapshotID;
+		clock_t::time_point mStartTime;
+		Snapshot mSnapshot;
+		Snapshot mEncodedSnapshot;
+		Snapshot mRelevantSnapshot; // What is sent of the snapshot to the client being encoded
+
+		ShipStatesPacket mShipStates;
+
+		std::vector<PlayerInput> mInputsOnFrame;
+		clock_t::time_point mInputClock; // Up to when the input time of the clients has grown
+
+		// Stats sent to the clients, of the ticks since the last ones
+		clock_t::time_point mStatsStart;
+		clock_t::time_point mTickStart;
+		unsigned mStatsTicks;
+		unsigned long long mTickTimeTotal; // Microseconds
+		unsigned mTickTimeMax;
+		ConnectionStats mStatsTotals; // Of every shard when the last ones were sent
 	public:
 		/*	\fn Server
 		\brief	Server constructor following RAII design
@@ -69,16 +128,57 @@ namespace CS260
 		*/
 		~Server();
 
+		/*	\fn SetShardCount
+		\brief	Sets the amount of sockets the next servers open on their port, each one received by its own thread.
+				Needs SO_REUSEPORT, without it a single socket is used
+		*/
+		static void SetShardCount(unsigned count);
+
+		/*	\fn SetViewExtents
+		\brief	Sets half the size of the view of the clients of the next servers, centered on their ship.
+				Each client only gets the updates of what is in or around its view, zero replicates everything to everyone
+		*/
+		static void SetViewExtents(glm::vec2 halfExtents);
+
+		/*	\fn SetClientByteBudget
+		\brief	Sets the bytes the next servers send to each client per tick, zero for no limit.
+				The snapshots are cut to fit, and the reliable messages over it wait for the next ticks
+		*/
+		static void SetClientByteBudget(unsigned bytesPerTick);
+
+		/*	\fn SetShipStatesInterval
+		\brief	Sets the milliseconds between the states of the ships the next servers send, zero to send them every tick.
+				The clients show the other ships between the states, so they move smoothly at a lower rate
+		*/
+		static void SetShipStatesInterval(unsigned milliseconds);
+
+		/*	\fn SetStatsInterval
+		\brief	Sets the milliseconds between the ServerStats the next servers send to their clients, zero to not send them
+		*/
+		static void SetStatsInterval(unsigned milliseconds);
+
 		/*	\fn Tick
 		\brief	Responsible of receiving packets and handling timeouts
+		\param ticks Ticks of tickRate this one stands for, more than one when catching up with missed ones
 		*/
-		void Tick();
+		void Tick(unsigned ticks = 1);
+
+		/*	\fn Flush
+		\brief	Sends everything queued for the clients during this tick, packed per client.
+				The time since Tick is what the tick took in the stats
+		*/
+		void Flush();
 
 		/*	\fn PlayerCount
 		\brief	Return the total count of current players
 		*/
 		int PlayerCount();
 
+		/*	\fn GetNetworkStats
+		\brief	Return the counters of the connections with every client, the gone ones included, as of the last network tick
+		*/
+		ConnectionStats GetNetworkStats();
+
 		/*	\fn PlayerCount
 		\brief	Return the total count of current players
 		*/
@@ -89,20 +189,22 @@ namespace CS260
 		*/
 		const std::vector<ClientInfo>& GetPlayersInfo();
 
-		/*	\fn GetBulletsToCreate
-		\brief	Return the total count of bullets requests and the information related to each of them
+		/*	\fn GetPlayerInputs
+		\brief	Return the input commands received this tick, each one only once and in order for each player.
+				Their durations add up to no more than the time that went by in the server, see maxInputTimeAhead
 		*/
-		const std::vector<BulletRequestPacket>& GetBulletsToCreate();
+		const std::vector<PlayerInput>& GetPlayerInputs();
 
 		/*	\fn GetDisconnectedPlayersIDs
 		\brief	Return the ids of the disconnected players
 		*/
 		const std::vector<unsigned char>& GetDisconnectedPlayersIDs();
 
-		/*	\fn SendPlayerInfo
-		\brief	Send the received player info to the rest of the players
+		/*	\fn SendShipStates
+		\brief	Send the state of the given ships to the players every ship states interval, all of them in as few messages as possible.
+				The ships far from the view of a client are sent less often or not at all, its own one always
 		*/
-		void SendPlayerInfo(sockaddr _endpoint, PlayerInfo _playerinfo);
+		void SendShipStates(const std::vector<PlayerInfo>& ships);
 
 		/*	\fn SendAsteroidCreation
 		\brief	Send asteroid creation packet to all clients
@@ -120,7 +222,8 @@ namespace CS260
 		void SendAsteroidsForcedUpdate(unsigned id, glm::vec2 pos, glm::vec2 vel);
 		
 		/*	\fn SendAsteroidsUpdate
-		\brief	Send asteroid update packet to all clients, this function is called every 5000ms and by the game instance
+		\brief	Send a snapshot of the asteroids to all clients, delta encoded against the last one each client acknowledged.
+				Called by the game instance every frame, it only sends every snapshotInterval ms
 		*/
 		void SendAsteroidsUpdate();
 
@@ -156,21 +259,36 @@ namespace CS260
 		*/
 		void ReceivePackets();
 
-		/*	\fn SendVoidPackets
-		\brief	Sends void packets to avoid having timeout players
-		*/
-		void SendVoidPackets();
-
 		/*	\fn HandleReceivedPacket
 		\brief	Sends void packets to avoid having timeout players
 		*/
 		void HandleReceivedPacket(ProtocolPacket& packet, Packet_Types type, sockaddr& senderAddress);
 
+		/*	\fn FindClient
+		\brief	Returns the client talking from the given endpoint, null if there is none
+		*/
+		ClientInfo* FindClient(const sockaddr* endpoint);
+
+		/*	\fn FindClientByID
+		\brief	Returns the client playing with the given id, null if there is none
+		*/
+		ClientInfo* FindClientByID(unsigned char playerID);
+
+		/*	\fn RebuildClientIndices
+		\brief	Updates the lookup of clients by endpoint after some were removed
+		*/
+		void RebuildClientIndices();
+
 		/*	\fn HandleNewPlayerACKPacket
 		\brief	At this step the client is finally connected, so notify the rest of the clients
 		*/
 		void HandleNewPlayerACKPacket(SYNACKPacket& packet, sockaddr& senderAddress);
 
+		/*	\fn HandleDeliveryFailed
+		\brief	Called by the protocol when a reliable message could not be delivered, drops the client as if it timed out
+		*/
+		void HandleDeliveryFailed(const sockaddr* endpoint, Packet_Types type);
+
 		/*	\fn CheckTimeoutPlayer
 		\brief	Forces disconnection of clients if they time out
 		*/
@@ -186,6 +304,47 @@ namespace CS260
 		*/
 		void HandleDisconnection();
 
+		/*	\fn UpdateClientEndpoints
+		\brief	Rebuilds the lists of endpoints used for broadcasting after the clients changed
+		*/
+		void UpdateClientEndpoints();
+
+		/*	\fn SendServerStats
+		\brief	Sends the stats of the ticks since the last ones to every client, and starts counting again
+		*/
+		void SendServerStats();
+
+		/*	\fn BroadcastToClients
+		\brief	Sends the packet to every client through the shard each one belongs to
+		*/
+		void BroadcastToClients(Packet_Types type, const void* packet);
+
+		/*	\fn BroadcastToClients
+		\brief	Sends the packet of variable size to every client through the shard each one belongs to
+		*/
+		void BroadcastToClients(Packet_Types type, const void* packet, unsigned size);
+
+		/*	\fn SendToRelevantClients
+		\brief	Sends the packet to the clients the given position is relevant to
+		*/
+		void SendToRelevantClients(Packet_Types type, const void* packet, glm::vec2 position);
+
+		/*	\fn ShouldSendShip
+		\brief	Whether the state of the ship goes to the client this tick, keeping track of the ships entering and leaving its view
+		*/
+		bool ShouldSendShip(ClientInfo& client, const PlayerInfo& ship);
+
+		/*	\fn GetRelevance
+		\brief	Returns how the client gets the updates of an entity at the given position
+		*/
+		Relevance GetRelevance(const ClientInfo& client, glm::vec2 position) const;
+
+		/*	\fn GetRelevantSnapshot
+		\brief	Returns the part of the current snapshot the client gets, the asteroids of reduced relevance
+				only change when it is their turn. Adds the relevance of each asteroid to its priority for the client
+		*/
+		const Snapshot& GetRelevantSnapshot(ClientInfo& client, const Snapshot* baseline);
+
 		/*	\fn PrintMessage
 		\brief	Prints the given message if verbose is active
 		*/
@@ -0,0 +1,156 @@
+#include "simulated_io_backend.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace CS260
+{
+	namespace
+	{
+		clock_t::duration Milliseconds(float ms)
+		{
+			return std::chrono::duration_cast<clock_t::duration>(std::chrono::duration<float, std::milli>(ms));
+		}
+	}
+
+	bool NetworkConditions::IsActive() const
+	{
+		return mLatency > 0.0f || mJitter > 0.0f || mLoss > 0.0f || mDuplication > 0.0f || mReordering > 0.0f || mBandwidth > 0;
+	}
+
+	SimulatedIoBackend::SimulatedIoBackend(std::unique_ptr<IoBackend> backend, const NetworkConditions& conditions) :
+		mBackend(std::move(backend)),
+		mConditions(conditions),
+		mRandom(conditions.mSeed),
+		mNextOrder(0)
+	{
+	}
+
+	void SimulatedIoBackend::Send(const char* data, unsigned size, const sockaddr* addr)
+	{
+		Schedule(mOutgoing, data, size, addr);
+	}
+
+	void SimulatedIoBackend::FlushSends()
+	{
+		auto current = now();
+		while (IsDue(mOutgoing, current)) {
+			Datagram datagram = Pop(mOutgoing);
+			mBackend->Send(datagram.mData.data(), static_cast<unsigned>(datagram.mData.size()), datagram.mHasAddress ? &datagram.mAddress : nullptr);
+		}
+		mBackend->FlushSends();
+	}
+
+	bool SimulatedIoBackend::Receive(const char** data, unsigned* size, sockaddr* addr)
+	{
+		//what arrived only gets to us once it went through the incoming link
+		const char* received;
+		unsigned receivedSize;
+		sockaddr from{};
+		while (mBackend->Receive(&received, &receivedSize, addr ? &from : nullptr))
+			Schedule(mIncoming, received, receivedSize, addr ? &from : nullptr);
+
+		if (!IsDue(mIncoming, now()))
+			return false;
+
+		Datagram datagram = Pop(mIncoming);
+		mReceived.swap(datagram.mData);
+		*data = mReceived.data();
+		*size = static_cast<unsigned>(mReceived.size());
+		if (addr)
+			*addr = datagram.mAddress;
+		return true;
+	}
+
+	bool SimulatedIoBackend::Wait(unsigned timeoutMs)
+	{
+		FlushSends();
+		if (IsDue(mIncoming, now()))
+			return true;
+
+		//something arriving wakes us, but the datagrams already in the links have their own time
+		unsigned wait = GetMsUntilDue(mOutgoing, GetMsUntilDue(mIncoming, timeoutMs));
+		bool activity = mBackend->Wait(wait);
+
+		FlushSends();
+		return activity || IsDue(mIncoming, now());
+	}
+
+	void SimulatedIoBackend::Wake()
+	{
+		mBackend->Wake();
+	}
+
+	void SimulatedIoBackend::Schedule(Link& link, const char* data, unsigned size, const sockaddr* addr)
+	{
+		if (Chance(mConditions.mLoss))
+			return;
+
+		//the link lets the datagrams through one after another, at its bandwidth
+		auto current = now();
+		auto departure = current;
+		if (mConditions.mBandwidth > 0) {
+			departure = std::max(current, link.mBusyUntil);
+			if (departure - current > Milliseconds(SIMULATED_MAX_QUEUE_DELAY))
+				return;
+			link.mBusyUntil = departure + Milliseconds(size * 1000.0f / static_cast<float>(mConditions.mBandwidth));
+		}
+
+		unsigned copies = Chance(mConditions.mDuplication) ? 2 : 1;
+		for (unsigned copy = 0; copy < copies; copy++) {
+			float delay = mConditions.mLatency + mConditions.mJitter * std::uniform_real_distribution<float>(0.0f, 1.0f)(mRandom);
+			if (Chance(mConditions.mReordering))
+				delay += SIMULATED_REORDER_DELAY;
+
+			Datagram datagram;
+			datagram.mTime = departure + Milliseconds(delay);
+			datagram.mOrder = mNextOrder++;
+			datagram.mData.assign(data, data + size);
+			datagram.mHasAddress = addr != nullptr;
+			if (addr)
+				datagram.mAddress = *addr;
+			else
+				memset(&datagram.mAddress, 0, sizeof(datagram.mAddress));
+
+			link.mDatagrams.push_back(std::move(datagram));
+			std::push_heap(link.mDatagrams.begin(), link.mDatagrams.end(), &SimulatedIoBackend::LeavesAfter);
+		}
+	}
+
+	bool SimulatedIoBackend::LeavesAfter(const Datagram& a, const Datagram& b)
+	{
+		//as a heap, the one that gets out first is at the front
+		return a.mTime != b.mTime ? a.mTime > b.mTime : a.mOrder > b.mOrder;
+	}
+
+	bool SimulatedIoBackend::IsDue(const Link& link, clock_t::time_point time) const
+	{
+		return !link.mDatagrams.empty() && link.mDatagrams.front().mTime <= time;
+	}
+
+	SimulatedIoBackend::Datagram SimulatedIoBackend::Pop(Link& link)
+	{
+		std::pop_heap(link.mDatagrams.begin(), link.mDatagrams.end(), &SimulatedIoBackend::LeavesAfter);
+		Datagram datagram = std::move(link.mDatagrams.back());
+		link.mDatagrams.pop_back();
+		return datagram;
+	}
+
+	unsigned SimulatedIoBackend::GetMsUntilDue(const Link& link, unsigned limit) const
+	{
+		if (link.mDatagrams.empty())
+			return limit;
+
+		auto left = link.mDatagrams.front().mTime - now();
+		if (left <= clock_t::duration::zero())
+			return 0;
+		//round up, waking before its time would only mean waiting again
+		auto ms = static_cast<unsigned>((std::chrono::duration_cast<std::chrono::microseconds>(left).count() + 999) / 1000);
+		return std::min(ms, limit);
+	}
+
+	bool SimulatedIoBackend::Chance(float probability)
+	{
+		return probability > 0.0f && std::uniform_real_distribution<float>(0.0f, 1.0f)(mRandom) < probability;
+	}
+}
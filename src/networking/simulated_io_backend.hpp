@@ -0,0 +1,151 @@
+#pragma once
+#include "io_backend.hpp"
+#include "utils.hpp"
+
+#include <random>
+#include <vector>
+
+namespace CS260 {
+
+	//extra delay of the datagrams held back to be reordered, in milliseconds
+	const float SIMULATED_REORDER_DELAY = 20.0f;
+
+	//longest a datagram waits for the bandwidth before the link drops it, in milliseconds
+	const float SIMULATED_MAX_QUEUE_DELAY = 250.0f;
+
+	// Bad network a process pretends to be behind. Each direction is affected on its own,
+	// so a round trip to a peer grows by twice the latency and loses a message with about twice the loss
+	struct NetworkConditions
+	{
+		//milliseconds added to every datagram
+		float mLatency = 0.0f;
+		//up to this many milliseconds more, at random
+		float mJitter = 0.0f;
+		//chance of a datagram being dropped
+		float mLoss = 0.0f;
+		//chance of a datagram arriving twice
+		float mDuplication = 0.0f;
+		//chance of a datagram being held back SIMULATED_REORDER_DELAY so the next ones overtake it
+		float mReordering = 0.0f;
+		//bytes per second, 0 for no limit
+		unsigned mBandwidth = 0;
+		//same seed, same datagrams affected
+		uint32_t mSeed = 1;
+
+		/**
+		* @brief
+		* Whether any of the conditions does something
+		*/
+		bool IsActive() const;
+	};
+
+	// Wraps another backend, delaying, dropping, duplicating and reordering the datagrams going through it
+	// in both directions. Only meant for testing, the datagrams are copied and kept until their time comes
+	class SimulatedIoBackend : public IoBackend {
+
+	public:
+		/**
+		* @brief
+		*  Constructs the backend on top of the one doing the actual I/O
+		*/
+		SimulatedIoBackend(std::unique_ptr<IoBackend> backend, const NetworkConditions& conditions);
+
+		/**
+		* @brief
+		* Puts the datagram on the outgoing link, it is sent once its time comes
+		*/
+		void Send(const char* data, unsigned size, const sockaddr* addr) override;
+
+		/**
+		* @brief
+		* Sends the datagrams whose time came
+		*/
+		void FlushSends() override;
+
+		/**
+		* @brief
+		* Puts everything received on the incoming link, and returns the first datagram whose time came
+		*/
+		bool Receive(const char** data, unsigned* size, sockaddr* addr) override;
+
+		/**
+		* @brief
+		* Waits on the wrapped backend, but not past the time of the next datagram of either link
+		*/
+		bool Wait(unsigned timeoutMs) override;
+
+		/**
+		* @brief
+		* Wakes the wrapped backend
+		*/
+		void Wake() override;
+
+		IoBackendType GetType() const override { return mBackend->GetType(); }
+
+	private:
+		struct Datagram
+		{
+			clock_t::time_point mTime;
+			//the ones with the same time keep their order
+			uint64_t mOrder;
+			std::vector<char> mData;
+			sockaddr mAddress;
+			bool mHasAddress;
+		};
+
+		// One direction, the datagrams in it sorted as a heap by the time they get out of it
+		struct Link
+		{
+			std::vector<Datagram> mDatagrams;
+			//when the last datagram is done going through, for the bandwidth limit
+			clock_t::time_point mBusyUntil;
+		};
+
+		/**
+		* @brief
+		* Puts a datagram in a link, or not if it is lost
+		*/
+		void Schedule(Link& link, const char* data, unsigned size, const sockaddr* addr);
+
+		/**
+		* @brief
+		* Order of the datagrams in a link
+		*/
+		static bool LeavesAfter(const Datagram& a, const Datagram& b);
+
+		/**
+		* @brief
+		* Whether the first datagram of the link can get out of it
+		*/
+		bool IsDue(const Link& link, clock_t::time_point time) const;
+
+		/**
+		* @brief
+		* Takes the first datagram out of the link
+		*/
+		Datagram Pop(Link& link);
+
+		/**
+		* @brief
+		* Milliseconds until the first datagram of the link can get out of it, the given one if it is empty
+		*/
+		unsigned GetMsUntilDue(const Link& link, unsigned limit) const;
+
+		/**
+		* @brief
+		* Random true with the given chance
+		*/
+		bool Chance(float probability);
+
+		std::unique_ptr<IoBackend> mBackend;
+		NetworkConditions mConditions;
+		std::mt19937 mRandom;
+		uint64_t mNextOrder;
+
+		Link mOutgoing;
+		Link mIncoming;
+
+		//last datagram returned by Receive
+		std::vector<char> mReceived;
+	};
+}
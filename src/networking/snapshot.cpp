@@ -0,0 +1,403 @@
+#include "snapshot.hpp"
+
+#include "packet_serialization.hpp"
+#include "quantization.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace CS260
+{
+	namespace
+	{
+		AsteroidMotion sMotion;
+
+		//what an entity of the message carries
+		enum EntityFields : uint8_t
+		{
+			Position = 1 << 0,
+			Velocity = 1 << 1,
+			//it is in the baseline but not anymore
+			Removed = 1 << 2
+		};
+
+		const unsigned ENTITY_FIELD_BITS = 3;
+
+		/**
+		* @brief
+		* Bits an entity takes in the message, the bit telling there is one included
+		*/
+		unsigned EntityBits(uint8_t fields)
+		{
+			return 1 + 16 + ENTITY_FIELD_BITS + ((fields & Position) ? 32 : 0) + ((fields & Velocity) ? 2 * BitsRequired(NET_VELOCITY_STEPS - 1) : 0);
+		}
+
+		/**
+		* @brief
+		* Bits of the ships of a snapshot, with their count
+		*/
+		unsigned ShipBits(size_t count)
+		{
+			return BitsRequired(SNAPSHOT_MAX_SHIPS) + static_cast<unsigned>(count) * 2 * BitsRequired(QuantizedMax(-NET_POSITION_LIMIT, NET_POSITION_LIMIT, SNAPSHOT_SHIP_RESOLUTION));
+		}
+
+		/**
+		* @brief
+		* Bits of the header and the ships of a snapshot, and of the bit ending the entities
+		*/
+		unsigned HeaderBits(size_t shipCount, bool hasBaseline)
+		{
+			return 16 + 32 + 1 + (hasBaseline ? 16 : 0) + ShipBits(shipCount) + 1;
+		}
+
+		/**
+		* @brief
+		* Brings a coordinate that left the play field back from the other side, however far it went
+		*/
+		float Wrap(float value, float min, float max)
+		{
+			float size = max - min;
+			value = min + std::fmod(value - min, size);
+			return value < min ? value + size : value;
+		}
+
+		/**
+		* @brief
+		* Moves an asteroid in a straight line, wrapping at the play field the way the game does
+		*/
+		void Advance(AsteroidUpdatePacket& asteroid, float dt)
+		{
+			asteroid.mPosition += asteroid.mVelocity * dt;
+			if (sMotion.mWrapMax.x > sMotion.mWrapMin.x && sMotion.mWrapMax.y > sMotion.mWrapMin.y) {
+				asteroid.mPosition.x = Wrap(asteroid.mPosition.x, sMotion.mWrapMin.x, sMotion.mWrapMax.x);
+				asteroid.mPosition.y = Wrap(asteroid.mPosition.y, sMotion.mWrapMin.y, sMotion.mWrapMax.y);
+			}
+		}
+
+		float ElapsedSeconds(const Snapshot& from, const Snapshot& to)
+		{
+			return static_cast<float>(to.mTime - from.mTime) / 1000.0f;
+		}
+	}
+
+	void SnapshotHistory::Store(const Snapshot& snapshot)
+	{
+		Entry& entry = mEntries[snapshot.mID % SNAPSHOT_HISTORY_SIZE];
+		entry.mValid = true;
+		entry.mSnapshot.mID = snapshot.mID;
+		entry.mSnapshot.mTime = snapshot.mTime;
+		//assign instead of copying the whole snapshot, so the vector keeps its capacity
+		entry.mSnapshot.mAsteroids.assign(snapshot.mAsteroids.begin(), snapshot.mAsteroids.end());
+		entry.mSnapshot.mShips.assign(snapshot.mShips.begin(), snapshot.mShips.end());
+	}
+
+	const Snapshot* SnapshotHistory::Find(uint16_t id) const
+	{
+		const Entry& entry = mEntries[id % SNAPSHOT_HISTORY_SIZE];
+		if (!entry.mValid || entry.mSnapshot.mID != id)
+			return nullptr;
+		return &entry.mSnapshot;
+	}
+
+	void SnapshotHistory::Clear()
+	{
+		for (Entry& entry : mEntries)
+			entry.mValid = false;
+	}
+
+	void SetAsteroidMotion(const AsteroidMotion& motion)
+	{
+		sMotion = motion;
+	}
+
+	AsteroidUpdatePacket DeadReckonAsteroid(const AsteroidUpdatePacket& asteroid, const std::vector<glm::vec2>& ships, float elapsed)
+	{
+		AsteroidUpdatePacket moved = asteroid;
+
+		//nothing changes the velocity, a single step is exact
+		bool steered = sMotion.mSteering != 0.0f && !ships.empty();
+		bool limited = sMotion.mMaxSpeed > 0.0f;
+		if (!steered && !limited) {
+			Advance(moved, elapsed);
+			return moved;
+		}
+
+		//the same steps on both peers, so they get the same result
+		unsigned steps = std::max(1u, static_cast<unsigned>(std::ceil(elapsed / DEAD_RECKONING_STEP)));
+		float dt = elapsed / static_cast<float>(steps);
+		float damping = std::pow(sMotion.mDamping, dt);
+		for (unsigned step = 0; step < steps; step++) {
+			Advance(moved, dt);
+
+			if (steered) {
+				const glm::vec2* nearest = &ships.front();
+				float nearestDistance = FLT_MAX;
+				for (const glm::vec2& ship : ships) {
+					glm::vec2 offset = ship - moved.mPosition;
+					float distance = offset.x * offset.x + offset.y * offset.y;
+					if (distance < nearestDistance) {
+						nearestDistance = distance;
+						nearest = &ship;
+					}
+				}
+				moved.mVelocity += (*nearest - moved.mPosition) * (sMotion.mSteering * dt);
+			}
+
+			if (limited) {
+				float speed = std::sqrt(moved.mVelocity.x * moved.mVelocity.x + moved.mVelocity.y * moved.mVelocity.y);
+				if (speed > sMotion.mMaxSpeed)
+					moved.mVelocity += moved.mVelocity * (1.0f / speed) * (sMotion.mMaxSpeed - speed) * damping;
+			}
+		}
+		return moved;
+	}
+
+	bool PredictAsteroid(const Snapshot& baseline, uint16_t id, uint32_t time, AsteroidUpdatePacket* predicted)
+	{
+		auto found = std::lower_bound(baseline.mAsteroids.begin(), baseline.mAsteroids.end(), id, [](const AsteroidUpdatePacket& asteroid, uint16_t id) { return asteroid.mID < id; });
+		if (found == baseline.mAsteroids.end() || found->mID != id)
+			return false;
+		*predicted = DeadReckonAsteroid(*found, baseline.mShips, static_cast<float>(time - baseline.mTime) / 1000.0f);
+		return true;
+	}
+
+	unsigned GetSnapshotMinimumSize(const Snapshot& current, bool hasBaseline)
+	{
+		return (HeaderBits(std::min<size_t>(current.mShips.size(), SNAPSHOT_MAX_SHIPS), hasBaseline) + 7) / 8;
+	}
+
+	unsigned EncodeSnapshot(const Snapshot& current, const Snapshot* baseline, char* buffer, unsigned capacity, Snapshot* encoded, PriorityAccumulator* priorities)
+	{
+		static const std::vector<AsteroidUpdatePacket> empty;
+		static const std::vector<glm::vec2> noShips;
+		const std::vector<AsteroidUpdatePacket>& previous = baseline ? baseline->mAsteroids : empty;
+		const std::vector<glm::vec2>& previousShips = baseline ? baseline->mShips : noShips;
+		float elapsed = baseline ? ElapsedSeconds(*baseline, current) : 0.0f;
+
+		//every asteroid of either snapshot, with what the peer gets if it is sent and if it is not
+		struct Change
+		{
+			AsteroidUpdatePacket mState;
+			AsteroidUpdatePacket mPredicted;
+			uint8_t mFields;
+			bool mInBaseline;
+			bool mSend;
+		};
+		//kept between calls, so encoding does not allocate once warmed up
+		static thread_local std::vector<Change> changes;
+		static thread_local std::vector<unsigned> order;
+		changes.clear();
+
+		//both lists are sorted by id, so walk them together
+		size_t i = 0, j = 0;
+		while (i < current.mAsteroids.size() || j < previous.size()) {
+			const AsteroidUpdatePacket* now = i < current.mAsteroids.size() ? &current.mAsteroids[i] : nullptr;
+			const AsteroidUpdatePacket* old = j < previous.size() ? &previous[j] : nullptr;
+			if (now && old && now->mID != old->mID) {
+				if (now->mID < old->mID)
+					old = nullptr;
+				else
+					now = nullptr;
+			}
+			if (now)
+				i++;
+			if (old)
+				j++;
+
+			//what the peer has if we do not tell it anything
+			AsteroidUpdatePacket predicted{};
+			if (old)
+				predicted = DeadReckonAsteroid(*old, previousShips, elapsed);
+
+			//the baseline holds what the peer read, so compare against the quantized values
+			glm::vec2 position = now ? QuantizePosition(now->mPosition) : glm::vec2{};
+			glm::vec2 velocity = now ? QuantizeVelocity(now->mVelocity, NET_ASTEROID_SPEED_LIMIT) : glm::vec2{};
+
+			uint8_t fields = 0;
+			AsteroidUpdatePacket state = predicted;
+			if (!now)
+				fields = Removed;
+			else if (!old) {
+				fields = Position | Velocity;
+				state = { now->mID, position, velocity };
+			}
+			else {
+				glm::vec2 drift = now->mPosition - predicted.mPosition;
+				if (drift.x * drift.x + drift.y * drift.y > SNAPSHOT_POSITION_TOLERANCE * SNAPSHOT_POSITION_TOLERANCE) {
+					fields |= Position;
+					state.mPosition = position;
+				}
+				glm::vec2 velocityDrift = now->mVelocity - predicted.mVelocity;
+				if (velocityDrift.x * velocityDrift.x + velocityDrift.y * velocityDrift.y > SNAPSHOT_VELOCITY_TOLERANCE * SNAPSHOT_VELOCITY_TOLERANCE) {
+					fields |= Velocity;
+					state.mVelocity = velocity;
+				}
+			}
+			state.mID = now ? now->mID : old->mID;
+
+			changes.push_back({ state, predicted, fields, old != nullptr, fields != 0 });
+		}
+
+		//the ships go whole in every snapshot, they are few and small
+		size_t shipCount = std::min<size_t>(current.mShips.size(), SNAPSHOT_MAX_SHIPS);
+
+		//not even the header fits, nothing is encoded and the priorities are left as they were
+		unsigned bitsLeft = capacity * 8;
+		unsigned headerBits = HeaderBits(shipCount, baseline != nullptr);
+		if (headerBits > bitsLeft)
+			return 0;
+		bitsLeft -= headerBits;
+
+		unsigned changedBits = 0;
+		for (const Change& change : changes) {
+			if (change.mFields)
+				changedBits += EntityBits(change.mFields);
+		}
+
+		//it does not all fit, send the ones with the most priority and leave the rest for a later snapshot
+		if (changedBits > bitsLeft) {
+			order.clear();
+			for (unsigned n = 0; n < changes.size(); n++) {
+				if (changes[n].mFields)
+					order.push_back(n);
+			}
+			if (priorities)
+				std::stable_sort(order.begin(), order.end(), [priorities](unsigned a, unsigned b) { return priorities->GetPriority(changes[a].mState.mID) > priorities->GetPriority(changes[b].mState.mID); });
+
+			for (unsigned n : order) {
+				unsigned bits = EntityBits(changes[n].mFields);
+				changes[n].mSend = bits <= bitsLeft;
+				if (changes[n].mSend)
+					bitsLeft -= bits;
+			}
+		}
+
+		encoded->mID = current.mID;
+		encoded->mTime = current.mTime;
+		encoded->mAsteroids.clear();
+		encoded->mShips.clear();
+
+		BitWriter writer(buffer, capacity);
+		writer.WriteBits(current.mID, 16);
+		writer.WriteBits(current.mTime, 32);
+		writer.WriteBool(baseline != nullptr);
+		if (baseline)
+			writer.WriteBits(baseline->mID, 16);
+
+		writer.WriteInt(static_cast<int32_t>(shipCount), 0, SNAPSHOT_MAX_SHIPS);
+		for (size_t n = 0; n < shipCount; n++) {
+			const glm::vec2& ship = current.mShips[n];
+			writer.WriteFloat(ship.x, -NET_POSITION_LIMIT, NET_POSITION_LIMIT, SNAPSHOT_SHIP_RESOLUTION);
+			writer.WriteFloat(ship.y, -NET_POSITION_LIMIT, NET_POSITION_LIMIT, SNAPSHOT_SHIP_RESOLUTION);
+			encoded->mShips.push_back({ QuantizeRoundTrip(ship.x, -NET_POSITION_LIMIT, NET_POSITION_LIMIT, SNAPSHOT_SHIP_RESOLUTION),
+				QuantizeRoundTrip(ship.y, -NET_POSITION_LIMIT, NET_POSITION_LIMIT, SNAPSHOT_SHIP_RESOLUTION) });
+		}
+
+		//in order of id, the peer walks its baseline along with them
+		for (const Change& change : changes) {
+			if (change.mFields && !change.mSend) {
+				//no room, the peer keeps what it had and the difference goes in a later snapshot
+				if (change.mInBaseline)
+					encoded->mAsteroids.push_back(change.mPredicted);
+				continue;
+			}
+
+			if (change.mFields) {
+				writer.WriteBool(true);
+				writer.WriteBits(change.mState.mID, 16);
+				writer.WriteBits(change.mFields, ENTITY_FIELD_BITS);
+				if (change.mFields & Position)
+					WritePosition(writer, change.mState.mPosition);
+				if (change.mFields & Velocity)
+					WriteVelocity(writer, change.mState.mVelocity, NET_ASTEROID_SPEED_LIMIT);
+			}
+
+			if (!(change.mFields & Removed))
+				encoded->mAsteroids.push_back(change.mState);
+
+			//the peer is up to date with it
+			if (priorities) {
+				if (change.mFields & Removed)
+					priorities->Remove(change.mState.mID);
+				else
+					priorities->Reset(change.mState.mID);
+			}
+		}
+		writer.WriteBool(false);
+
+		return writer.HasOverflowed() ? 0 : writer.GetBytesWritten();
+	}
+
+	bool DecodeSnapshot(const char* buffer, unsigned size, const SnapshotHistory& history, Snapshot* decoded)
+	{
+		BitReader reader(buffer, size);
+		decoded->mID = static_cast<uint16_t>(reader.ReadBits(16));
+		decoded->mTime = reader.ReadBits(32);
+
+		const Snapshot* baseline = nullptr;
+		if (reader.ReadBool()) {
+			baseline = history.Find(static_cast<uint16_t>(reader.ReadBits(16)));
+			if (!baseline)
+				return false;
+		}
+		if (reader.HasOverflowed())
+			return false;
+
+		static const std::vector<AsteroidUpdatePacket> empty;
+		static const std::vector<glm::vec2> noShips;
+		const std::vector<AsteroidUpdatePacket>& previous = baseline ? baseline->mAsteroids : empty;
+		const std::vector<glm::vec2>& previousShips = baseline ? baseline->mShips : noShips;
+		float elapsed = baseline ? ElapsedSeconds(*baseline, *decoded) : 0.0f;
+
+		decoded->mAsteroids.clear();
+		decoded->mShips.clear();
+
+		unsigned shipCount = static_cast<unsigned>(reader.ReadInt(0, SNAPSHOT_MAX_SHIPS));
+		for (unsigned n = 0; n < shipCount && !reader.HasOverflowed(); n++) {
+			glm::vec2 ship;
+			ship.x = reader.ReadFloat(-NET_POSITION_LIMIT, NET_POSITION_LIMIT, SNAPSHOT_SHIP_RESOLUTION);
+			ship.y = reader.ReadFloat(-NET_POSITION_LIMIT, NET_POSITION_LIMIT, SNAPSHOT_SHIP_RESOLUTION);
+			decoded->mShips.push_back(ship);
+		}
+
+		size_t j = 0;
+		while (reader.ReadBool()) {
+			uint16_t id = static_cast<uint16_t>(reader.ReadBits(16));
+			uint8_t fields = static_cast<uint8_t>(reader.ReadBits(ENTITY_FIELD_BITS));
+
+			//the asteroids of the baseline the message does not mention
+			while (j < previous.size() && previous[j].mID < id)
+				decoded->mAsteroids.push_back(DeadReckonAsteroid(previous[j++], previousShips, elapsed));
+
+			const AsteroidUpdatePacket* old = nullptr;
+			if (j < previous.size() && previous[j].mID == id)
+				old = &previous[j++];
+
+			if (fields & Removed)
+				continue;
+
+			//a new asteroid has to come whole
+			if (!old && (fields & (Position | Velocity)) != (Position | Velocity))
+				return false;
+
+			AsteroidUpdatePacket state{};
+			if (old)
+				state = DeadReckonAsteroid(*old, previousShips, elapsed);
+			state.mID = id;
+			if (fields & Position)
+				state.mPosition = ReadPosition(reader);
+			if (fields & Velocity)
+				state.mVelocity = ReadVelocity(reader, NET_ASTEROID_SPEED_LIMIT);
+			if (reader.HasOverflowed())
+				return false;
+
+			decoded->mAsteroids.push_back(state);
+		}
+
+		while (j < previous.size())
+			decoded->mAsteroids.push_back(DeadReckonAsteroid(previous[j++], previousShips, elapsed));
+
+		return !reader.HasOverflowed() && reader.GetBytesRead() == size;
+	}
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include "protocol.hpp"
+#include "priority_accumulator.hpp"
+
+#include <array>
+#include <vector>
+
+namespace CS260 {
+
+	// Time between two snapshots of the asteroids sent to each client (20 Hz)
+	const unsigned snapshotInterval = 50;
+
+	// Snapshots remembered to be used as baselines, counting back from the newest one, must be a power of two
+	const unsigned SNAPSHOT_HISTORY_SIZE = 32;
+
+	// Part of the byte budget of a client a snapshot can use, the rest is left for the other messages of the tick
+	const float SNAPSHOT_BUDGET_SHARE = 0.5f;
+
+	// Distance an asteroid may drift from where the dead reckoning takes it before its position is sent again
+	const float SNAPSHOT_POSITION_TOLERANCE = 1.0f;
+
+	// Difference from the dead reckoned velocity of an asteroid over which its velocity is sent again
+	const float SNAPSHOT_VELOCITY_TOLERANCE = 2.0f;
+
+	// Precision of the positions of the ships in a snapshot, they are only used to steer the asteroids. 10 bits per component
+	const float SNAPSHOT_SHIP_RESOLUTION = 4.0f;
+
+	// Ships a snapshot carries at most, past it the dead reckoning steers toward the ones it has
+	const unsigned SNAPSHOT_MAX_SHIPS = 63;
+
+	// Step the dead reckoning is integrated with, in seconds
+	const float DEAD_RECKONING_STEP = tickRate / 1000.0f;
+
+	// How the asteroids move on their own. The dead reckoning has to move them the way the game does for it to hold
+	struct AsteroidMotion
+	{
+		// Acceleration toward the nearest ship for each unit of distance to it
+		float mSteering = 0.0f;
+		// Speed over which they are slowed down, 0 for no limit
+		float mMaxSpeed = 0.0f;
+		// The speed over the limit is reduced by this to the power of the step, per step
+		float mDamping = 1.0f;
+		// Corners of the play field, leaving one side they come back from the other. Not wrapped if it is empty
+		glm::vec2 mWrapMin = { 0.0f, 0.0f };
+		glm::vec2 mWrapMax = { 0.0f, 0.0f };
+	};
+
+	// State of every asteroid at a given time
+	struct Snapshot
+	{
+		uint16_t mID = 0;
+		//milliseconds in the clock of the server, used to move the asteroids from a baseline
+		uint32_t mTime = 0;
+		//sorted by id
+		std::vector<AsteroidUpdatePacket> mAsteroids;
+		//where the ships the asteroids steer toward were
+		std::vector<glm::vec2> mShips;
+	};
+
+	// Last snapshots sent to or received from a peer, found by their id
+	class SnapshotHistory {
+
+	public:
+		/**
+		* @brief
+		* Keeps a copy of the snapshot, replacing the one SNAPSHOT_HISTORY_SIZE ids older
+		*/
+		void Store(const Snapshot& snapshot);
+
+		/**
+		* @brief
+		* Returns the snapshot with the given id, null if it is not remembered anymore
+		*/
+		const Snapshot* Find(uint16_t id) const;
+
+		/**
+		* @brief
+		* Forgets every snapshot
+		*/
+		void Clear();
+
+	private:
+		struct Entry
+		{
+			bool mValid = false;
+			Snapshot mSnapshot;
+		};
+
+		std::array<Entry, SNAPSHOT_HISTORY_SIZE> mEntries;
+	};
+
+	/**
+	* @brief
+	* Sets how the asteroids move on their own, for the dead reckoning of the snapshots. Both peers need the same one.
+	* Without it they keep moving in a straight line and never wrap
+	*/
+	void SetAsteroidMotion(const AsteroidMotion& motion);
+
+	/**
+	* @brief
+	* Moves an asteroid on its own for the given seconds, steering toward the nearest of the given ships
+	*/
+	AsteroidUpdatePacket DeadReckonAsteroid(const AsteroidUpdatePacket& asteroid, const std::vector<glm::vec2>& ships, float elapsed);
+
+	/**
+	* @brief
+	* Where the peer has an asteroid of the baseline at the given time if it is not told anything about it
+	* @return
+	* False if the baseline does not have the asteroid
+	*/
+	bool PredictAsteroid(const Snapshot& baseline, uint16_t id, uint32_t time, AsteroidUpdatePacket* predicted);
+
+	/**
+	* @brief
+	* Bytes the header and the ships of a snapshot take, the least capacity EncodeSnapshot needs
+	* @param hasBaseline : whether it is encoded relative to a baseline
+	*/
+	unsigned GetSnapshotMinimumSize(const Snapshot& current, bool hasBaseline);
+
+	/**
+	* @brief
+	* Encodes only what changed in the snapshot relative to the baseline: new and removed asteroids, and the velocities
+	* and positions that drifted from where the dead reckoning from the baseline takes them. The ships are always sent whole.
+	* Positions and velocities are quantized like the asteroid updates. If it does not all fit, the asteroids with the most
+	* accumulated priority are sent and the rest is left for a later snapshot
+	* @param current : snapshot to send
+	* @param baseline : newest snapshot the peer acknowledged, null to encode everything
+	* @param buffer : where to write the message
+	* @param capacity : size of the buffer
+	* @param encoded : out parameter for the snapshot the peer will have after decoding the message, to be stored as a baseline
+	* @param priorities : priority of the asteroids for the peer, the ones sent are reset. Without it they go by id
+	* @return
+	* The size of the message, 0 if not even the header and the ships fit in the capacity, see GetSnapshotMinimumSize
+	*/
+	unsigned EncodeSnapshot(const Snapshot& current, const Snapshot* baseline, char* buffer, unsigned capacity, Snapshot* encoded, PriorityAccumulator* priorities = nullptr);
+
+	/**
+	* @brief
+	* Decodes a message written by EncodeSnapshot
+	* @param history : snapshots received before, the baseline is taken from them
+	* @param decoded : out parameter for the whole snapshot, the asteroids it does not carry moved from the baseline
+	* @return
+	* False if the message is malformed or its baseline is not in the history
+	*/
+	bool DecodeSnapshot(const char* buffer, unsigned size, const SnapshotHistory& history, Snapshot* decoded);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace CS260 {
+
+	// Lock-free ring buffer between exactly one producer thread and one consumer thread.
+	// Elements are written and read in place, so big elements are never copied as a whole
+	template <typename T, unsigned Capacity>
+	class SpscQueue {
+
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	public:
+		/**
+		* @brief
+		* Producer side. Returns the slot the next element has to be written to, null if the queue is full
+		*/
+		T* BeginPush()
+		{
+			unsigned tail = mTail.load(std::memory_order_relaxed);
+			if (tail - mCachedHead == Capacity) {
+				mCachedHead = mHead.load(std::memory_order_acquire);
+				if (tail - mCachedHead == Capacity)
+					return nullptr;
+			}
+			return &mElements[tail & (Capacity - 1)];
+		}
+
+		/**
+		* @brief
+		* Producer side. Publishes the element written to the slot returned by BeginPush
+		*/
+		void EndPush()
+		{
+			mTail.store(mTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		/**
+		* @brief
+		* Consumer side. Returns the oldest element, null if the queue is empty
+		*/
+		T* Front()
+		{
+			unsigned head = mHead.load(std::memory_order_relaxed);
+			if (head == mCachedTail) {
+				mCachedTail = mTail.load(std::memory_order_acquire);
+				if (head == mCachedTail)
+					return nullptr;
+			}
+			return &mElements[head & (Capacity - 1)];
+		}
+
+		/**
+		* @brief
+		* Consumer side. Releases the element returned by Front so its slot can be reused
+		*/
+		void Pop()
+		{
+			mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+	private:
+		std::array<T, Capacity> mElements{};
+
+		//each index is only written by its own side, and they live in different cache lines
+		alignas(64) std::atomic<unsigned> mHead{ 0 };
+		unsigned mCachedTail = 0;
+		alignas(64) std::atomic<unsigned> mTail{ 0 };
+		unsigned mCachedHead = 0;
+	};
+}
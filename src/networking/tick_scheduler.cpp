@@ -0,0 +1,50 @@
+#include "tick_scheduler.hpp"
+
+namespace CS260
+{
+	TickScheduler::TickScheduler(unsigned periodMs) :
+		mPeriod(std::chrono::milliseconds(periodMs)),
+		mNextDeadline(now() + mPeriod)
+	{
+	}
+
+	void TickScheduler::Reset()
+	{
+		mNextDeadline = now() + mPeriod;
+	}
+
+	unsigned TickScheduler::ConsumeTicks()
+	{
+		auto current = now();
+		if (current < mNextDeadline)
+			return 0;
+
+		//every deadline is a whole number of periods after the previous one, however late we look at it
+		auto late = current - mNextDeadline;
+		unsigned ticks = static_cast<unsigned>(late / mPeriod) + 1;
+		if (ticks > TICK_MAX_CATCH_UP) {
+			//too far behind, catching up would only make the next ticks late too
+			mNextDeadline = current + mPeriod;
+			return TICK_MAX_CATCH_UP;
+		}
+
+		mNextDeadline += mPeriod * ticks;
+		return ticks;
+	}
+
+	unsigned TickScheduler::GetMsUntilNextTick() const
+	{
+		auto current = now();
+		if (current >= mNextDeadline)
+			return 0;
+
+		//round up, waking before the deadline would only mean waiting again
+		auto left = std::chrono::duration_cast<std::chrono::microseconds>(mNextDeadline - current).count();
+		return static_cast<unsigned>((left + 999) / 1000);
+	}
+
+	clock_t::time_point TickScheduler::GetNextDeadline() const
+	{
+		return mNextDeadline;
+	}
+}
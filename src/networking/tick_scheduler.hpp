@@ -0,0 +1,50 @@
+#pragma once
+#include "networking.hpp"
+#include "utils.hpp"
+
+namespace CS260 {
+
+	//ticks a scheduler runs in a row to catch up, past them the late ones are dropped
+	const unsigned TICK_MAX_CATCH_UP = 4;
+
+	// Keeps ticks on exact multiples of a period from its start, so a late tick does not delay the next ones
+	class TickScheduler {
+
+	public:
+		/**
+		* @brief
+		*  Constructs a scheduler whose first tick is one period from now
+		* @param periodMs : milliseconds between ticks
+		*/
+		explicit TickScheduler(unsigned periodMs);
+
+		/**
+		* @brief
+		* Starts counting the periods again from now
+		*/
+		void Reset();
+
+		/**
+		* @brief
+		* Ticks whose time came since the last call, moving on to the next deadline.
+		* If more than TICK_MAX_CATCH_UP were missed the rest are dropped and the ticks continue from now
+		*/
+		unsigned ConsumeTicks();
+
+		/**
+		* @brief
+		* Milliseconds until the next tick, 0 if it is already due
+		*/
+		unsigned GetMsUntilNextTick() const;
+
+		/**
+		* @brief
+		* Time of the next tick
+		*/
+		clock_t::time_point GetNextDeadline() const;
+
+	private:
+		clock_t::duration mPeriod;
+		clock_t::time_point mNextDeadline;
+	};
+}
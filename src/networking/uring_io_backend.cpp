@@ -0,0 +1,263 @@
+#if defined(__linux__) && defined(ASTEROIDS_IO_URING)
+#include "uring_io_backend.hpp"
+
+#include <sys/utsname.h>
+#include <cstring>
+#include <cstdio>
+
+namespace CS260
+{
+	namespace
+	{
+		//user data of the receive and wakeup completions, the sends use their slot index
+		const uint64_t RECEIVE_TAG = UINT64_MAX;
+		const uint64_t WAKEUP_TAG = UINT64_MAX - 1;
+
+		/**
+		* @brief
+		* Multishot recvmsg needs Linux 6.0
+		*/
+		bool KernelSupportsMultishotReceive()
+		{
+			utsname name;
+			int major = 0;
+			int minor = 0;
+			if (uname(&name) != 0 || sscanf(name.release, "%d.%d", &major, &minor) != 2)
+				return false;
+			return major >= 6;
+		}
+	}
+
+	UringIoBackend::UringIoBackend(SOCKET socket) :
+		mSocket(socket),
+		mWakeup(CreateWakeup()),
+		mRing{},
+		mValid(false),
+		mBufferRing(nullptr),
+		mReceiveBufferSize(sizeof(io_uring_recvmsg_out) + sizeof(sockaddr) + MAX_DATAGRAM_SIZE),
+		mReceiveHeader{},
+		mReceiveArmed(false),
+		mHeldBuffer(-1),
+		mWakeupArmed(false),
+		mNextCompletion(0),
+		mSendSlots(URING_SEND_SLOTS)
+	{
+		if (!KernelSupportsMultishotReceive() || io_uring_queue_init(URING_QUEUE_DEPTH, &mRing, 0) != 0)
+			return;
+
+		int result = 0;
+		mBufferRing = io_uring_setup_buf_ring(&mRing, URING_RECEIVE_BUFFERS, URING_BUFFER_GROUP, 0, &result);
+		if (!mBufferRing) {
+			io_uring_queue_exit(&mRing);
+			return;
+		}
+		mValid = true;
+
+		//lend every receive buffer to the kernel
+		mReceiveBuffers.resize(URING_RECEIVE_BUFFERS * mReceiveBufferSize);
+		for (unsigned i = 0; i < URING_RECEIVE_BUFFERS; i++)
+			io_uring_buf_ring_add(mBufferRing, BufferAt(i), mReceiveBufferSize, static_cast<unsigned short>(i), io_uring_buf_ring_mask(URING_RECEIVE_BUFFERS), static_cast<int>(i));
+		io_uring_buf_ring_advance(mBufferRing, URING_RECEIVE_BUFFERS);
+
+		mCompletions.reserve(URING_RECEIVE_BUFFERS);
+		mFreeSendSlots.reserve(URING_SEND_SLOTS);
+		for (unsigned i = 0; i < URING_SEND_SLOTS; i++)
+			mFreeSendSlots.push_back(URING_SEND_SLOTS - 1 - i);
+
+		//only the size of the address matters, the kernel lays it out in each buffer
+		mReceiveHeader.msg_namelen = sizeof(sockaddr);
+		ArmReceive();
+		ArmWakeup();
+		io_uring_submit(&mRing);
+	}
+
+	UringIoBackend::~UringIoBackend()
+	{
+		if (mValid) {
+			io_uring_submit(&mRing);
+			io_uring_free_buf_ring(&mRing, mBufferRing, URING_RECEIVE_BUFFERS, URING_BUFFER_GROUP);
+			io_uring_queue_exit(&mRing);
+		}
+		DestroyWakeup(mWakeup);
+	}
+
+	bool UringIoBackend::IsValid() const
+	{
+		return mValid;
+	}
+
+	void UringIoBackend::Send(const char* data, unsigned size, const sockaddr* addr)
+	{
+		//every slot is in flight or it is not one of our datagrams, send it the usual way
+		if (mFreeSendSlots.empty() || size > MAX_DATAGRAM_SIZE) {
+			if (addr)
+				sendto(mSocket, data, size, 0, addr, sizeof(sockaddr));
+			else
+				send(mSocket, data, size, 0);
+			return;
+		}
+
+		unsigned index = mFreeSendSlots.back();
+		mFreeSendSlots.pop_back();
+
+		SendSlot& slot = mSendSlots[index];
+		memcpy(slot.mData.data(), data, size);
+		slot.mVector.iov_base = slot.mData.data();
+		slot.mVector.iov_len = size;
+		slot.mHeader = msghdr{};
+		slot.mHeader.msg_iov = &slot.mVector;
+		slot.mHeader.msg_iovlen = 1;
+		//without an address it goes to the connected endpoint
+		if (addr) {
+			slot.mAddress = *addr;
+			slot.mHeader.msg_name = &slot.mAddress;
+			slot.mHeader.msg_namelen = sizeof(sockaddr);
+		}
+
+		io_uring_sqe* sqe = GetSubmission();
+		io_uring_prep_sendmsg(sqe, mSocket, &slot.mHeader, 0);
+		io_uring_sqe_set_data64(sqe, index);
+	}
+
+	void UringIoBackend::FlushSends()
+	{
+		if (io_uring_sq_ready(&mRing))
+			io_uring_submit(&mRing);
+		ReapCompletions();
+	}
+
+	bool UringIoBackend::Receive(const char** data, unsigned* size, sockaddr* addr)
+	{
+		RecycleHeldBuffer();
+
+		//every completion we had was returned, look for new ones
+		if (mNextCompletion == mCompletions.size()) {
+			mCompletions.clear();
+			mNextCompletion = 0;
+
+			if (io_uring_sq_ready(&mRing))
+				io_uring_submit(&mRing);
+			ReapCompletions();
+
+			if (mCompletions.empty())
+				return false;
+		}
+
+		const Completion& completion = mCompletions[mNextCompletion++];
+		mHeldBuffer = static_cast<int>(completion.mFlags >> IORING_CQE_BUFFER_SHIFT);
+
+		//anything that does not fit in a buffer is not ours, let the protocol discard it as too small
+		*size = 0;
+		io_uring_recvmsg_out* out = io_uring_recvmsg_validate(BufferAt(mHeldBuffer), completion.mResult, &mReceiveHeader);
+		if (!out || (out->flags & MSG_TRUNC))
+			return true;
+
+		*data = static_cast<const char*>(io_uring_recvmsg_payload(out, &mReceiveHeader));
+		*size = io_uring_recvmsg_payload_length(out, completion.mResult, &mReceiveHeader);
+		if (addr)
+			memcpy(addr, io_uring_recvmsg_name(out), sizeof(sockaddr));
+		return true;
+	}
+
+	bool UringIoBackend::Wait(unsigned timeoutMs)
+	{
+		//still receives we did not return
+		if (mNextCompletion != mCompletions.size())
+			return true;
+
+		__kernel_timespec time{};
+		time.tv_sec = timeoutMs / 1000;
+		time.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+
+		//this only looks at the completion, it is consumed by the next Receive
+		io_uring_cqe* cqe;
+		return io_uring_wait_cqe_timeout(&mRing, &cqe, &time) == 0;
+	}
+
+	void UringIoBackend::Wake()
+	{
+		SignalWakeup(mWakeup);
+	}
+
+	io_uring_sqe* UringIoBackend::GetSubmission()
+	{
+		io_uring_sqe* sqe = io_uring_get_sqe(&mRing);
+		if (!sqe) {
+			io_uring_submit(&mRing);
+			sqe = io_uring_get_sqe(&mRing);
+		}
+		return sqe;
+	}
+
+	void UringIoBackend::ArmReceive()
+	{
+		io_uring_sqe* sqe = GetSubmission();
+		io_uring_prep_recvmsg_multishot(sqe, mSocket, &mReceiveHeader, 0);
+		sqe->flags |= IOSQE_BUFFER_SELECT;
+		sqe->buf_group = URING_BUFFER_GROUP;
+		io_uring_sqe_set_data64(sqe, RECEIVE_TAG);
+		mReceiveArmed = true;
+	}
+
+	void UringIoBackend::ArmWakeup()
+	{
+		io_uring_sqe* sqe = GetSubmission();
+		io_uring_prep_poll_multishot(sqe, mWakeup, POLLIN);
+		io_uring_sqe_set_data64(sqe, WAKEUP_TAG);
+		mWakeupArmed = true;
+	}
+
+	void UringIoBackend::ReapCompletions()
+	{
+		unsigned head;
+		unsigned count = 0;
+		io_uring_cqe* cqe;
+
+		io_uring_for_each_cqe(&mRing, head, cqe) {
+			count++;
+
+			//only there to end the wait, the poll stays armed while the kernel allows it
+			if (cqe->user_data == WAKEUP_TAG) {
+				ClearWakeup(mWakeup);
+				if (!(cqe->flags & IORING_CQE_F_MORE))
+					mWakeupArmed = false;
+				continue;
+			}
+
+			//a send finished, its slot can be reused
+			if (cqe->user_data != RECEIVE_TAG) {
+				mFreeSendSlots.push_back(static_cast<unsigned>(cqe->user_data));
+				continue;
+			}
+
+			//the kernel ran out of buffers or failed, the receive has to be armed again
+			if (!(cqe->flags & IORING_CQE_F_MORE))
+				mReceiveArmed = false;
+
+			if (cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+				mCompletions.push_back(Completion{ cqe->res, cqe->flags });
+		}
+		io_uring_cq_advance(&mRing, count);
+
+		if (!mReceiveArmed)
+			ArmReceive();
+		if (!mWakeupArmed)
+			ArmWakeup();
+	}
+
+	void UringIoBackend::RecycleHeldBuffer()
+	{
+		if (mHeldBuffer < 0)
+			return;
+
+		io_uring_buf_ring_add(mBufferRing, BufferAt(mHeldBuffer), mReceiveBufferSize, static_cast<unsigned short>(mHeldBuffer), io_uring_buf_ring_mask(URING_RECEIVE_BUFFERS), 0);
+		io_uring_buf_ring_advance(mBufferRing, 1);
+		mHeldBuffer = -1;
+	}
+
+	char* UringIoBackend::BufferAt(unsigned id)
+	{
+		return mReceiveBuffers.data() + static_cast<size_t>(id) * mReceiveBufferSize;
+	}
+}
+#endif
@@ -0,0 +1,153 @@
+#pragma once
+#if defined(__linux__) && defined(ASTEROIDS_IO_URING)
+#include "io_backend.hpp"
+
+#include <liburing.h>
+
+#include <array>
+#include <vector>
+
+namespace CS260 {
+
+	// Entries of the submission queue
+	const unsigned URING_QUEUE_DEPTH = 512;
+
+	// Receive buffers lent to the kernel, must be a power of two
+	const unsigned URING_RECEIVE_BUFFERS = 256;
+
+	// Identifier of our group of receive buffers
+	const unsigned short URING_BUFFER_GROUP = 0;
+
+	// Sends that can be in flight at the same time
+	const unsigned URING_SEND_SLOTS = 256;
+
+	// io_uring backend: a multishot receive keeps filling buffers from a provided ring,
+	// and sends are queued to the kernel without waiting for them to complete
+	class UringIoBackend : public IoBackend {
+
+	public:
+		/**
+		* @brief
+		*  Creates the ring, lends the receive buffers to the kernel and arms the receive
+		*/
+		UringIoBackend(SOCKET socket);
+
+		/**
+		* @brief
+		*  Submits what is left and destroys the ring and the wakeup
+		*/
+		~UringIoBackend() override;
+
+		/**
+		* @brief
+		* Whether the ring could be created, the kernel may not support everything we need
+		*/
+		bool IsValid() const;
+
+		/**
+		* @brief
+		* Copies the datagram into a free send slot and queues its submission
+		*/
+		void Send(const char* data, unsigned size, const sockaddr* addr) override;
+
+		/**
+		* @brief
+		* Submits the queued sends and frees the slots of the completed ones, without waiting for them
+		*/
+		void FlushSends() override;
+
+		/**
+		* @brief
+		* Returns the next completed receive, its buffer is given back to the kernel on the next call
+		*/
+		bool Receive(const char** data, unsigned* size, sockaddr* addr) override;
+
+		/**
+		* @brief
+		* Waits for the next completion, the wakeup is polled by the ring too
+		*/
+		bool Wait(unsigned timeoutMs) override;
+
+		/**
+		* @brief
+		* Signals the wakeup
+		*/
+		void Wake() override;
+
+		IoBackendType GetType() const override { return IoBackendType::Uring; }
+
+	private:
+		//a completed receive waiting to be returned
+		struct Completion
+		{
+			int mResult;
+			unsigned mFlags;
+		};
+
+		//a send in flight, the kernel reads the datagram from here until it completes
+		struct SendSlot
+		{
+			msghdr mHeader;
+			iovec mVector;
+			sockaddr mAddress;
+			std::array<char, MAX_DATAGRAM_SIZE> mData;
+		};
+
+		/**
+		* @brief
+		* Gets a submission entry, submitting the full queue if needed
+		*/
+		io_uring_sqe* GetSubmission();
+
+		/**
+		* @brief
+		* Queues the multishot receive, it stays armed until the kernel runs out of buffers
+		*/
+		void ArmReceive();
+
+		/**
+		* @brief
+		* Queues the multishot poll of the wakeup
+		*/
+		void ArmWakeup();
+
+		/**
+		* @brief
+		* Consumes every completion, keeping the receives, freeing the slots of the sends and clearing the wakeup
+		*/
+		void ReapCompletions();
+
+		/**
+		* @brief
+		* Gives back to the kernel the buffer of the last datagram returned
+		*/
+		void RecycleHeldBuffer();
+
+		/**
+		* @brief
+		* Start of the receive buffer with the given id
+		*/
+		char* BufferAt(unsigned id);
+
+		SOCKET mSocket;
+		SOCKET mWakeup;
+		io_uring mRing;
+		bool mValid;
+
+		//receive buffers, each one holds the recvmsg header, the sender address and the payload
+		io_uring_buf_ring* mBufferRing;
+		std::vector<char> mReceiveBuffers;
+		unsigned mReceiveBufferSize;
+		msghdr mReceiveHeader;
+		bool mReceiveArmed;
+		int mHeldBuffer;
+		bool mWakeupArmed;
+
+		std::vector<Completion> mCompletions;
+		unsigned mNextCompletion;
+
+		std::vector<SendSlot> mSendSlots;
+		std::vector<unsigned> mFreeSendSlots;
+	};
+}
+#endif